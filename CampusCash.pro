@@ -222,6 +222,12 @@ HEADERS += src/qt/bitcoingui.h \
     src/qt/bitcoinaddressvalidator.h \
     src/alert.h \
     src/blocksizecalculator.h \
+    src/socketevents.h \
+    src/orphanblocks.h \
+    src/headerchain.h \
+    src/blockdownload.h \
+    src/txcache.h \
+    src/checkqueue.h \
     src/allocators.h \
     src/addrman.h \
     src/base58.h \
@@ -329,6 +335,7 @@ HEADERS += src/qt/bitcoingui.h \
     src/crypto/common/ripemd160.h \
     src/crypto/common/sha1.h \
     src/crypto/common/sha256.h \
+    src/crypto/common/sha256_lanes.h \
     src/crypto/common/sha512.h \
     src/stb/stb_image.h \
     src/stb/stb_image_write.h \
@@ -357,6 +364,7 @@ HEADERS += src/qt/bitcoingui.h \
     src/crypto/common/sph_echo.h \
     src/crypto/common/sph_types.h \
     src/crypto/bmw/bmw512.h \
+    src/crypto/bmw/bmw512_lanes.h \
     src/crypto/echo/echo512.h \
     src/limitedmap.h
 
@@ -377,6 +385,11 @@ SOURCES += src/qt/bitcoin.cpp src/qt/bitcoingui.cpp \
     src/qt/bitcoinaddressvalidator.cpp \
     src/alert.cpp \
     src/blocksizecalculator.cpp \
+    src/socketevents.cpp \
+    src/orphanblocks.cpp \
+    src/headerchain.cpp \
+    src/blockdownload.cpp \
+    src/txcache.cpp \
     src/allocators.cpp \
     src/base58.cpp \
     src/blockparams.cpp \
@@ -474,7 +487,13 @@ SOURCES += src/qt/bitcoin.cpp src/qt/bitcoingui.cpp \
     src/crypto/common/ripemd160.cpp \
     src/crypto/common/sha1.cpp \
     src/crypto/common/sha256.cpp \
+    src/crypto/common/sha256_sse41.cpp \
+    src/crypto/common/sha256_avx2.cpp \
+    src/crypto/common/sha256_shani.cpp \
     src/crypto/common/sha512.cpp \
+    src/crypto/bmw/bmw512.cpp \
+    src/crypto/bmw/bmw512_sse2.cpp \
+    src/crypto/bmw/bmw512_avx2.cpp \
     src/qt/masternodemanager.cpp \
     src/qt/addeditadrenalinenode.cpp \
     src/qt/adrenalinenodeconfigdialog.cpp \
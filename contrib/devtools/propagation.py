@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The CampusCash developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+'''
+Measure how long a new block takes to cross a line of local regtest nodes.
+
+Starts NODES daemons, each connected only to the one before it, mines a
+block on the first and polls every node until it has the block. Prints the
+delay to each node and the average per hop. Run it against two builds to
+compare them:
+
+    propagation.py --daemon ./CampusCashd --nodes 8 --blocks 20
+    propagation.py --daemon ./CampusCashd --nodes 8 --blocks 20 --args=-msghandlerthreads=4
+
+Each node gets a throwaway data directory under /tmp.
+'''
+import argparse
+import base64
+import http.client
+import json
+import os
+import shutil
+import subprocess
+import tempfile
+import time
+
+RPC_USER = 'bench'
+RPC_PASSWORD = 'bench'
+
+
+class RPC(object):
+    def __init__(self, port):
+        self.port = port
+        self.auth = base64.b64encode(('%s:%s' % (RPC_USER, RPC_PASSWORD)).encode()).decode()
+
+    def call(self, method, *params):
+        conn = http.client.HTTPConnection('127.0.0.1', self.port, timeout=30)
+        body = json.dumps({'version': '1.1', 'method': method, 'params': params, 'id': 1})
+        conn.request('POST', '/', body, {'Authorization': 'Basic ' + self.auth,
+                                         'Content-Type': 'application/json'})
+        reply = json.loads(conn.getresponse().read().decode())
+        conn.close()
+        if reply.get('error'):
+            raise RuntimeError('%s: %s' % (method, reply['error']))
+        return reply['result']
+
+
+def start_nodes(args, root):
+    nodes = []
+    for i in range(args.nodes):
+        datadir = os.path.join(root, 'node%d' % i)
+        os.makedirs(datadir)
+        cmd = [args.daemon, '-regtest', '-datadir=' + datadir, '-listen=1', '-server=1',
+               '-port=%d' % (args.port + i), '-rpcport=%d' % (args.rpcport + i),
+               '-rpcuser=' + RPC_USER, '-rpcpassword=' + RPC_PASSWORD,
+               '-dnsseed=0', '-discover=0', '-staking=0', '-printtoconsole=0']
+        if i > 0:
+            cmd.append('-connect=127.0.0.1:%d' % (args.port + i - 1))
+        cmd += args.args
+        nodes.append((subprocess.Popen(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL),
+                      RPC(args.rpcport + i)))
+    # Wait for RPC, then for each node to see its predecessor
+    for _, rpc in nodes:
+        for _ in range(600):
+            try:
+                rpc.call('getblockcount')
+                break
+            except (OSError, RuntimeError, ValueError):
+                time.sleep(0.1)
+    for _, rpc in nodes[1:]:
+        while not rpc.call('getpeerinfo'):
+            time.sleep(0.1)
+    return nodes
+
+
+def mine_one(rpc):
+    height = rpc.call('getblockcount')
+    rpc.call('setgenerate', True, 1)
+    while rpc.call('getblockcount') == height:
+        time.sleep(0.001)
+    rpc.call('setgenerate', False)
+    return rpc.call('getbestblockhash')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Block propagation delay through a line of regtest nodes')
+    parser.add_argument('--daemon', required=True, help='path to CampusCashd')
+    parser.add_argument('--nodes', type=int, default=6)
+    parser.add_argument('--blocks', type=int, default=10)
+    parser.add_argument('--port', type=int, default=31000)
+    parser.add_argument('--rpcport', type=int, default=32000)
+    parser.add_argument('--args', action='append', default=[], help='extra daemon argument, repeatable')
+    args = parser.parse_args()
+
+    root = tempfile.mkdtemp(prefix='propagation-')
+    nodes = start_nodes(args, root)
+    try:
+        delays = [[] for _ in nodes]
+        for _ in range(args.blocks):
+            # The clock starts when the first node reports the block, so the
+            # next one may already be a little way into receiving it
+            hash_block = mine_one(nodes[0][1])
+            start = time.time()
+            pending = set(range(1, len(nodes)))
+            while pending:
+                for i in list(pending):
+                    if nodes[i][1].call('getbestblockhash') == hash_block:
+                        delays[i].append(time.time() - start)
+                        pending.discard(i)
+                if time.time() - start > 60:
+                    raise RuntimeError('block did not reach nodes %s' % sorted(pending))
+        for i in range(1, len(nodes)):
+            print('node %d: %.1fms' % (i, 1000 * sum(delays[i]) / len(delays[i])))
+        last = delays[-1]
+        print('per hop: %.1fms' % (1000 * sum(last) / len(last) / (len(nodes) - 1)))
+    finally:
+        for _, rpc in nodes:
+            try:
+                rpc.call('stop')
+            except (OSError, RuntimeError, ValueError):
+                pass
+        for process, _ in nodes:
+            process.wait()
+        shutil.rmtree(root)
+
+
+if __name__ == '__main__':
+    main()
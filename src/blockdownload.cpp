@@ -0,0 +1,142 @@
+// Copyright (c) 2026 The CampusCash developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockdownload.h"
+
+using namespace std;
+
+bool CBlockDownloadQueue::Add(const uint256& hash, NodeId nodeFrom, int nHeight, int64_t nNow)
+{
+    if (mapBlocks.count(hash))
+        return false;
+
+    // Blocks without a height go after the others without one, the rest
+    // after those at their height or below, which is mostly at the back
+    list<CBlockToDownload>::iterator it;
+    if (nHeight < 0)
+    {
+        it = listBlocks.begin();
+        while (it != listBlocks.end() && it->nHeight < 0)
+            ++it;
+    }
+    else
+    {
+        it = listBlocks.end();
+        while (it != listBlocks.begin())
+        {
+            list<CBlockToDownload>::iterator itPrev = it;
+            if ((--itPrev)->nHeight <= nHeight)
+                break;
+            it = itPrev;
+        }
+    }
+
+    CBlockToDownload entry = {hash, nodeFrom, nHeight, nNow};
+    mapBlocks[hash] = listBlocks.insert(it, entry);
+    return true;
+}
+
+bool CBlockDownloadQueue::PushFront(const uint256& hash, int nHeight, int64_t nNow)
+{
+    if (nHeight < 0 || mapBlocks.count(hash))
+        return false;
+
+    list<CBlockToDownload>::iterator it = listBlocks.begin();
+    while (it != listBlocks.end() && it->nHeight < nHeight)
+        ++it;
+
+    CBlockToDownload entry = {hash, -1, nHeight, nNow};
+    mapBlocks[hash] = listBlocks.insert(it, entry);
+    return true;
+}
+
+bool CBlockDownloadQueue::Remove(const uint256& hash, NodeId& nodeFromRet)
+{
+    map<uint256, list<CBlockToDownload>::iterator>::iterator it = mapBlocks.find(hash);
+    if (it == mapBlocks.end())
+        return false;
+
+    nodeFromRet = it->second->nodeFrom;
+    listBlocks.erase(it->second);
+    mapBlocks.erase(it);
+    return true;
+}
+
+void CBlockDownloadQueue::FindNext(NodeId nodeid, int nMaxHeight, int nWindowEnd, int64_t nQueuedBefore,
+                                   unsigned int nCount, vector<CBlockToDownload>& vBlocks) const
+{
+    for (list<CBlockToDownload>::const_iterator it = listBlocks.begin(); it != listBlocks.end() && vBlocks.size() < nCount; ++it)
+    {
+        if (it->nHeight > nWindowEnd)
+            break;
+        if (it->nodeFrom == nodeid ||
+            (it->nHeight >= 0 && it->nHeight <= nMaxHeight && it->nTimeQueued <= nQueuedBefore))
+            vBlocks.push_back(*it);
+    }
+}
+
+unsigned int CBlockDownloadQueue::ForgetNode(NodeId nodeid)
+{
+    unsigned int nDropped = 0;
+    list<CBlockToDownload>::iterator it = listBlocks.begin();
+    while (it != listBlocks.end())
+    {
+        if (it->nodeFrom != nodeid)
+        {
+            ++it;
+        }
+        else if (it->nHeight < 0)
+        {
+            mapBlocks.erase(it->hash);
+            it = listBlocks.erase(it);
+            nDropped++;
+        }
+        else
+        {
+            it->nodeFrom = -1;
+            ++it;
+        }
+    }
+    return nDropped;
+}
+
+bool CBlockBuffer::Add(const CBlock& block, NodeId nodeFrom)
+{
+    uint256 hash = block.GetHash();
+    if (setBlocks.count(hash) || mapByParent.count(block.hashPrevBlock))
+        return false;
+
+    CEntry& entry = mapByParent[block.hashPrevBlock];
+    entry.buffered.block = block;
+    entry.buffered.hashBlock = hash;
+    entry.buffered.nodeFrom = nodeFrom;
+    entry.itOrder = listOrder.insert(listOrder.end(), block.hashPrevBlock);
+    setBlocks.insert(hash);
+    return true;
+}
+
+void CBlockBuffer::Take(map<uint256, CEntry>::iterator it, CBufferedBlock& bufferedRet)
+{
+    bufferedRet = it->second.buffered;
+    setBlocks.erase(bufferedRet.hashBlock);
+    listOrder.erase(it->second.itOrder);
+    mapByParent.erase(it);
+}
+
+bool CBlockBuffer::TakeChildOf(const uint256& hashParent, CBufferedBlock& bufferedRet)
+{
+    map<uint256, CEntry>::iterator it = mapByParent.find(hashParent);
+    if (it == mapByParent.end())
+        return false;
+    Take(it, bufferedRet);
+    return true;
+}
+
+bool CBlockBuffer::TakeOldest(CBufferedBlock& bufferedRet)
+{
+    if (listOrder.empty())
+        return false;
+    Take(mapByParent.find(listOrder.front()), bufferedRet);
+    return true;
+}
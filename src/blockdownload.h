@@ -0,0 +1,112 @@
+// Copyright (c) 2026 The CampusCash developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_BLOCKDOWNLOAD_H
+#define BITCOIN_BLOCKDOWNLOAD_H
+
+#include "main.h"
+
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
+
+/** A block waiting to be requested */
+struct CBlockToDownload
+{
+    uint256 hash;
+    NodeId nodeFrom;     // Peer that announced it, -1 once that one is gone.
+    int nHeight;         // Estimated height, -1 if unknown.
+    int64_t nTimeQueued; // When it was queued, or taken back from a peer.
+};
+
+/*
+ * CBlockDownloadQueue holds the blocks waiting to be requested, by estimated
+ * height and then in the order they were announced, those without one
+ * first. Those with an estimated height may be fetched from any peer that is
+ * far enough ahead, the rest only from the peer that announced them. Blocks
+ * taken back from a slow peer go ahead of the others at their height.
+ *
+ * Not locked, callers hold cs_main.
+ */
+class CBlockDownloadQueue
+{
+private:
+    std::list<CBlockToDownload> listBlocks;
+    std::map<uint256, std::list<CBlockToDownload>::iterator> mapBlocks;
+
+public:
+    /** Queue a block in height order, false if it is queued already */
+    bool Add(const uint256& hash, NodeId nodeFrom, int nHeight, int64_t nNow);
+
+    /** Queue a block taken back from a peer ahead of the others at its
+      * height, for any peer to fetch; false if it is queued already or has
+      * no estimated height */
+    bool PushFront(const uint256& hash, int nHeight, int64_t nNow);
+
+    /** Take a block off the queue, setting who it was queued for */
+    bool Remove(const uint256& hash, NodeId& nodeFromRet);
+
+    bool Contains(const uint256& hash) const { return mapBlocks.count(hash) != 0; }
+
+    /** Pick up to nCount blocks for a peer, in queue order: the ones it
+      * announced, and those with an estimated height up to nMaxHeight that
+      * were queued no later than nQueuedBefore. Nothing above nWindowEnd is
+      * looked at. */
+    void FindNext(NodeId nodeid, int nMaxHeight, int nWindowEnd, int64_t nQueuedBefore,
+                  unsigned int nCount, std::vector<CBlockToDownload>& vBlocks) const;
+
+    /** A peer went away: its blocks with an estimated height are left to the
+      * others, the rest are dropped. Returns how many were dropped. */
+    unsigned int ForgetNode(NodeId nodeid);
+
+    size_t size() const { return listBlocks.size(); }
+};
+
+/** A block fetched ahead of its parent */
+struct CBufferedBlock
+{
+    CBlock block;
+    uint256 hashBlock;
+    NodeId nodeFrom;
+};
+
+/*
+ * CBlockBuffer holds blocks of the initial download that arrived before
+ * their parent, by the hash of that parent, until the parent is accepted.
+ * It remembers the order they came in, so the one waiting longest can be
+ * let go first when it fills up.
+ *
+ * Not locked, callers hold cs_main.
+ */
+class CBlockBuffer
+{
+private:
+    struct CEntry
+    {
+        CBufferedBlock buffered;
+        std::list<uint256>::iterator itOrder;
+    };
+    std::map<uint256, CEntry> mapByParent;
+    std::set<uint256> setBlocks;
+    std::list<uint256> listOrder; // parents of the blocks, oldest block first
+
+    void Take(std::map<uint256, CEntry>::iterator it, CBufferedBlock& bufferedRet);
+
+public:
+    /** Hold a block, false if it is held already or its parent has a child here */
+    bool Add(const CBlock& block, NodeId nodeFrom);
+
+    bool Contains(const uint256& hash) const { return setBlocks.count(hash) != 0; }
+    bool HasChildOf(const uint256& hashParent) const { return mapByParent.count(hashParent) != 0; }
+
+    /** Let go of the block waiting for hashParent, false if there is none */
+    bool TakeChildOf(const uint256& hashParent, CBufferedBlock& bufferedRet);
+
+    /** Let go of the block held longest, false when empty */
+    bool TakeOldest(CBufferedBlock& bufferedRet);
+
+    size_t size() const { return mapByParent.size(); }
+};
+
+#endif
@@ -0,0 +1,167 @@
+// Copyright (c) 2026 The CampusCash developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bmw512.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#include <cpuid.h>
+#define USE_BMW512_X86
+#endif
+
+#include "bmw512_lanes.h"
+
+#ifdef USE_BMW512_X86
+namespace bmw512_sse2
+{
+void Headers80_2way(const unsigned char* in, unsigned char* out);
+}
+namespace bmw512_avx2
+{
+void Headers80_4way(const unsigned char* in, unsigned char* out);
+void Headers80_8way(const unsigned char* in, unsigned char* out);
+}
+#endif
+
+namespace
+{
+/** One message per "lane", plain 64-bit integer arithmetic. */
+struct OpsScalar
+{
+    typedef uint64_t V;
+    static const int N = 1;
+
+    static inline V Set1(uint64_t x) { return x; }
+    static inline V Load(const unsigned char* p, size_t)
+    {
+        return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+               (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+    }
+    static inline void Store(unsigned char* p, size_t, V x)
+    {
+        for (int i = 0; i < 8; i++)
+            p[i] = x >> (8 * i);
+    }
+    static inline V Add(V a, V b) { return a + b; }
+    static inline V Sub(V a, V b) { return a - b; }
+    static inline V Xor(V a, V b) { return a ^ b; }
+    static inline V Shl(V x, int n) { return x << n; }
+    static inline V Shr(V x, int n) { return x >> n; }
+};
+
+void Headers80_1way(const unsigned char* in, unsigned char* out)
+{
+    bmw512_lanes::Compressor<OpsScalar>::Headers80(in, 80, out);
+}
+
+typedef void (*HeadersFunc)(const unsigned char* in, unsigned char* out);
+
+struct CBMW512Implementation
+{
+    const char* pszName;
+    HeadersFunc fn;
+    int nLanes;
+};
+
+const CBMW512Implementation implScalar = { "scalar", Headers80_1way, 1 };
+#ifdef USE_BMW512_X86
+const CBMW512Implementation implSSE2 = { "sse2", bmw512_sse2::Headers80_2way, 2 };
+const CBMW512Implementation implAVX2 = { "avx2", bmw512_avx2::Headers80_4way, 4 };
+const CBMW512Implementation implAVX2x2 = { "avx2-8way", bmw512_avx2::Headers80_8way, 8 };
+#endif
+
+const CBMW512Implementation* pimpl = &implScalar;
+
+#ifdef USE_BMW512_X86
+bool HaveSSE2()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    return (edx >> 26) & 1;
+}
+
+bool HaveAVX2()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    // The OS has to save the ymm registers across context switches
+    if (!((ecx >> 27) & 1) || !((ecx >> 28) & 1))
+        return false;
+    uint32_t xcr0_lo, xcr0_hi;
+    __asm__ ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 6) != 6)
+        return false;
+    if (__get_cpuid_max(0, NULL) < 7)
+        return false;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx >> 5) & 1;
+}
+#endif
+
+const CBMW512Implementation* FindImplementation(const std::string& strName)
+{
+    if (strName == implScalar.pszName)
+        return &implScalar;
+#ifdef USE_BMW512_X86
+    if (strName == implSSE2.pszName && HaveSSE2())
+        return &implSSE2;
+    if (strName == implAVX2.pszName && HaveAVX2())
+        return &implAVX2;
+    if (strName == implAVX2x2.pszName && HaveAVX2())
+        return &implAVX2x2;
+#endif
+    return NULL;
+}
+}
+
+std::string BMW512AutoDetect()
+{
+    pimpl = &implScalar;
+#ifdef USE_BMW512_X86
+    // Two ymm chains per call measured no faster than one, so 4-way it is
+    if (HaveAVX2())
+        pimpl = &implAVX2;
+    else if (HaveSSE2())
+        pimpl = &implSSE2;
+#endif
+    return pimpl->pszName;
+}
+
+bool BMW512SelectImplementation(const std::string& strName)
+{
+    const CBMW512Implementation* p = FindImplementation(strName);
+    if (p == NULL)
+        return false;
+    pimpl = p;
+    return true;
+}
+
+int BMW512HeaderLanes()
+{
+    return pimpl->nLanes;
+}
+
+void Hash_bmw512_headers(const unsigned char* pheaders, size_t nCount, uint256* phashes)
+{
+    const CBMW512Implementation* p = pimpl;
+    size_t i = 0;
+    for (; i + p->nLanes <= nCount; i += p->nLanes)
+        p->fn(pheaders + 80 * i, (unsigned char*)phashes[i].begin());
+
+    // Pad a short tail out to a full set of lanes
+    if (i < nCount)
+    {
+        unsigned char vchIn[80 * 8];
+        uint256 vHash[8];
+        memset(vchIn, 0, sizeof(vchIn));
+        memcpy(vchIn, pheaders + 80 * i, 80 * (nCount - i));
+        p->fn(vchIn, (unsigned char*)vHash[0].begin());
+        for (size_t j = 0; i + j < nCount; j++)
+            phashes[i + j] = vHash[j];
+    }
+}
@@ -4,9 +4,7 @@
 #include "uint256.h"
 #include "../common/sph_bmw.h"
 
-#ifndef QT_NO_DEBUG
 #include <string>
-#endif
 
 #ifdef GLOBALDEFINED
 #define GLOBAL
@@ -44,6 +42,20 @@ inline uint256 Hash_bmw512(const T1 pbegin, const T1 pend)
     return hash[0].trim256();
 }
 
+/** Hash nCount 80-byte block headers stored back to back, several at a
+  * time with the implementation picked by BMW512AutoDetect. */
+void Hash_bmw512_headers(const unsigned char* pheaders, size_t nCount, uint256* phashes);
+
+/** Pick the widest header implementation this CPU supports and return its name */
+std::string BMW512AutoDetect();
+
+/** Force a header implementation ("scalar", "sse2", "avx2", "avx2-8way");
+  * false if it is unknown or this CPU cannot run it */
+bool BMW512SelectImplementation(const std::string& strName);
+
+/** Headers hashed per call by the current implementation */
+int BMW512HeaderLanes();
+
 
 
 
@@ -0,0 +1,97 @@
+// Copyright (c) 2026 The CampusCash developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Four headers per ymm register, and eight by running two registers side by
+// side so the core has independent instructions to schedule.
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+// Only called after the dispatcher has seen AVX2 in CPUID.
+// Nothing that other units could share may be included below this line.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("avx2")
+#endif
+
+namespace
+{
+struct OpsAVX2
+{
+    typedef __m256i V;
+    static const int N = 4;
+
+    static inline V Set1(uint64_t x) { return _mm256_set1_epi64x(x); }
+    static inline V Load(const unsigned char* p, size_t nStride)
+    {
+        uint64_t a, b, c, d;
+        memcpy(&a, p, 8);
+        memcpy(&b, p + nStride, 8);
+        memcpy(&c, p + 2 * nStride, 8);
+        memcpy(&d, p + 3 * nStride, 8);
+        return _mm256_set_epi64x(d, c, b, a);
+    }
+    static inline void Store(unsigned char* p, size_t nStride, V x)
+    {
+        uint64_t t[4];
+        _mm256_storeu_si256((__m256i*)t, x);
+        for (int i = 0; i < 4; i++)
+            memcpy(p + i * nStride, &t[i], 8);
+    }
+    static inline V Add(V a, V b) { return _mm256_add_epi64(a, b); }
+    static inline V Sub(V a, V b) { return _mm256_sub_epi64(a, b); }
+    static inline V Xor(V a, V b) { return _mm256_xor_si256(a, b); }
+    static inline V Shl(V x, int n) { return _mm256_slli_epi64(x, n); }
+    static inline V Shr(V x, int n) { return _mm256_srli_epi64(x, n); }
+};
+
+struct OpsAVX2x2
+{
+    struct V { __m256i a, b; };
+    static const int N = 8;
+
+    static inline V Make(__m256i a, __m256i b) { V v; v.a = a; v.b = b; return v; }
+    static inline V Set1(uint64_t x) { return Make(_mm256_set1_epi64x(x), _mm256_set1_epi64x(x)); }
+    static inline V Load(const unsigned char* p, size_t nStride)
+    {
+        return Make(OpsAVX2::Load(p, nStride), OpsAVX2::Load(p + 4 * nStride, nStride));
+    }
+    static inline void Store(unsigned char* p, size_t nStride, V x)
+    {
+        OpsAVX2::Store(p, nStride, x.a);
+        OpsAVX2::Store(p + 4 * nStride, nStride, x.b);
+    }
+    static inline V Add(V x, V y) { return Make(_mm256_add_epi64(x.a, y.a), _mm256_add_epi64(x.b, y.b)); }
+    static inline V Sub(V x, V y) { return Make(_mm256_sub_epi64(x.a, y.a), _mm256_sub_epi64(x.b, y.b)); }
+    static inline V Xor(V x, V y) { return Make(_mm256_xor_si256(x.a, y.a), _mm256_xor_si256(x.b, y.b)); }
+    static inline V Shl(V x, int n) { return Make(_mm256_slli_epi64(x.a, n), _mm256_slli_epi64(x.b, n)); }
+    static inline V Shr(V x, int n) { return Make(_mm256_srli_epi64(x.a, n), _mm256_srli_epi64(x.b, n)); }
+};
+}
+
+#include "bmw512_lanes.h"
+
+namespace bmw512_avx2
+{
+void Headers80_4way(const unsigned char* in, unsigned char* out)
+{
+    bmw512_lanes::Compressor<OpsAVX2>::Headers80(in, 80, out);
+}
+
+void Headers80_8way(const unsigned char* in, unsigned char* out)
+{
+    bmw512_lanes::Compressor<OpsAVX2x2>::Headers80(in, 80, out);
+}
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#endif
@@ -0,0 +1,160 @@
+// Copyright (c) 2026 The CampusCash developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Internal BMW-512 compression over N independent messages at once.
+//
+// Included by bmw512.cpp and the per-instruction-set translation units after
+// they define an Ops type with one 64-bit word of each message per lane:
+//
+//   typedef ... V;              one word from each of N messages
+//   static const int N;         number of lanes
+//   V Set1(uint64_t x);         broadcast
+//   V Load(const unsigned char* p, size_t nStride);   LE64 from p + i*nStride
+//   void Store(unsigned char* p, size_t nStride, V x); LE64 to p + i*nStride
+//   V Add(V a, V b); V Sub(V a, V b); V Xor(V a, V b);
+//   V Shl(V x, int n); V Shr(V x, int n);
+//
+// This file must not include anything: the AVX2 unit switches the target
+// instruction set before including it, and any inline function pulled in
+// from a shared header would be emitted with AVX2 instructions.
+
+#ifndef BMW512_LANES_H
+#define BMW512_LANES_H
+
+namespace bmw512_lanes
+{
+template<typename Ops>
+struct Compressor
+{
+    typedef typename Ops::V V;
+
+    static inline V Rotl(V x, int n) { return Ops::Xor(Ops::Shl(x, n), Ops::Shr(x, 64 - n)); }
+
+    static inline V S0(V x) { return Ops::Xor(Ops::Xor(Ops::Shr(x, 1), Ops::Shl(x, 3)), Ops::Xor(Rotl(x,  4), Rotl(x, 37))); }
+    static inline V S1(V x) { return Ops::Xor(Ops::Xor(Ops::Shr(x, 1), Ops::Shl(x, 2)), Ops::Xor(Rotl(x, 13), Rotl(x, 43))); }
+    static inline V S2(V x) { return Ops::Xor(Ops::Xor(Ops::Shr(x, 2), Ops::Shl(x, 1)), Ops::Xor(Rotl(x, 19), Rotl(x, 53))); }
+    static inline V S3(V x) { return Ops::Xor(Ops::Xor(Ops::Shr(x, 2), Ops::Shl(x, 2)), Ops::Xor(Rotl(x, 28), Rotl(x, 59))); }
+    static inline V S4(V x) { return Ops::Xor(Ops::Shr(x, 1), x); }
+    static inline V S5(V x) { return Ops::Xor(Ops::Shr(x, 2), x); }
+
+    /** The add_elt term of the expansion for q[j+16]. */
+    static inline V AddElement(const V* m, const V* h, int j)
+    {
+        V t = Ops::Add(Rotl(m[j], j + 1), Rotl(m[(j + 3) & 15], ((j + 3) & 15) + 1));
+        t = Ops::Sub(t, Rotl(m[(j + 10) & 15], ((j + 10) & 15) + 1));
+        t = Ops::Add(t, Ops::Set1((uint64_t)(j + 16) * 0x0555555555555555ULL));
+        return Ops::Xor(t, h[(j + 7) & 15]);
+    }
+
+    /** One BMW-512 compression: dh = f(m, h). */
+    static void Compress(const V* m, const V* h, V* dh)
+    {
+        V w[16], q[32];
+        for (int i = 0; i < 16; i++)
+            w[i] = Ops::Xor(m[i], h[i]);
+
+        // f0: bijective transform of m ^ h
+        q[ 0] = Ops::Add(S0(Ops::Add(Ops::Add(Ops::Add(Ops::Sub(w[ 5], w[ 7]), w[10]), w[13]), w[14])), h[ 1]);
+        q[ 1] = Ops::Add(S1(Ops::Sub(Ops::Add(Ops::Add(Ops::Sub(w[ 6], w[ 8]), w[11]), w[14]), w[15])), h[ 2]);
+        q[ 2] = Ops::Add(S2(Ops::Add(Ops::Sub(Ops::Add(Ops::Add(w[ 0], w[ 7]), w[ 9]), w[12]), w[15])), h[ 3]);
+        q[ 3] = Ops::Add(S3(Ops::Add(Ops::Sub(Ops::Add(Ops::Sub(w[ 0], w[ 1]), w[ 8]), w[10]), w[13])), h[ 4]);
+        q[ 4] = Ops::Add(S4(Ops::Sub(Ops::Sub(Ops::Add(Ops::Add(w[ 1], w[ 2]), w[ 9]), w[11]), w[14])), h[ 5]);
+        q[ 5] = Ops::Add(S0(Ops::Add(Ops::Sub(Ops::Add(Ops::Sub(w[ 3], w[ 2]), w[10]), w[12]), w[15])), h[ 6]);
+        q[ 6] = Ops::Add(S1(Ops::Add(Ops::Sub(Ops::Sub(Ops::Sub(w[ 4], w[ 0]), w[ 3]), w[11]), w[13])), h[ 7]);
+        q[ 7] = Ops::Add(S2(Ops::Sub(Ops::Sub(Ops::Sub(Ops::Sub(w[ 1], w[ 4]), w[ 5]), w[12]), w[14])), h[ 8]);
+        q[ 8] = Ops::Add(S3(Ops::Sub(Ops::Add(Ops::Sub(Ops::Sub(w[ 2], w[ 5]), w[ 6]), w[13]), w[15])), h[ 9]);
+        q[ 9] = Ops::Add(S4(Ops::Add(Ops::Sub(Ops::Add(Ops::Sub(w[ 0], w[ 3]), w[ 6]), w[ 7]), w[14])), h[10]);
+        q[10] = Ops::Add(S0(Ops::Add(Ops::Sub(Ops::Sub(Ops::Sub(w[ 8], w[ 1]), w[ 4]), w[ 7]), w[15])), h[11]);
+        q[11] = Ops::Add(S1(Ops::Add(Ops::Sub(Ops::Sub(Ops::Sub(w[ 8], w[ 0]), w[ 2]), w[ 5]), w[ 9])), h[12]);
+        q[12] = Ops::Add(S2(Ops::Add(Ops::Sub(Ops::Sub(Ops::Add(w[ 1], w[ 3]), w[ 6]), w[ 9]), w[10])), h[13]);
+        q[13] = Ops::Add(S3(Ops::Add(Ops::Add(Ops::Add(Ops::Add(w[ 2], w[ 4]), w[ 7]), w[10]), w[11])), h[14]);
+        q[14] = Ops::Add(S4(Ops::Sub(Ops::Sub(Ops::Add(Ops::Sub(w[ 3], w[ 5]), w[ 8]), w[11]), w[12])), h[15]);
+        q[15] = Ops::Add(S0(Ops::Add(Ops::Sub(Ops::Sub(Ops::Sub(w[12], w[ 4]), w[ 6]), w[ 9]), w[13])), h[ 0]);
+
+        // f1: message expansion, two rounds of expand1 then fourteen of expand2
+        for (int i = 16; i < 18; i++)
+        {
+            V t = AddElement(m, h, i - 16);
+            for (int k = 0; k < 16; k += 4)
+            {
+                t = Ops::Add(t, S1(q[i - 16 + k]));
+                t = Ops::Add(t, S2(q[i - 15 + k]));
+                t = Ops::Add(t, S3(q[i - 14 + k]));
+                t = Ops::Add(t, S0(q[i - 13 + k]));
+            }
+            q[i] = t;
+        }
+        for (int i = 18; i < 32; i++)
+        {
+            V t = Ops::Add(AddElement(m, h, i - 16), Ops::Add(S4(q[i - 2]), S5(q[i - 1])));
+            t = Ops::Add(t, Ops::Add(q[i - 16], Rotl(q[i - 15],  5)));
+            t = Ops::Add(t, Ops::Add(q[i - 14], Rotl(q[i - 13], 11)));
+            t = Ops::Add(t, Ops::Add(q[i - 12], Rotl(q[i - 11], 27)));
+            t = Ops::Add(t, Ops::Add(q[i - 10], Rotl(q[i -  9], 32)));
+            t = Ops::Add(t, Ops::Add(q[i -  8], Rotl(q[i -  7], 37)));
+            t = Ops::Add(t, Ops::Add(q[i -  6], Rotl(q[i -  5], 43)));
+            t = Ops::Add(t, Ops::Add(q[i -  4], Rotl(q[i -  3], 53)));
+            q[i] = t;
+        }
+
+        // f2: fold q back into the chaining value
+        V xl = Ops::Xor(Ops::Xor(Ops::Xor(q[16], q[17]), Ops::Xor(q[18], q[19])),
+                        Ops::Xor(Ops::Xor(q[20], q[21]), Ops::Xor(q[22], q[23])));
+        V xh = Ops::Xor(Ops::Xor(Ops::Xor(Ops::Xor(xl, q[24]), Ops::Xor(q[25], q[26])),
+                                 Ops::Xor(Ops::Xor(q[27], q[28]), Ops::Xor(q[29], q[30]))), q[31]);
+
+        dh[ 0] = Ops::Add(Ops::Xor(Ops::Xor(Ops::Shl(xh,  5), Ops::Shr(q[16],  5)), m[ 0]), Ops::Xor(Ops::Xor(xl, q[24]), q[ 0]));
+        dh[ 1] = Ops::Add(Ops::Xor(Ops::Xor(Ops::Shr(xh,  7), Ops::Shl(q[17],  8)), m[ 1]), Ops::Xor(Ops::Xor(xl, q[25]), q[ 1]));
+        dh[ 2] = Ops::Add(Ops::Xor(Ops::Xor(Ops::Shr(xh,  5), Ops::Shl(q[18],  5)), m[ 2]), Ops::Xor(Ops::Xor(xl, q[26]), q[ 2]));
+        dh[ 3] = Ops::Add(Ops::Xor(Ops::Xor(Ops::Shr(xh,  1), Ops::Shl(q[19],  5)), m[ 3]), Ops::Xor(Ops::Xor(xl, q[27]), q[ 3]));
+        dh[ 4] = Ops::Add(Ops::Xor(Ops::Xor(Ops::Shr(xh,  3), q[20]), m[ 4]),                Ops::Xor(Ops::Xor(xl, q[28]), q[ 4]));
+        dh[ 5] = Ops::Add(Ops::Xor(Ops::Xor(Ops::Shl(xh,  6), Ops::Shr(q[21],  6)), m[ 5]), Ops::Xor(Ops::Xor(xl, q[29]), q[ 5]));
+        dh[ 6] = Ops::Add(Ops::Xor(Ops::Xor(Ops::Shr(xh,  4), Ops::Shl(q[22],  6)), m[ 6]), Ops::Xor(Ops::Xor(xl, q[30]), q[ 6]));
+        dh[ 7] = Ops::Add(Ops::Xor(Ops::Xor(Ops::Shr(xh, 11), Ops::Shl(q[23],  2)), m[ 7]), Ops::Xor(Ops::Xor(xl, q[31]), q[ 7]));
+
+        dh[ 8] = Ops::Add(Ops::Add(Rotl(dh[4],  9), Ops::Xor(Ops::Xor(xh, q[24]), m[ 8])), Ops::Xor(Ops::Xor(Ops::Shl(xl, 8), q[23]), q[ 8]));
+        dh[ 9] = Ops::Add(Ops::Add(Rotl(dh[5], 10), Ops::Xor(Ops::Xor(xh, q[25]), m[ 9])), Ops::Xor(Ops::Xor(Ops::Shr(xl, 6), q[16]), q[ 9]));
+        dh[10] = Ops::Add(Ops::Add(Rotl(dh[6], 11), Ops::Xor(Ops::Xor(xh, q[26]), m[10])), Ops::Xor(Ops::Xor(Ops::Shl(xl, 6), q[17]), q[10]));
+        dh[11] = Ops::Add(Ops::Add(Rotl(dh[7], 12), Ops::Xor(Ops::Xor(xh, q[27]), m[11])), Ops::Xor(Ops::Xor(Ops::Shl(xl, 4), q[18]), q[11]));
+        dh[12] = Ops::Add(Ops::Add(Rotl(dh[0], 13), Ops::Xor(Ops::Xor(xh, q[28]), m[12])), Ops::Xor(Ops::Xor(Ops::Shr(xl, 3), q[19]), q[12]));
+        dh[13] = Ops::Add(Ops::Add(Rotl(dh[1], 14), Ops::Xor(Ops::Xor(xh, q[29]), m[13])), Ops::Xor(Ops::Xor(Ops::Shr(xl, 4), q[20]), q[13]));
+        dh[14] = Ops::Add(Ops::Add(Rotl(dh[2], 15), Ops::Xor(Ops::Xor(xh, q[30]), m[14])), Ops::Xor(Ops::Xor(Ops::Shr(xl, 7), q[21]), q[14]));
+        dh[15] = Ops::Add(Ops::Add(Rotl(dh[3], 16), Ops::Xor(Ops::Xor(xh, q[31]), m[15])), Ops::Xor(Ops::Xor(Ops::Shr(xl, 2), q[22]), q[15]));
+    }
+
+    /** Hash Ops::N 80-byte block headers laid out nStride bytes apart and
+      * write the low 256 bits of each BMW-512 digest to out + 32*i. */
+    static void Headers80(const unsigned char* in, size_t nStride, unsigned char* out)
+    {
+        V m[16], h[16], h2[16], h3[16];
+
+        // The header, the 0x80 end marker and the 640-bit length fit in one block
+        for (int i = 0; i < 10; i++)
+            m[i] = Ops::Load(in + 8 * i, nStride);
+        m[10] = Ops::Set1(0x80);
+        for (int i = 11; i < 15; i++)
+            m[i] = Ops::Set1(0);
+        m[15] = Ops::Set1(80 * 8);
+
+        // IV512 is the byte sequence 0x80 .. 0xff
+        for (int i = 0; i < 16; i++)
+        {
+            uint64_t b = 0x80 + 8 * i;
+            h[i] = Ops::Set1(((b + 0) << 56 | (b + 1) << 48 | (b + 2) << 40 | (b + 3) << 32 |
+                              (b + 4) << 24 | (b + 5) << 16 | (b + 6) << 8 | (b + 7)));
+        }
+        Compress(m, h, h2);
+
+        // Final compression keyed by the constant 0xaaaaaaaaaaaaaaa0 + i
+        for (int i = 0; i < 16; i++)
+            h[i] = Ops::Set1(0xaaaaaaaaaaaaaaa0ULL + i);
+        Compress(h2, h, h3);
+
+        for (int i = 0; i < 4; i++)
+            Ops::Store(out + 8 * i, 32, h3[8 + i]);
+    }
+};
+}
+
+#endif // BMW512_LANES_H
@@ -0,0 +1,66 @@
+// Copyright (c) 2026 The CampusCash developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Two headers at once, one per 64-bit half of an xmm register.
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <emmintrin.h>
+
+// 32-bit builds do not assume SSE2; the dispatcher checks CPUID first.
+// Nothing that other units could share may be included below this line.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("sse2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("sse2")
+#endif
+
+namespace
+{
+struct OpsSSE2
+{
+    typedef __m128i V;
+    static const int N = 2;
+
+    static inline V Set1(uint64_t x) { return _mm_set1_epi64x(x); }
+    static inline V Load(const unsigned char* p, size_t nStride)
+    {
+        uint64_t a, b;
+        memcpy(&a, p, 8);
+        memcpy(&b, p + nStride, 8);
+        return _mm_set_epi64x(b, a);
+    }
+    static inline void Store(unsigned char* p, size_t nStride, V x)
+    {
+        uint64_t t[2];
+        _mm_storeu_si128((__m128i*)t, x);
+        memcpy(p, &t[0], 8);
+        memcpy(p + nStride, &t[1], 8);
+    }
+    static inline V Add(V a, V b) { return _mm_add_epi64(a, b); }
+    static inline V Sub(V a, V b) { return _mm_sub_epi64(a, b); }
+    static inline V Xor(V a, V b) { return _mm_xor_si128(a, b); }
+    static inline V Shl(V x, int n) { return _mm_slli_epi64(x, n); }
+    static inline V Shr(V x, int n) { return _mm_srli_epi64(x, n); }
+};
+}
+
+#include "bmw512_lanes.h"
+
+namespace bmw512_sse2
+{
+void Headers80_2way(const unsigned char* in, unsigned char* out)
+{
+    bmw512_lanes::Compressor<OpsSSE2>::Headers80(in, 80, out);
+}
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#endif
@@ -8,6 +8,8 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <string>
+
 /** A hasher class for SHA-256. */
 class CSHA256
 {
@@ -25,4 +27,17 @@ public:
     CSHA256& Reset();
 };
 
+/** Pick the fastest SHA-256 code this CPU supports, check it against the
+  * portable implementation and return its name */
+std::string SHA256AutoDetect();
+
+/** Force an implementation ("standard", "sse4.1", "avx2", "shani");
+  * false if it is unknown or this CPU cannot run it */
+bool SHA256SelectImplementation(const std::string& strName);
+
+/** Double SHA-256 of a number of 64-byte inputs stored back to back, the
+  * 32-byte digests written back to back to out. This is what merkle tree
+  * nodes are. */
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,73 @@
+// Copyright (c) 2026 The CampusCash developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Eight 64-byte double SHA-256 hashes at once, one per ymm lane.
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+// Only called after the dispatcher has seen AVX2 in CPUID.
+// Nothing that other units could share may be included below this line.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("avx2")
+#endif
+
+namespace
+{
+struct OpsAVX2
+{
+    typedef __m256i V;
+    static const int N = 8;
+
+    static inline V ByteSwap(V x)
+    {
+        return _mm256_shuffle_epi8(x, _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                                      12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3));
+    }
+
+    static inline V Set1(uint32_t x) { return _mm256_set1_epi32(x); }
+    static inline V LoadBE(const unsigned char* p)
+    {
+        int t[8];
+        for (int i = 0; i < 8; i++)
+            memcpy(&t[i], p + 64 * i, 4);
+        return ByteSwap(_mm256_set_epi32(t[7], t[6], t[5], t[4], t[3], t[2], t[1], t[0]));
+    }
+    static inline void StoreBE(unsigned char* p, V x)
+    {
+        uint32_t t[8];
+        _mm256_storeu_si256((__m256i*)t, ByteSwap(x));
+        for (int i = 0; i < 8; i++)
+            memcpy(p + 32 * i, &t[i], 4);
+    }
+    static inline V Add(V a, V b) { return _mm256_add_epi32(a, b); }
+    static inline V Xor(V a, V b) { return _mm256_xor_si256(a, b); }
+    static inline V And(V a, V b) { return _mm256_and_si256(a, b); }
+    static inline V Or(V a, V b) { return _mm256_or_si256(a, b); }
+    static inline V Shl(V x, int n) { return _mm256_slli_epi32(x, n); }
+    static inline V Shr(V x, int n) { return _mm256_srli_epi32(x, n); }
+};
+}
+
+#include "sha256_lanes.h"
+
+namespace sha256_avx2
+{
+void TransformD64_8way(unsigned char* out, const unsigned char* in)
+{
+    sha256_lanes::Compressor<OpsAVX2>::D64(out, in);
+}
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#endif
@@ -0,0 +1,175 @@
+// Copyright (c) 2026 The CampusCash developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Internal SHA-256 compression over N independent messages at once, for the
+// double SHA-256 of 64-byte inputs that merkle trees are made of.
+//
+// Included by the per-instruction-set translation units after they define an
+// Ops type with one 32-bit word of each message per lane:
+//
+//   typedef ... V;              one word from each of N messages
+//   static const int N;         number of lanes
+//   V Set1(uint32_t x);         broadcast
+//   V LoadBE(const unsigned char* p);   BE32 from p + 64*i
+//   void StoreBE(unsigned char* p, V x); BE32 to p + 32*i
+//   V Add(V a, V b); V Xor(V a, V b); V And(V a, V b); V Or(V a, V b);
+//   V Shl(V x, int n); V Shr(V x, int n);
+//
+// This file must not include anything: the SIMD units switch the target
+// instruction set before including it, and any inline function pulled in
+// from a shared header would be emitted with their instructions.
+
+#ifndef SHA256_LANES_H
+#define SHA256_LANES_H
+
+namespace sha256_lanes
+{
+static const uint32_t K[64] = {
+    0x428a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul,
+    0x3956c25bul, 0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul,
+    0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul,
+    0x72be5d74ul, 0x80deb1feul, 0x9bdc06a7ul, 0xc19bf174ul,
+    0xe49b69c1ul, 0xefbe4786ul, 0x0fc19dc6ul, 0x240ca1ccul,
+    0x2de92c6ful, 0x4a7484aaul, 0x5cb0a9dcul, 0x76f988daul,
+    0x983e5152ul, 0xa831c66dul, 0xb00327c8ul, 0xbf597fc7ul,
+    0xc6e00bf3ul, 0xd5a79147ul, 0x06ca6351ul, 0x14292967ul,
+    0x27b70a85ul, 0x2e1b2138ul, 0x4d2c6dfcul, 0x53380d13ul,
+    0x650a7354ul, 0x766a0abbul, 0x81c2c92eul, 0x92722c85ul,
+    0xa2bfe8a1ul, 0xa81a664bul, 0xc24b8b70ul, 0xc76c51a3ul,
+    0xd192e819ul, 0xd6990624ul, 0xf40e3585ul, 0x106aa070ul,
+    0x19a4c116ul, 0x1e376c08ul, 0x2748774cul, 0x34b0bcb5ul,
+    0x391c0cb3ul, 0x4ed8aa4aul, 0x5b9cca4ful, 0x682e6ff3ul,
+    0x748f82eeul, 0x78a5636ful, 0x84c87814ul, 0x8cc70208ul,
+    0x90befffaul, 0xa4506cebul, 0xbef9a3f7ul, 0xc67178f2ul,
+};
+
+/** K[i] plus the expanded schedule of the block that pads a 64-byte message,
+  * which is the same for every input. */
+static const uint32_t KPadding64[64] = {
+    0xc28a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul,
+    0x3956c25bul, 0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul,
+    0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul,
+    0x72be5d74ul, 0x80deb1feul, 0x9bdc06a7ul, 0xc19bf374ul,
+    0x649b69c1ul, 0xf0fe4786ul, 0x0fe1edc6ul, 0x240cf254ul,
+    0x4fe9346ful, 0x6cc984beul, 0x61b9411eul, 0x16f988faul,
+    0xf2c65152ul, 0xa88e5a6dul, 0xb019fc65ul, 0xb9d99ec7ul,
+    0x9a1231c3ul, 0xe70eeaa0ul, 0xfdb1232bul, 0xc7353eb0ul,
+    0x3069bad5ul, 0xcb976d5ful, 0x5a0f118ful, 0xdc1eeefdul,
+    0x0a35b689ul, 0xde0b7a04ul, 0x58f4ca9dul, 0xe15d5b16ul,
+    0x007f3e86ul, 0x37088980ul, 0xa507ea32ul, 0x6fab9537ul,
+    0x17406110ul, 0x0d8cd6f1ul, 0xcdaa3b6dul, 0xc0bbbe37ul,
+    0x83613bdaul, 0xdb48a363ul, 0x0b02e931ul, 0x6fd15ca7ul,
+    0x521afacaul, 0x31338431ul, 0x6ed41a95ul, 0x6d437890ul,
+    0xc39c91f2ul, 0x9eccabbdul, 0xb5c9a0e6ul, 0x532fb63cul,
+    0xd2c741c6ul, 0x07237ea3ul, 0xa4954b68ul, 0x4c191d76ul,
+};
+
+static const uint32_t IV[8] = {
+    0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul,
+    0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul,
+};
+
+template<typename Ops>
+struct Compressor
+{
+    typedef typename Ops::V V;
+
+    static inline V Ror(V x, int n) { return Ops::Or(Ops::Shr(x, n), Ops::Shl(x, 32 - n)); }
+    static inline V Add(V a, V b, V c) { return Ops::Add(Ops::Add(a, b), c); }
+    static inline V Add(V a, V b, V c, V d) { return Ops::Add(Ops::Add(a, b), Ops::Add(c, d)); }
+
+    static inline V Ch(V x, V y, V z) { return Ops::Xor(z, Ops::And(x, Ops::Xor(y, z))); }
+    static inline V Maj(V x, V y, V z) { return Ops::Or(Ops::And(x, y), Ops::And(z, Ops::Or(x, y))); }
+    static inline V Sigma0(V x) { return Ops::Xor(Ops::Xor(Ror(x, 2), Ror(x, 13)), Ror(x, 22)); }
+    static inline V Sigma1(V x) { return Ops::Xor(Ops::Xor(Ror(x, 6), Ror(x, 11)), Ror(x, 25)); }
+    static inline V sigma0(V x) { return Ops::Xor(Ops::Xor(Ror(x, 7), Ror(x, 18)), Ops::Shr(x, 3)); }
+    static inline V sigma1(V x) { return Ops::Xor(Ops::Xor(Ror(x, 17), Ror(x, 19)), Ops::Shr(x, 10)); }
+
+    /** One round, kw being the round constant plus the message word. */
+    static inline void Round(V a, V b, V c, V& d, V e, V f, V g, V& h, V kw)
+    {
+        V t1 = Add(h, Sigma1(e), Ch(e, f, g), kw);
+        V t2 = Ops::Add(Sigma0(a), Maj(a, b, c));
+        d = Ops::Add(d, t1);
+        h = Ops::Add(t1, t2);
+    }
+
+    /** Round constant plus message word i, expanding the schedule in w as it goes. */
+    static inline V KW(V* w, int i)
+    {
+        if (i >= 16)
+            w[i & 15] = Add(w[i & 15], sigma1(w[(i - 2) & 15]), w[(i - 7) & 15], sigma0(w[(i - 15) & 15]));
+        return Ops::Add(Ops::Set1(K[i]), w[i & 15]);
+    }
+
+    /** Compress the 16 message words in w (overwritten) into s. */
+    static void Transform(V* s, V* w)
+    {
+        V a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        for (int i = 0; i < 64; i += 8)
+        {
+            Round(a, b, c, d, e, f, g, h, KW(w, i + 0));
+            Round(h, a, b, c, d, e, f, g, KW(w, i + 1));
+            Round(g, h, a, b, c, d, e, f, KW(w, i + 2));
+            Round(f, g, h, a, b, c, d, e, KW(w, i + 3));
+            Round(e, f, g, h, a, b, c, d, KW(w, i + 4));
+            Round(d, e, f, g, h, a, b, c, KW(w, i + 5));
+            Round(c, d, e, f, g, h, a, b, KW(w, i + 6));
+            Round(b, c, d, e, f, g, h, a, KW(w, i + 7));
+        }
+        s[0] = Ops::Add(s[0], a); s[1] = Ops::Add(s[1], b); s[2] = Ops::Add(s[2], c); s[3] = Ops::Add(s[3], d);
+        s[4] = Ops::Add(s[4], e); s[5] = Ops::Add(s[5], f); s[6] = Ops::Add(s[6], g); s[7] = Ops::Add(s[7], h);
+    }
+
+    /** Compress the padding block that follows a 64-byte message into s. */
+    static void TransformPadding64(V* s)
+    {
+        V a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        for (int i = 0; i < 64; i += 8)
+        {
+            Round(a, b, c, d, e, f, g, h, Ops::Set1(KPadding64[i + 0]));
+            Round(h, a, b, c, d, e, f, g, Ops::Set1(KPadding64[i + 1]));
+            Round(g, h, a, b, c, d, e, f, Ops::Set1(KPadding64[i + 2]));
+            Round(f, g, h, a, b, c, d, e, Ops::Set1(KPadding64[i + 3]));
+            Round(e, f, g, h, a, b, c, d, Ops::Set1(KPadding64[i + 4]));
+            Round(d, e, f, g, h, a, b, c, Ops::Set1(KPadding64[i + 5]));
+            Round(c, d, e, f, g, h, a, b, Ops::Set1(KPadding64[i + 6]));
+            Round(b, c, d, e, f, g, h, a, Ops::Set1(KPadding64[i + 7]));
+        }
+        s[0] = Ops::Add(s[0], a); s[1] = Ops::Add(s[1], b); s[2] = Ops::Add(s[2], c); s[3] = Ops::Add(s[3], d);
+        s[4] = Ops::Add(s[4], e); s[5] = Ops::Add(s[5], f); s[6] = Ops::Add(s[6], g); s[7] = Ops::Add(s[7], h);
+    }
+
+    /** Double SHA-256 of Ops::N 64-byte inputs laid out back to back, the
+      * 32-byte digests written back to back to out. */
+    static void D64(unsigned char* out, const unsigned char* in)
+    {
+        V s[8], w[16];
+
+        // First hash: the message, then its padding
+        for (int i = 0; i < 8; i++)
+            s[i] = Ops::Set1(IV[i]);
+        for (int i = 0; i < 16; i++)
+            w[i] = Ops::LoadBE(in + 4 * i);
+        Transform(s, w);
+        TransformPadding64(s);
+
+        // Second hash: the 32-byte digest and its padding in one block
+        for (int i = 0; i < 8; i++)
+            w[i] = s[i];
+        w[8] = Ops::Set1(0x80000000ul);
+        for (int i = 9; i < 15; i++)
+            w[i] = Ops::Set1(0);
+        w[15] = Ops::Set1(256);
+        for (int i = 0; i < 8; i++)
+            s[i] = Ops::Set1(IV[i]);
+        Transform(s, w);
+
+        for (int i = 0; i < 8; i++)
+            Ops::StoreBE(out + 4 * i, s[i]);
+    }
+};
+}
+
+#endif // SHA256_LANES_H
@@ -0,0 +1,195 @@
+// Copyright (c) 2026 The CampusCash developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// SHA-256 with the x86 SHA extensions: sha256rnds2 does two rounds with the
+// state split across two registers as ABEF and CDGH, sha256msg1/msg2 expand
+// the message schedule four words at a time.
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+// Only called after the dispatcher has seen SHA and SSE4.1 in CPUID.
+// Nothing that other units could share may be included below this line.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("sha,sse4.1"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("sha,sse4.1")
+#endif
+
+namespace
+{
+inline __m128i Load(const unsigned char* p)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)p), mask);
+}
+
+/** Four rounds of message words m plus constants k3:k2:k1:k0. */
+inline void QuadRound(__m128i& state0, __m128i& state1, __m128i m, uint64_t k1, uint64_t k0)
+{
+    const __m128i msg = _mm_add_epi32(m, _mm_set_epi64x(k1, k0));
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+}
+
+/** Four rounds where the message words and constants are one precomputed value. */
+inline void QuadRound(__m128i& state0, __m128i& state1, uint64_t kw1, uint64_t kw0)
+{
+    const __m128i msg = _mm_set_epi64x(kw1, kw0);
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0e));
+}
+
+// With m0, m1, m2 the schedule words 4(i-1), 4i and 4(i+1) onwards, start the
+// next words in m0 (A) and finish them in m2 (C)
+inline void ShiftMessageA(__m128i& m0, __m128i m1)
+{
+    m0 = _mm_sha256msg1_epu32(m0, m1);
+}
+
+inline void ShiftMessageC(__m128i m0, __m128i m1, __m128i& m2)
+{
+    m2 = _mm_sha256msg2_epu32(_mm_add_epi32(m2, _mm_alignr_epi8(m1, m0, 4)), m1);
+}
+
+inline void ShiftMessageB(__m128i& m0, __m128i m1, __m128i& m2)
+{
+    ShiftMessageC(m0, m1, m2);
+    ShiftMessageA(m0, m1);
+}
+
+/** s[0..7] (a..h) to and from the ABEF/CDGH layout sha256rnds2 works on. */
+inline void Unshuffle(const uint32_t* s, __m128i& state0, __m128i& state1)
+{
+    const __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)s), 0xb1);
+    const __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(s + 4)), 0x1b);
+    state0 = _mm_alignr_epi8(abcd, efgh, 8);
+    state1 = _mm_blend_epi16(efgh, abcd, 0xf0);
+}
+
+inline void Shuffle(__m128i state0, __m128i state1, uint32_t* s)
+{
+    const __m128i feba = _mm_shuffle_epi32(state0, 0x1b);
+    const __m128i dchg = _mm_shuffle_epi32(state1, 0xb1);
+    _mm_storeu_si128((__m128i*)s, _mm_blend_epi16(feba, dchg, 0xf0));
+    _mm_storeu_si128((__m128i*)(s + 4), _mm_alignr_epi8(dchg, feba, 8));
+}
+
+inline void Compress(__m128i& state0, __m128i& state1, __m128i m0, __m128i m1, __m128i m2, __m128i m3)
+{
+    const __m128i save0 = state0, save1 = state1;
+
+    QuadRound(state0, state1, m0, 0xe9b5dba5b5c0fbcfull, 0x71374491428a2f98ull);
+    QuadRound(state0, state1, m1, 0xab1c5ed5923f82a4ull, 0x59f111f13956c25bull);
+    ShiftMessageA(m0, m1);
+    QuadRound(state0, state1, m2, 0x550c7dc3243185beull, 0x12835b01d807aa98ull);
+    ShiftMessageA(m1, m2);
+    QuadRound(state0, state1, m3, 0xc19bf1749bdc06a7ull, 0x80deb1fe72be5d74ull);
+    ShiftMessageB(m2, m3, m0);
+    QuadRound(state0, state1, m0, 0x240ca1cc0fc19dc6ull, 0xefbe4786e49b69c1ull);
+    ShiftMessageB(m3, m0, m1);
+    QuadRound(state0, state1, m1, 0x76f988da5cb0a9dcull, 0x4a7484aa2de92c6full);
+    ShiftMessageB(m0, m1, m2);
+    QuadRound(state0, state1, m2, 0xbf597fc7b00327c8ull, 0xa831c66d983e5152ull);
+    ShiftMessageB(m1, m2, m3);
+    QuadRound(state0, state1, m3, 0x1429296706ca6351ull, 0xd5a79147c6e00bf3ull);
+    ShiftMessageB(m2, m3, m0);
+    QuadRound(state0, state1, m0, 0x53380d134d2c6dfcull, 0x2e1b213827b70a85ull);
+    ShiftMessageB(m3, m0, m1);
+    QuadRound(state0, state1, m1, 0x92722c8581c2c92eull, 0x766a0abb650a7354ull);
+    ShiftMessageB(m0, m1, m2);
+    QuadRound(state0, state1, m2, 0xc76c51a3c24b8b70ull, 0xa81a664ba2bfe8a1ull);
+    ShiftMessageB(m1, m2, m3);
+    QuadRound(state0, state1, m3, 0x106aa070f40e3585ull, 0xd6990624d192e819ull);
+    ShiftMessageB(m2, m3, m0);
+    QuadRound(state0, state1, m0, 0x34b0bcb52748774cull, 0x1e376c0819a4c116ull);
+    ShiftMessageB(m3, m0, m1);
+    QuadRound(state0, state1, m1, 0x682e6ff35b9cca4full, 0x4ed8aa4a391c0cb3ull);
+    ShiftMessageC(m0, m1, m2);
+    QuadRound(state0, state1, m2, 0x8cc7020884c87814ull, 0x78a5636f748f82eeull);
+    ShiftMessageC(m1, m2, m3);
+    QuadRound(state0, state1, m3, 0xc67178f2bef9a3f7ull, 0xa4506ceb90befffaull);
+
+    state0 = _mm_add_epi32(state0, save0);
+    state1 = _mm_add_epi32(state1, save1);
+}
+
+// Same as sha256_lanes::KPadding64, the padding block of a 64-byte message
+inline void CompressPadding64(__m128i& state0, __m128i& state1)
+{
+    const __m128i save0 = state0, save1 = state1;
+
+    QuadRound(state0, state1, 0xe9b5dba5b5c0fbcfull, 0x71374491c28a2f98ull);
+    QuadRound(state0, state1, 0xab1c5ed5923f82a4ull, 0x59f111f13956c25bull);
+    QuadRound(state0, state1, 0x550c7dc3243185beull, 0x12835b01d807aa98ull);
+    QuadRound(state0, state1, 0xc19bf3749bdc06a7ull, 0x80deb1fe72be5d74ull);
+    QuadRound(state0, state1, 0x240cf2540fe1edc6ull, 0xf0fe4786649b69c1ull);
+    QuadRound(state0, state1, 0x16f988fa61b9411eull, 0x6cc984be4fe9346full);
+    QuadRound(state0, state1, 0xb9d99ec7b019fc65ull, 0xa88e5a6df2c65152ull);
+    QuadRound(state0, state1, 0xc7353eb0fdb1232bull, 0xe70eeaa09a1231c3ull);
+    QuadRound(state0, state1, 0xdc1eeefd5a0f118full, 0xcb976d5f3069bad5ull);
+    QuadRound(state0, state1, 0xe15d5b1658f4ca9dull, 0xde0b7a040a35b689ull);
+    QuadRound(state0, state1, 0x6fab9537a507ea32ull, 0x37088980007f3e86ull);
+    QuadRound(state0, state1, 0xc0bbbe37cdaa3b6dull, 0x0d8cd6f117406110ull);
+    QuadRound(state0, state1, 0x6fd15ca70b02e931ull, 0xdb48a36383613bdaull);
+    QuadRound(state0, state1, 0x6d4378906ed41a95ull, 0x31338431521afacaull);
+    QuadRound(state0, state1, 0x532fb63cb5c9a0e6ull, 0x9eccabbdc39c91f2ull);
+    QuadRound(state0, state1, 0x4c191d76a4954b68ull, 0x07237ea3d2c741c6ull);
+
+    state0 = _mm_add_epi32(state0, save0);
+    state1 = _mm_add_epi32(state1, save1);
+}
+
+const uint32_t IV[8] = {
+    0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul,
+    0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul,
+};
+}
+
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    __m128i state0, state1;
+    Unshuffle(s, state0, state1);
+    for (size_t i = 0; i < blocks; i++, chunk += 64)
+        Compress(state0, state1, Load(chunk), Load(chunk + 16), Load(chunk + 32), Load(chunk + 48));
+    Shuffle(state0, state1, s);
+}
+
+void TransformD64(unsigned char* out, const unsigned char* in)
+{
+    uint32_t s[8];
+    __m128i state0, state1;
+
+    // First hash: the message, then its padding
+    Unshuffle(IV, state0, state1);
+    Compress(state0, state1, Load(in), Load(in + 16), Load(in + 32), Load(in + 48));
+    CompressPadding64(state0, state1);
+    Shuffle(state0, state1, s);
+
+    // Second hash: the 32-byte digest and its padding in one block
+    const __m128i m0 = _mm_loadu_si128((const __m128i*)s);
+    const __m128i m1 = _mm_loadu_si128((const __m128i*)(s + 4));
+    const __m128i m2 = _mm_set_epi32(0, 0, 0, 0x80000000);
+    const __m128i m3 = _mm_set_epi32(256, 0, 0, 0);
+    Unshuffle(IV, state0, state1);
+    Compress(state0, state1, m0, m1, m2, m3);
+    Shuffle(state0, state1, s);
+
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    _mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)s), mask));
+    _mm_storeu_si128((__m128i*)(out + 16), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(s + 4)), mask));
+}
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#endif
@@ -0,0 +1,73 @@
+// Copyright (c) 2026 The CampusCash developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Four 64-byte double SHA-256 hashes at once, one per xmm lane.
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+// Only called after the dispatcher has seen SSE4.1 in CPUID.
+// Nothing that other units could share may be included below this line.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("sse4.1"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC target("sse4.1")
+#endif
+
+namespace
+{
+struct OpsSSE41
+{
+    typedef __m128i V;
+    static const int N = 4;
+
+    static inline V ByteSwap(V x) { return _mm_shuffle_epi8(x, _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3)); }
+
+    static inline V Set1(uint32_t x) { return _mm_set1_epi32(x); }
+    static inline V LoadBE(const unsigned char* p)
+    {
+        int a, b, c, d;
+        memcpy(&a, p, 4);
+        memcpy(&b, p + 64, 4);
+        memcpy(&c, p + 128, 4);
+        memcpy(&d, p + 192, 4);
+        return ByteSwap(_mm_set_epi32(d, c, b, a));
+    }
+    static inline void StoreBE(unsigned char* p, V x)
+    {
+        x = ByteSwap(x);
+        int t;
+        t = _mm_extract_epi32(x, 0); memcpy(p, &t, 4);
+        t = _mm_extract_epi32(x, 1); memcpy(p + 32, &t, 4);
+        t = _mm_extract_epi32(x, 2); memcpy(p + 64, &t, 4);
+        t = _mm_extract_epi32(x, 3); memcpy(p + 96, &t, 4);
+    }
+    static inline V Add(V a, V b) { return _mm_add_epi32(a, b); }
+    static inline V Xor(V a, V b) { return _mm_xor_si128(a, b); }
+    static inline V And(V a, V b) { return _mm_and_si128(a, b); }
+    static inline V Or(V a, V b) { return _mm_or_si128(a, b); }
+    static inline V Shl(V x, int n) { return _mm_slli_epi32(x, n); }
+    static inline V Shr(V x, int n) { return _mm_srli_epi32(x, n); }
+};
+}
+
+#include "sha256_lanes.h"
+
+namespace sha256_sse41
+{
+void TransformD64_4way(unsigned char* out, const unsigned char* in)
+{
+    sha256_lanes::Compressor<OpsSSE41>::D64(out, in);
+}
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#endif
+
+#endif
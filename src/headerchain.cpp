@@ -0,0 +1,119 @@
+// Copyright (c) 2026 The CampusCash developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "headerchain.h"
+
+using namespace std;
+
+CHeaderChain::CHeaderChain() : hashBest(0), nBestHeight(-1), nBestChainWork(0)
+{
+}
+
+const CHeaderIndex* CHeaderChain::Add(const uint256& hash, const uint256& hashPrev, unsigned int nTime, const uint256& nWork,
+                                      NodeId nodeFrom, int nPrevHeight, const uint256& nPrevChainWork)
+{
+    map<uint256, CHeaderIndex>::iterator it = mapHeaders.find(hash);
+    if (it != mapHeaders.end())
+        return &it->second;
+
+    uint256 nChainWork = nPrevChainWork;
+    map<uint256, CHeaderIndex>::iterator itPrev = mapHeaders.find(hashPrev);
+    if (itPrev != mapHeaders.end())
+    {
+        nPrevHeight = itPrev->second.nHeight;
+        nChainWork = itPrev->second.nChainWork;
+        itPrev->second.nChildren++;
+    }
+    else if (nPrevHeight == -1)
+        return NULL;
+
+    CHeaderIndex header;
+    header.hashBlock = hash;
+    header.hashPrev = hashPrev;
+    header.nHeight = nPrevHeight + 1;
+    header.nTime = nTime;
+    header.nChainWork = nChainWork + nWork;
+    header.nodeFrom = nodeFrom;
+    header.nChildren = 0;
+    it = mapHeaders.insert(make_pair(hash, header)).first;
+    mapHeightIndex.insert(make_pair(header.nHeight, hash));
+    mapNodeHeaders[nodeFrom]++;
+
+    if (header.nChainWork > nBestChainWork)
+    {
+        nBestChainWork = header.nChainWork;
+        nBestHeight = header.nHeight;
+        hashBest = hash;
+    }
+    return &it->second;
+}
+
+void CHeaderChain::Erase(map<uint256, CHeaderIndex>::iterator it)
+{
+    const CHeaderIndex& header = it->second;
+
+    map<uint256, CHeaderIndex>::iterator itPrev = mapHeaders.find(header.hashPrev);
+    if (itPrev != mapHeaders.end())
+        itPrev->second.nChildren--;
+
+    map<NodeId, unsigned int>::iterator itNode = mapNodeHeaders.find(header.nodeFrom);
+    if (itNode != mapNodeHeaders.end() && --itNode->second == 0)
+        mapNodeHeaders.erase(itNode);
+
+    pair<multimap<int, uint256>::iterator, multimap<int, uint256>::iterator> range = mapHeightIndex.equal_range(header.nHeight);
+    for (multimap<int, uint256>::iterator itHeight = range.first; itHeight != range.second; ++itHeight)
+    {
+        if (itHeight->second == header.hashBlock)
+        {
+            mapHeightIndex.erase(itHeight);
+            break;
+        }
+    }
+
+    mapHeaders.erase(it);
+}
+
+unsigned int CHeaderChain::Prune(int nHeight)
+{
+    unsigned int nPruned = 0;
+    while (!mapHeightIndex.empty() && mapHeightIndex.begin()->first <= nHeight)
+    {
+        Erase(mapHeaders.find(mapHeightIndex.begin()->second));
+        nPruned++;
+    }
+    return nPruned;
+}
+
+void CHeaderChain::PruneForks(int nMaxBehind, vector<uint256>& vPruned)
+{
+    vector<uint256> vTips;
+    for (map<uint256, CHeaderIndex>::const_iterator it = mapHeaders.begin(); it != mapHeaders.end(); ++it)
+        if (it->second.nChildren == 0 && it->first != hashBest && it->second.nHeight + nMaxBehind < nBestHeight)
+            vTips.push_back(it->first);
+
+    // Walk each branch down to where it leaves a header that has others on top
+    for (vector<uint256>::const_iterator itTip = vTips.begin(); itTip != vTips.end(); ++itTip)
+    {
+        map<uint256, CHeaderIndex>::iterator it = mapHeaders.find(*itTip);
+        while (it != mapHeaders.end() && it->second.nChildren == 0 && it->first != hashBest)
+        {
+            uint256 hashPrev = it->second.hashPrev;
+            vPruned.push_back(it->first);
+            Erase(it);
+            it = mapHeaders.find(hashPrev);
+        }
+    }
+}
+
+const CHeaderIndex* CHeaderChain::Get(const uint256& hash) const
+{
+    map<uint256, CHeaderIndex>::const_iterator it = mapHeaders.find(hash);
+    return it == mapHeaders.end() ? NULL : &it->second;
+}
+
+unsigned int CHeaderChain::CountFrom(NodeId nodeid) const
+{
+    map<NodeId, unsigned int>::const_iterator it = mapNodeHeaders.find(nodeid);
+    return it == mapNodeHeaders.end() ? 0 : it->second;
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2026 The CampusCash developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_HEADERCHAIN_H
+#define BITCOIN_HEADERCHAIN_H
+
+#include "uint256.h"
+
+#include <map>
+#include <vector>
+
+typedef int NodeId;
+
+/** A block header received ahead of its block */
+struct CHeaderIndex
+{
+    uint256 hashBlock;
+    uint256 hashPrev;
+    int nHeight;
+    unsigned int nTime;
+    uint256 nChainWork;     // Work of the chain up to and including this header.
+    NodeId nodeFrom;        // Peer that sent it.
+    unsigned int nChildren; // Headers here on top of it.
+};
+
+/*
+ * CHeaderChain is the header-only stage of headers-first sync: headers of
+ * blocks we do not have yet, each placed at its height on top of another
+ * header or of a block we have. The best header is the one with the most
+ * chain work. Block downloads are scheduled from it in chain order, headers
+ * are pruned once the chain has passed their height, and side branches once
+ * they have fallen behind the best one.
+ *
+ * Not locked, callers hold cs_main.
+ */
+class CHeaderChain
+{
+private:
+    std::map<uint256, CHeaderIndex> mapHeaders;
+    std::multimap<int, uint256> mapHeightIndex;
+    std::map<NodeId, unsigned int> mapNodeHeaders;
+    uint256 hashBest;
+    int nBestHeight;
+    uint256 nBestChainWork;
+
+    void Erase(std::map<uint256, CHeaderIndex>::iterator it);
+
+public:
+    CHeaderChain();
+
+    /** Add a header worth nWork on top of one already here or, when
+      * nPrevHeight is not -1, on the block we have at that height with
+      * nPrevChainWork. Returns the stored header, or NULL if it connects to
+      * neither. */
+    const CHeaderIndex* Add(const uint256& hash, const uint256& hashPrev, unsigned int nTime, const uint256& nWork,
+                            NodeId nodeFrom, int nPrevHeight = -1, const uint256& nPrevChainWork = 0);
+
+    /** Forget the headers at or below nHeight, returns how many went */
+    unsigned int Prune(int nHeight);
+
+    /** Forget the side branches that end more than nMaxBehind below the best
+      * header, adding the hashes of the headers that went to vPruned */
+    void PruneForks(int nMaxBehind, std::vector<uint256>& vPruned);
+
+    /** The header with this hash, or NULL */
+    const CHeaderIndex* Get(const uint256& hash) const;
+
+    bool Contains(const uint256& hash) const { return mapHeaders.count(hash) != 0; }
+
+    /** Number of headers here that a peer sent */
+    unsigned int CountFrom(NodeId nodeid) const;
+
+    /** The header with the most chain work, first come first served,
+      * remembered after it has been pruned; -1 and 0 before any */
+    int GetBestHeight() const { return nBestHeight; }
+    const uint256& GetBestHash() const { return hashBest; }
+
+    size_t size() const { return mapHeaders.size(); }
+};
+
+#endif
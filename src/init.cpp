@@ -9,6 +9,7 @@
 #include "main.h"
 #include "chainparams.h"
 #include "txdb.h"
+#include "txcache.h"
 #include "rpcserver.h"
 #include "net.h"
 #include "key.h"
@@ -27,6 +28,7 @@
 
 #ifdef ENABLE_WALLET
 #include "db.h"
+#include "miner.h"
 #include "wallet.h"
 #include "walletdb.h"
 #endif
@@ -58,6 +60,7 @@ bool fConfChange;
 unsigned int nNodeLifespan;
 unsigned int nDerivationMethodIndex;
 unsigned int nMinerSleep;
+int nStakeThreads;
 bool fUseFastIndex;
 bool fOnlyTor = false;
 
@@ -119,6 +122,7 @@ void Shutdown()
     SecureMsgShutdown();
 
 #ifdef ENABLE_WALLET
+    GeneratePoWBlocks(false, NULL, 0);
     ShutdownRPCMining();
     if (pwalletMain)
         bitdb.Flush(false);
@@ -126,6 +130,9 @@ void Shutdown()
     StopNode();
     UnregisterNodeSignals(GetNodeSignals());
     DumpMasternodes();
+    // Not before the load finished, or the transactions not read back yet are lost
+    if (mempool.IsLoaded() && GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
+        DumpMempool();
     {
         LOCK(cs_main);
 #ifdef ENABLE_WALLET
@@ -195,13 +202,17 @@ std::string HelpMessage()
     strUsage += "  -datadir=<dir>         " + _("Specify data directory") + "\n";
     strUsage += "  -wallet=<dir>          " + _("Specify wallet file (within data directory)") + "\n";
     strUsage += "  -dbcache=<n>           " + _("Set database cache size in megabytes (default: 100)") + "\n";
+    strUsage += "  -txcache=<n>           " + strprintf(_("Keep up to <n> megabytes of recently used transactions in memory for input lookups (default: %u)"), DEFAULT_TX_CACHE_SIZE) + "\n";
     strUsage += "  -dblogsize=<n>         " + _("Set database disk log size in megabytes (default: 100)") + "\n";
     strUsage += "  -timeout=<n>           " + _("Specify connection timeout in milliseconds (default: 5000)") + "\n";
     strUsage += "  -proxy=<ip:port>       " + _("Connect through SOCKS5 proxy") + "\n";
     strUsage += "  -tor=<ip:port>         " + _("Use proxy to reach tor hidden services (default: same as -proxy)") + "\n";
     strUsage += "  -dns                   " + _("Allow DNS lookups for -addnode, -seednode and -connect") + "\n";
     strUsage += "  -port=<port>           " + _("Listen for connections on <port> (default: 51441)") + "\n";
-    strUsage += "  -maxconnections=<n>    " + _("Maintain at most <n> connections to peers (default: 125)") + "\n";
+    strUsage += "  -maxconnections=<n>    " + strprintf(_("Maintain at most <n> connections to peers (default: %u)"), DEFAULT_MAX_PEER_CONNECTIONS) + "\n";
+#ifdef USE_EPOLL
+    strUsage += "  -socketevents=<mode>   " + strprintf(_("Wait for socket events with select or epoll (default: %s)"), SocketEventsModeName(DEFAULT_SOCKETEVENTS)) + "\n";
+#endif
     strUsage += "  -addnode=<ip>          " + _("Add a node to connect to and attempt to keep the connection open") + "\n";
     strUsage += "  -connect=<ip>          " + _("Connect only to the specified node(s)") + "\n";
     strUsage += "  -seednode=<ip>         " + _("Connect to a node to retrieve peer addresses, and disconnect") + "\n";
@@ -217,6 +228,7 @@ std::string HelpMessage()
     strUsage += "  -bantime=<n>           " + _("Number of seconds to keep misbehaving peers from reconnecting (default: 86400)") + "\n";
     strUsage += "  -maxreceivebuffer=<n>  " + _("Maximum per-connection receive buffer, <n>*1000 bytes (default: 5000)") + "\n";
     strUsage += "  -maxsendbuffer=<n>     " + _("Maximum per-connection send buffer, <n>*1000 bytes (default: 1000)") + "\n";
+    strUsage += "  -msghandlerthreads=<n> " + strprintf(_("Process peer messages on <n> threads, up to %d (default: %d)"), MAX_MESSAGE_HANDLER_THREADS, DEFAULT_MESSAGE_HANDLER_THREADS) + "\n";
 #ifdef USE_UPNP
 #if USE_UPNP
     strUsage += "  -upnp                  " + _("Use UPnP to map the listening port (default: 1 when listening)") + "\n";
@@ -269,7 +281,17 @@ std::string HelpMessage()
     strUsage += "  -checkblocks=<n>       " + _("How many blocks to check at startup (default: 500, 0 = all)") + "\n";
     strUsage += "  -checklevel=<n>        " + _("How thorough the block verification is (0-6, default: 1)") + "\n";
     strUsage += "  -loadblock=<file>      " + _("Imports blocks from external blk000?.dat file") + "\n";
+    strUsage += "  -maxsigcachesize=<n>   " + strprintf(_("Keep up to <n> megabytes of verified signatures in memory (up to %u, default: %u)"), MAX_SIG_CACHE_SIZE, DEFAULT_MAX_SIG_CACHE_SIZE) + "\n";
+    strUsage += "  -par=<n>               " + strprintf(_("Set the number of script verification threads (up to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS) + "\n";
+    strUsage += "  -rawblockcache=<n>     " + strprintf(_("Keep up to <n> megabytes of recently served blocks and transactions in memory (default: %u)"), DEFAULT_RAW_BLOCK_CACHE_SIZE) + "\n";
     strUsage += "  -maxorphanblocks=<n>   " + strprintf(_("Keep at most <n> unconnectable blocks in memory (default: %u)"), DEFAULT_MAX_ORPHAN_BLOCKS) + "\n";
+    strUsage += "  -maxorphanblocksize=<n> " + strprintf(_("Keep at most <n> megabytes of unconnectable blocks in memory (default: %u)"), DEFAULT_MAX_ORPHAN_BLOCKS_SIZE) + "\n";
+    strUsage += "  -headersfirst          " + strprintf(_("Fetch block headers before the blocks during initial sync (default: %u)"), DEFAULT_HEADERS_FIRST) + "\n";
+    strUsage += "  -maxorphantx=<n>       " + strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS) + "\n";
+    strUsage += "  -maxorphantxsize=<n>   " + strprintf(_("Keep at most <n> megabytes of unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TX_SIZE) + "\n";
+    strUsage += "  -maxmempool=<n>        " + strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE) + "\n";
+    strUsage += "  -mempoolexpiry=<n>     " + strprintf(_("Do not keep transactions in the memory pool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY) + "\n";
+    strUsage += "  -persistmempool        " + strprintf(_("Save the memory pool on shutdown and load it on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL) + "\n";
     strUsage += "  -backtoblock=<n>      " + _("Rollback local block chain to block height <n>") + "\n";
     strUsage += "  -maxblockheight=<n>    " + _("Stop sync when block height reaches <n>") + "\n";
 
@@ -278,6 +300,9 @@ std::string HelpMessage()
     strUsage += "  -blockmaxsize=<n>      "   + _("Set maximum block size in bytes (default: 250000)") + "\n";
     strUsage += "  -blockprioritysize=<n> "   + _("Set maximum size of high-priority/low-fee transactions in bytes (default: 50000)") + "\n";
     strUsage += "  -scaleblocksizeoptions=<n>"    + strprintf(_("Adaptively scale block size options (max, min, priority) (default: %d)"), DEFAULT_SCALE_BLOCK_SIZE_OPTIONS) + "\n";
+    strUsage += "  -gen                   "   + _("Mine proof-of-work blocks (default: 0)") + "\n";
+    strUsage += "  -genproclimit=<n>      "   + strprintf(_("Number of threads mining proof-of-work blocks with -gen (-1 = one per core, default: %d)"), DEFAULT_GENERATE_THREADS) + "\n";
+    strUsage += "  -stakethreads=<n>      "   + strprintf(_("Number of threads searching for proof-of-stake kernels (1-%d, default: %d)"), MAX_STAKE_THREADS, DEFAULT_STAKE_THREADS) + "\n";
 
     strUsage += "\n" + _("SSL options: (see the CampusCash Wiki for SSL setup instructions)") + "\n";
     strUsage += "  -rpcssl                                  " + _("Use OpenSSL (https) for JSON-RPC connections") + "\n";
@@ -376,6 +401,7 @@ bool AppInit2(boost::thread_group& threadGroup)
     nNodeLifespan = GetArg("-addrlifespan", 7);
     fUseFastIndex = GetBoolArg("-fastindex", true);
     nMinerSleep = GetArg("-minersleep", 500);
+    nStakeThreads = std::max(1, std::min(MAX_STAKE_THREADS, (int)GetArg("-stakethreads", DEFAULT_STAKE_THREADS)));
 
     nDerivationMethodIndex = 0;
 
@@ -471,6 +497,16 @@ bool AppInit2(boost::thread_group& threadGroup)
        fServer = true;
     fPrintToConsole = GetBoolArg("-printtoconsole", false);
     fLogTimestamps = GetBoolArg("-logtimestamps", true);
+
+    // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
+    nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
+    if (nScriptCheckThreads <= 0)
+        nScriptCheckThreads += boost::thread::hardware_concurrency();
+    if (nScriptCheckThreads <= 1)
+        nScriptCheckThreads = 0;
+    else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
+        nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
+
 #ifdef ENABLE_WALLET
     bool fDisableWallet = GetBoolArg("-disablewallet", false);
 #endif
@@ -494,6 +530,8 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     fConfChange = GetBoolArg("-confchange", false);
 
+    txReadCache.SetMaxSize(std::max((int64_t)0, GetArg("-txcache", DEFAULT_TX_CACHE_SIZE)) * 1048576);
+
 #ifdef ENABLE_WALLET
     if (mapArgs.count("-mininput"))
     {
@@ -533,6 +571,8 @@ bool AppInit2(boost::thread_group& threadGroup)
     LogPrintf("\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n");
     LogPrintf("CampusCash version %s (%s)\n", FormatFullVersion(), CLIENT_DATE);
     LogPrintf("Using OpenSSL version %s\n", SSLeay_version(SSLEAY_VERSION));
+    LogPrintf("Using BMW-512 header implementation %s\n", BMW512AutoDetect());
+    LogPrintf("Using SHA-256 implementation %s\n", SHA256AutoDetect());
     if (!fLogTimestamps)
         LogPrintf("Startup time: %s\n", DateTimeStrFormat("%x %H:%M:%S", GetTime()));
     LogPrintf("Default data directory %s\n", GetDefaultDataDir().string());
@@ -556,6 +596,12 @@ bool AppInit2(boost::thread_group& threadGroup)
     if (fDaemon)
         fprintf(stdout, "CampusCash server starting\n"); 
 
+    if (nScriptCheckThreads) {
+        LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadScriptCheck);
+    }
+
     int64_t nStart;
 
     // ********************************************************* Step 5: Backup wallet and verify wallet database integrity
@@ -737,6 +783,22 @@ bool AppInit2(boost::thread_group& threadGroup)
         SetReachable(NET_TOR);
     }
 
+    SocketEventsMode modeSocketEvents = DEFAULT_SOCKETEVENTS;
+    if (mapArgs.count("-socketevents") && !ParseSocketEventsMode(mapArgs["-socketevents"], modeSocketEvents))
+        return InitError(strprintf(_("Unknown or unsupported -socketevents mode: '%s'"), mapArgs["-socketevents"]));
+    modeSocketEvents = InitSocketEvents(modeSocketEvents);
+
+    // Make sure enough file descriptors are available, select() cannot
+    // wait on descriptors past FD_SETSIZE however many there are
+    int nUserMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
+    nMaxConnections = max(nUserMaxConnections, 0);
+    if (modeSocketEvents == SOCKETEVENTS_SELECT)
+        nMaxConnections = min(nMaxConnections, (int)FD_SETSIZE - MIN_CORE_FILEDESCRIPTORS);
+    int nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
+    nMaxConnections = max(min(nMaxConnections, nFD - MIN_CORE_FILEDESCRIPTORS), 0);
+    if (nMaxConnections < nUserMaxConnections)
+        InitWarning(strprintf(_("Reducing -maxconnections from %d to %d, because of system limitations."), nUserMaxConnections, nMaxConnections));
+
     // see Step 2: parameter interactions for more information about these
     fNoListen = !GetBoolArg("-listen", true);
     fDiscover = GetBoolArg("-discover", true);
@@ -851,15 +913,9 @@ bool AppInit2(boost::thread_group& threadGroup)
         if(!strRollbackToBlock.empty()){
             nNewHeight = GetArg("-backtoblock", 0);
 
-            CBlockIndex* pindex = pindexBest;
-            while (pindex != NULL && pindex->nHeight > nNewHeight)
-            {
-                ostringstream osHeight;
-                osHeight << pindex->nHeight;
-                string strHeight = osHeight.str();
-                uiInterface.InitMessage(strprintf("Rolling blocks back... %s to %i \n", strHeight, nNewHeight));
-                pindex = pindex->pprev;
-            }
+            uiInterface.InitMessage(strprintf("Rolling blocks back... %d to %i \n", nBestHeight, nNewHeight));
+            LOCK(cs_main);
+            CBlockIndex* pindex = FindBlockByHeight(nNewHeight);
 
             if (pindex != NULL)
             {
@@ -1134,13 +1190,15 @@ bool AppInit2(boost::thread_group& threadGroup)
         uiInterface.InitMessage(_("Rebuilding address index..."));
         CBlockIndex *pblockAddrIndex = pindexBest;
 	CTxDB txdbAddr("rw");
+	if (!txdbAddr.ClearAddrIndex())
+	    return InitError(_("Error clearing the address index"));
 	while(pblockAddrIndex)
 	{
 	    uiInterface.InitMessage(strprintf("Rebuilding address index, block %i", pblockAddrIndex->nHeight));
 	    bool ReadFromDisk(const CBlockIndex* pindex, bool fReadTransactions=true);
 	    CBlock pblockAddr;
 	    if(pblockAddr.ReadFromDisk(pblockAddrIndex, true))
-	        pblockAddr.RebuildAddressIndex(txdbAddr);
+	        pblockAddr.RebuildAddressIndex(txdbAddr, pblockAddrIndex->nHeight);
 	    pblockAddrIndex = pblockAddrIndex->pprev;
 	}
     }
@@ -1169,6 +1227,10 @@ bool AppInit2(boost::thread_group& threadGroup)
     else if (pwalletMain)
         threadGroup.create_thread(boost::bind(&ThreadStakeMiner, pwalletMain));
 
+    // Mine proof-of-work blocks with -gen
+    if (pwalletMain)
+        GeneratePoWBlocks(GetBoolArg("-gen", false), pwalletMain, GetArg("-genproclimit", DEFAULT_GENERATE_THREADS));
+
     if(pwalletMain->IsLocked())
     {
         //Toggle wallet lock status
@@ -38,4 +38,21 @@ int64_t GetWeight(int64_t nIntervalBeginning, int64_t nIntervalEnd);
 // Convenient for searching a kernel
 bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, const COutPoint& prevout, int64_t* pBlockTime = NULL);
 
+// Everything the kernel hash needs to know about a stake input,
+// so that a staker can try many timestamps without touching the disk
+struct CStakeCandidate
+{
+    COutPoint prevout;
+    CBlockIndex* pindexFrom; // block containing the input's transaction
+    unsigned int nBlockTime;
+    unsigned int nTxTime;
+    int64_t nValue;
+};
+
+// Read a stake input and its block header from disk
+bool ReadStakeCandidate(CTxDB& txdb, const COutPoint& prevout, CStakeCandidate& candidate);
+
+// Same as CheckKernel() above, but for an input already read from disk
+bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, int64_t nTime, const CStakeCandidate& candidate);
+
 #endif // PPCOIN_KERNEL_H
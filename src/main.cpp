@@ -7,14 +7,19 @@
 
 #include "addrman.h"
 #include "alert.h"
+#include "blockdownload.h"
 #include "blocksizecalculator.h"
 #include "blockparams.h"
 #include "chainparams.h"
 #include "checkpoints.h"
+#include "checkqueue.h"
 #include "db.h"
+#include "headerchain.h"
 #include "init.h"
 #include "kernel.h"
 #include "net.h"
+#include "orphanblocks.h"
+#include "txcache.h"
 #include "txdb.h"
 #include "txmempool.h"
 #include "ui_interface.h"
@@ -57,25 +62,24 @@ uint256 nBestChainTrust = 0;
 uint256 nBestInvalidTrust = 0;
 uint256 hashBestChain = 0;
 CBlockIndex* pindexBest = NULL;
+CChain chainActive;
 int64_t nTimeBestReceived = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fAddrIndex = false;
 bool fHaveGUI = false;
 bool fRollingCheckpoint = false;
+int nScriptCheckThreads = 0;
 
-struct COrphanBlock {
-    uint256 hashBlock;
-    uint256 hashPrev;
-    std::pair<COutPoint, unsigned int> stake;
-    vector<unsigned char> vchBlock;
-};
-map<uint256, COrphanBlock*> mapOrphanBlocks;
-multimap<uint256, COrphanBlock*> mapOrphanBlocksByPrev;
-set<pair<COutPoint, unsigned int> > setStakeSeenOrphan;
+std::atomic<uint64_t> nTransactionHashesComputed(0);
+std::atomic<uint64_t> nBlockHashesComputed(0);
 
-map<uint256, CTransaction> mapOrphanTransactions;
-map<uint256, set<uint256> > mapOrphanTransactionsByPrev;
+COrphanBlockPool orphanBlocks;
+CHeaderChain headerChain;
+
+map<uint256, COrphanTx> mapOrphanTransactions;
+map<COutPoint, set<uint256> > mapOrphanTransactionsByPrev;
+uint64_t nOrphanTxBytes = 0;
 
 // Constant stuff for coinbase transactions we create:
 CScript COINBASE_FLAGS;
@@ -101,9 +105,19 @@ struct QueuedBlock {
     uint256 hash;
     int64_t nTime;  // Time of "getdata" request in microseconds.
     int nQueuedBefore;  // Number of blocks in flight at the time of request.
+    int nHeight;  // Estimated height, -1 if unknown.
 };
 map<uint256, pair<NodeId, list<QueuedBlock>::iterator> > mapBlocksInFlight;
-map<uint256, pair<NodeId, list<uint256>::iterator> > mapBlocksToDownload;
+
+// Blocks waiting to be requested. Those announced in a getblocks reply or
+// by headers during initial download have an estimated height and may be
+// fetched from any peer that is far enough ahead.
+CBlockDownloadQueue blocksToDownload;
+
+// Blocks fetched during initial download ahead of their parent, held until
+// it is accepted instead of going through the orphan pool. Protected by
+// cs_main.
+CBlockBuffer blocksBuffered;
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -194,10 +208,30 @@ struct CNodeState {
     std::vector<CBlockReject> rejects;
     list<QueuedBlock> vBlocksInFlight;
     int nBlocksInFlight;
-    list<uint256> vBlocksToDownload;
+    // Number of queued blocks this peer announced.
     int nBlocksToDownload;
     int64_t nLastBlockReceive;
     int64_t nLastBlockProcess;
+    // Whether requests were taken back from this peer for being too slow.
+    // Until it delivers again it is only asked for what it announced itself
+    // and for what no other peer took up within BLOCK_STALLING_TIMEOUT.
+    bool fStalling;
+    // Highest block this peer is believed to have, lowered when it answers a
+    // block request with notfound.
+    int nMaxDownloadHeight;
+    // Estimated height of the next block in a getblocks reply, -1 if none is expected.
+    int nGetBlocksHeight;
+    // How many more blocks that reply may list.
+    int nGetBlocksLeft;
+    // Last block announced in a getblocks reply, and its estimated height.
+    uint256 hashLastAnnounced;
+    int nLastAnnouncedHeight;
+    // Value of hashLastAnnounced when the last follow-up getblocks was sent.
+    uint256 hashGetBlocksAfter;
+    // When getheaders was last sent, 0 once the reply is in.
+    int64_t nGetHeadersTime;
+    // Last header of a full headers reply, to ask what follows; 0 if none.
+    uint256 hashMoreHeaders;
 
     CNodeState() {
         nMisbehavior = 0;
@@ -206,6 +240,15 @@ struct CNodeState {
         nBlocksInFlight = 0;
         nLastBlockReceive = 0;
         nLastBlockProcess = 0;
+        fStalling = false;
+        nMaxDownloadHeight = std::numeric_limits<int>::max();
+        nGetBlocksHeight = -1;
+        nGetBlocksLeft = 0;
+        hashLastAnnounced = 0;
+        nLastAnnouncedHeight = -1;
+        hashGetBlocksAfter = 0;
+        nGetHeadersTime = 0;
+        hashMoreHeaders = 0;
     }
 };
 
@@ -234,26 +277,13 @@ void InitializeNode(NodeId nodeid, const CNode *pnode) {
     state.name = pnode->addrName;
 }
 
-void FinalizeNode(NodeId nodeid) {
-    LOCK(cs_main);
-    CNodeState *state = State(nodeid);
-
-    BOOST_FOREACH(const QueuedBlock& entry, state->vBlocksInFlight)
-        mapBlocksInFlight.erase(entry.hash);
-    BOOST_FOREACH(const uint256& hash, state->vBlocksToDownload)
-        mapBlocksToDownload.erase(hash);
-
-    mapNodeState.erase(nodeid);
-}
-
 // Requires cs_main.
 void MarkBlockAsReceived(const uint256 &hash, NodeId nodeFrom = -1) {
-    map<uint256, pair<NodeId, list<uint256>::iterator> >::iterator itToDownload = mapBlocksToDownload.find(hash);
-    if (itToDownload != mapBlocksToDownload.end()) {
-        CNodeState *state = State(itToDownload->second.first);
-        state->vBlocksToDownload.erase(itToDownload->second.second);
-        state->nBlocksToDownload--;
-        mapBlocksToDownload.erase(itToDownload);
+    NodeId nodeQueued;
+    if (blocksToDownload.Remove(hash, nodeQueued)) {
+        CNodeState *state = State(nodeQueued);
+        if (state != NULL)
+            state->nBlocksToDownload--;
     }
 
     map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
@@ -266,34 +296,38 @@ void MarkBlockAsReceived(const uint256 &hash, NodeId nodeFrom = -1) {
         mapBlocksInFlight.erase(itInFlight);
     }
 
+    if (nodeFrom != -1) {
+        CNodeState *state = State(nodeFrom);
+        if (state != NULL)
+            state->fStalling = false;
+    }
 }
 
 // Requires cs_main.
-bool AddBlockToQueue(NodeId nodeid, const uint256 &hash) {
-    if (mapBlocksToDownload.count(hash) || mapBlocksInFlight.count(hash))
+bool AddBlockToQueue(NodeId nodeid, const uint256 &hash, int nHeight = -1) {
+    if (blocksToDownload.Contains(hash) || mapBlocksInFlight.count(hash) || blocksBuffered.Contains(hash))
         return false;
 
     CNodeState *state = State(nodeid);
     if (state == NULL)
         return false;
 
-    list<uint256>::iterator it = state->vBlocksToDownload.insert(state->vBlocksToDownload.end(), hash);
+    blocksToDownload.Add(hash, nodeid, nHeight, GetTimeMicros());
     state->nBlocksToDownload++;
-    if (state->nBlocksToDownload > 5000)
+    if (state->nBlocksToDownload > MAX_BLOCKS_TO_DOWNLOAD)
         Misbehaving(nodeid, 10);
-    mapBlocksToDownload[hash] = std::make_pair(nodeid, it);
     return true;
 }
 
 // Requires cs_main.
-void MarkBlockAsInFlight(NodeId nodeid, const uint256 &hash) {
+void MarkBlockAsInFlight(NodeId nodeid, const uint256 &hash, int nHeight = -1) {
     CNodeState *state = State(nodeid);
     assert(state != NULL);
 
     // Make sure it's not listed somewhere already.
     MarkBlockAsReceived(hash);
 
-    QueuedBlock newentry = {hash, GetTimeMicros(), state->nBlocksInFlight};
+    QueuedBlock newentry = {hash, GetTimeMicros(), state->nBlocksInFlight, nHeight};
     if (state->nBlocksInFlight == 0)
         state->nLastBlockReceive = newentry.nTime; // Reset when a first request is sent.
     list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(), newentry);
@@ -301,6 +335,51 @@ void MarkBlockAsInFlight(NodeId nodeid, const uint256 &hash) {
     mapBlocksInFlight[hash] = std::make_pair(nodeid, it);
 }
 
+// Requires cs_main. Take back a block that was asked of a peer and queue it
+// ahead of the others at its height, for the next peer with room. A block
+// without an estimated height can only be asked of the peer that announced
+// it, so it is dropped instead, to be announced again.
+void ReassignBlock(const uint256 &hash) {
+    map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end())
+        return;
+    int nHeight = itInFlight->second.second->nHeight;
+    MarkBlockAsReceived(hash);
+    blocksToDownload.PushFront(hash, nHeight, GetTimeMicros());
+}
+
+// Requires cs_main. Pick up to nCount queued blocks for a peer, lowest first:
+// the ones it announced, and those with an estimated height inside the
+// download window that it should have too. Blocks with a height are queued
+// in height order, so nothing past the first one outside the window is
+// looked at; headers-first sync can queue many thousands. A peer that was
+// too slow only gets what nobody else took up for BLOCK_STALLING_TIMEOUT,
+// so that it still gets them when it is the only peer.
+void FindNextBlocksToDownload(const CNode *pnode, const CNodeState &state, unsigned int nCount, vector<CBlockToDownload> &vBlocks) {
+    int nWindowEnd = nBestHeight + BLOCK_DOWNLOAD_WINDOW;
+    int nMaxHeight = std::min(pnode->nStartingHeight, state.nMaxDownloadHeight);
+    int64_t nQueuedBefore = state.fStalling ? GetTimeMicros() - BLOCK_STALLING_TIMEOUT*1000000 : std::numeric_limits<int64_t>::max();
+    blocksToDownload.FindNext(pnode->GetId(), nMaxHeight, nWindowEnd, nQueuedBefore, nCount, vBlocks);
+}
+
+void FinalizeNode(NodeId nodeid) {
+    LOCK(cs_main);
+    CNodeState *state = State(nodeid);
+
+    // Whatever it was still fetching goes to other peers, lowest first
+    vector<uint256> vInFlight;
+    BOOST_FOREACH(const QueuedBlock& entry, state->vBlocksInFlight)
+        vInFlight.push_back(entry.hash);
+    BOOST_REVERSE_FOREACH(const uint256& hash, vInFlight)
+        ReassignBlock(hash);
+
+    // Of the blocks it announced, keep those that others can be asked for
+    blocksToDownload.ForgetNode(nodeid);
+    EraseOrphansFor(nodeid);
+
+    mapNodeState.erase(nodeid);
+}
+
 }
 
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
@@ -309,6 +388,7 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     if (state == NULL)
         return false;
     stats.nMisbehavior = state->nMisbehavior;
+    stats.nBlocksInFlight = state->nBlocksInFlight;
     return true;
 }
 
@@ -346,7 +426,7 @@ bool AbortNode(const std::string &strMessage, const std::string &userMessage) {
 // mapOrphanTransactions
 //
 
-bool AddOrphanTx(const CTransaction& tx)
+bool AddOrphanTx(const CTransaction& tx, NodeId peer)
 {
     uint256 hash = tx.GetHash();
     if (mapOrphanTransactions.count(hash))
@@ -357,51 +437,91 @@ bool AddOrphanTx(const CTransaction& tx)
     // large transaction with a missing parent then we assume
     // it will rebroadcast it later, after the parent transaction(s)
     // have been mined or received.
-    // 10,000 orphans, each of which is at most 5,000 bytes big is
-    // at most 500 megabytes of orphans:
+    // -maxorphantxsize bounds the total on top of that.
 
     size_t nSize = tx.GetSerializeSize(SER_NETWORK, CTransaction::CURRENT_VERSION);
 
-    if (nSize > 5000)
+    if (nSize > MAX_ORPHAN_TX_SIZE)
     {
         LogPrint("mempool", "ignoring large orphan tx (size: %u, hash: %s)\n", nSize, hash.ToString());
         return false;
     }
 
-    mapOrphanTransactions[hash] = tx;
+    COrphanTx& orphan = mapOrphanTransactions[hash];
+    orphan.tx = tx;
+    orphan.fromPeer = peer;
+    orphan.nTimeExpire = GetTime() + ORPHAN_TX_EXPIRE_TIME;
+    orphan.nTxSize = nSize;
     BOOST_FOREACH(const CTxIn& txin, tx.vin)
-        mapOrphanTransactionsByPrev[txin.prevout.hash].insert(hash);
+        mapOrphanTransactionsByPrev[txin.prevout].insert(hash);
+    nOrphanTxBytes += nSize;
 
-    LogPrint("mempool", "stored orphan tx %s (mapsz %u)\n", hash.ToString(),
-        mapOrphanTransactions.size());
+    LogPrint("mempool", "stored orphan tx %s (mapsz %u, %u bytes)\n", hash.ToString(),
+        mapOrphanTransactions.size(), nOrphanTxBytes);
     return true;
 }
 
-void static EraseOrphanTx(uint256 hash)
+int static EraseOrphanTx(uint256 hash)
 {
-    map<uint256, CTransaction>::iterator it = mapOrphanTransactions.find(hash);
+    map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
     if (it == mapOrphanTransactions.end())
-        return;
-    BOOST_FOREACH(const CTxIn& txin, it->second.vin)
+        return 0;
+    BOOST_FOREACH(const CTxIn& txin, it->second.tx.vin)
     {
-        map<uint256, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout.hash);
+        map<COutPoint, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
         if (itPrev == mapOrphanTransactionsByPrev.end())
             continue;
         itPrev->second.erase(hash);
         if (itPrev->second.empty())
             mapOrphanTransactionsByPrev.erase(itPrev);
     }
+    nOrphanTxBytes -= it->second.nTxSize;
     mapOrphanTransactions.erase(it);
+    return 1;
 }
 
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
+void EraseOrphansFor(NodeId peer)
+{
+    int nErased = 0;
+    map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
+    while (iter != mapOrphanTransactions.end())
+    {
+        map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
+        if (maybeErase->second.fromPeer == peer)
+            nErased += EraseOrphanTx(maybeErase->first);
+    }
+    if (nErased > 0)
+        LogPrint("mempool", "Erased %d orphan tx from peer %d\n", nErased, peer);
+}
+
+unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, uint64_t nMaxBytes)
 {
     unsigned int nEvicted = 0;
-    while (mapOrphanTransactions.size() > nMaxOrphans)
+
+    // Sweep out expired orphans, at most once per ORPHAN_TX_EXPIRE_INTERVAL
+    static int64_t nNextSweep;
+    int64_t nNow = GetTime();
+    if (nNextSweep <= nNow)
+    {
+        int64_t nMinExpTime = nNow + ORPHAN_TX_EXPIRE_TIME;
+        map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
+        while (iter != mapOrphanTransactions.end())
+        {
+            map<uint256, COrphanTx>::iterator maybeErase = iter++;
+            if (maybeErase->second.nTimeExpire <= nNow)
+                nEvicted += EraseOrphanTx(maybeErase->first);
+            else
+                nMinExpTime = std::min(maybeErase->second.nTimeExpire, nMinExpTime);
+        }
+        nNextSweep = std::max(nMinExpTime, nNow + ORPHAN_TX_EXPIRE_INTERVAL);
+    }
+
+    while (!mapOrphanTransactions.empty() &&
+           (mapOrphanTransactions.size() > nMaxOrphans || nOrphanTxBytes > nMaxBytes))
     {
         // Evict a random orphan:
         uint256 randomhash = GetRandHash();
-        map<uint256, CTransaction>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
+        map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
         if (it == mapOrphanTransactions.end())
             it = mapOrphanTransactions.begin();
         EraseOrphanTx(it->first);
@@ -410,6 +530,58 @@ unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
     return nEvicted;
 }
 
+// Retry the orphans spending outputs of the transactions in vWorkQueue,
+// which is extended with every orphan accepted. Each orphan is tried at
+// most once, and only when none of its inputs is still another orphan:
+// such a child gets its turn when that parent is accepted.
+void static ProcessOrphanTxs(vector<uint256>& vWorkQueue)
+{
+    AssertLockHeld(cs_main);
+    set<uint256> setTried;
+    for (unsigned int i = 0; i < vWorkQueue.size() && !mapOrphanTransactions.empty(); i++)
+    {
+        const uint256 hashParent = vWorkQueue[i];
+        vector<uint256> vOrphans;
+        for (map<COutPoint, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.lower_bound(COutPoint(hashParent, 0));
+             itByPrev != mapOrphanTransactionsByPrev.end() && itByPrev->first.hash == hashParent;
+             ++itByPrev)
+            vOrphans.insert(vOrphans.end(), itByPrev->second.begin(), itByPrev->second.end());
+
+        BOOST_FOREACH(const uint256& orphanTxHash, vOrphans)
+        {
+            map<uint256, COrphanTx>::iterator mi = mapOrphanTransactions.find(orphanTxHash);
+            if (mi == mapOrphanTransactions.end() || setTried.count(orphanTxHash))
+                continue;
+
+            bool fOrphanParent = false;
+            BOOST_FOREACH(const CTxIn& txin, mi->second.tx.vin)
+                if (mapOrphanTransactions.count(txin.prevout.hash))
+                    fOrphanParent = true;
+            if (fOrphanParent)
+                continue;
+
+            setTried.insert(orphanTxHash);
+            CTransaction orphanTx = mi->second.tx;
+            bool fMissingInputs2 = false;
+
+            if (AcceptToMemoryPool(mempool, orphanTx, true, &fMissingInputs2))
+            {
+                LogPrint("mempool", "   accepted orphan tx %s\n", orphanTxHash.ToString());
+                RelayTransaction(orphanTx, orphanTxHash);
+                vWorkQueue.push_back(orphanTxHash);
+                EraseOrphanTx(orphanTxHash);
+            }
+            else if (!fMissingInputs2)
+            {
+                // Has inputs but not accepted to mempool
+                // Probably non-standard or insufficient fee/priority
+                EraseOrphanTx(orphanTxHash);
+                LogPrint("mempool", "   removed orphan tx %s\n", orphanTxHash.ToString());
+            }
+        }
+    }
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // CTransaction and CTxIndex
@@ -668,6 +840,28 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const MapPrevTx& inputs)
     return nSigOps;
 }
 
+double GetTxPriority(const CTransaction& tx, const MapPrevTx& inputs, unsigned int nSize, int64_t& nInChainInputValue)
+{
+    double dPriority = 0;
+    nInChainInputValue = 0;
+    map<uint256, int> mapDepth;
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    {
+        MapPrevTx::const_iterator mi = inputs.find(txin.prevout.hash);
+        if (mi == inputs.end())
+            continue;
+        const CTxIndex& txindex = mi->second.first;
+        if (txindex.pos.IsNull() || txindex.pos == CDiskTxPos(1,1,1))
+            continue;
+        if (!mapDepth.count(txin.prevout.hash))
+            mapDepth[txin.prevout.hash] = txindex.GetDepthInMainChain();
+        int64_t nValueIn = mi->second.second.vout[txin.prevout.n].nValue;
+        dPriority += (double)nValueIn * mapDepth[txin.prevout.hash];
+        nInChainInputValue += nValueIn;
+    }
+    return dPriority / nSize;
+}
+
 int CMerkleTx::SetMerkleBranch(const CBlock* pblock)
 {
     AssertLockHeld(cs_main);
@@ -821,7 +1015,8 @@ int64_t GetMinFee(const CTransaction& tx, unsigned int nBytes, bool fAllowFree,
 
 
 bool AcceptToMemoryPool(CTxMemPool& pool, CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees, bool fFixSpentCoins)
+                        bool* pfMissingInputs, bool fRejectInsaneFee, bool ignoreFees, bool fFixSpentCoins,
+                        int64_t nAcceptTime)
 {
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
@@ -873,6 +1068,9 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CTransaction &tx, bool fLimitFree,
     }
     }
 
+    int64_t nFees;
+    double dPriority = 0;
+    int64_t nInChainInputValue = 0;
     {
         CTxDB txdb("r");
 
@@ -916,9 +1114,11 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CTransaction &tx, bool fLimitFree,
                           error("AcceptToMemoryPool : too many sigops %s, %d > %d",
                                 hash.ToString(), nSigOps, MAX_TX_SIGOPS));
 
-        int64_t nFees = tx.GetValueMapIn(mapInputs)-tx.GetValueOut();
+        nFees = tx.GetValueMapIn(mapInputs)-tx.GetValueOut();
         unsigned int nSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
 
+        dPriority = GetTxPriority(tx, mapInputs, nSize, nInChainInputValue);
+
         // Don't accept it if it can't get into a block
         // but prioritise dstx and don't check fees for it
         if(mapMNengineBroadcastTxes.count(hash)) {
@@ -983,7 +1183,18 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CTransaction &tx, bool fLimitFree,
     }
 
     // Store transaction in memory
-    pool.addUnchecked(hash, tx);
+    if (nAcceptTime == 0)
+        nAcceptTime = GetTime();
+    pool.addUnchecked(hash, CTxMemPoolEntry(tx, nFees, nAcceptTime, dPriority, nBestHeight, nInChainInputValue));
+
+    // Make room, the new transaction may be the one that does not fit
+    int nExpired = pool.Expire(GetTime() - GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+    int nEvicted = pool.TrimToSize(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+    if (nExpired || nEvicted)
+        LogPrint("mempool", "AcceptToMemoryPool : expired %d, evicted %d transactions\n", nExpired, nEvicted);
+    if (!pool.exists(hash))
+        return error("AcceptToMemoryPool : mempool full, fee rate too low %s", hash.ToString());
+
     setValidatedTx.insert(hash);
 
     SyncWithWallets(tx, NULL, true, fFixSpentCoins);
@@ -1367,22 +1578,81 @@ bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock)
 // CBlock and CBlockIndex
 //
 
-static CBlockIndex* pblockindexFBBHLast;
 CBlockIndex* FindBlockByHeight(int nHeight)
 {
-    CBlockIndex *pblockindex;
-    if (nHeight < nBestHeight / 2)
-        pblockindex = pindexGenesisBlock;
-    else
-        pblockindex = pindexBest;
-    if (pblockindexFBBHLast && abs(nHeight - pblockindex->nHeight) > abs(nHeight - pblockindexFBBHLast->nHeight))
-        pblockindex = pblockindexFBBHLast;
-    while (pblockindex->nHeight > nHeight)
-        pblockindex = pblockindex->pprev;
-    while (pblockindex->nHeight < nHeight)
-        pblockindex = pblockindex->pnext;
-    pblockindexFBBHLast = pblockindex;
-    return pblockindex;
+    // SetTip may reallocate the chain vector
+    AssertLockHeld(cs_main);
+    return chainActive[nHeight];
+}
+
+/** Turn the lowest '1' bit in the binary representation of a number into a '0'. */
+static inline int InvertLowestOne(int n) { return n & (n - 1); }
+
+/** Compute what height to jump back to with the CBlockIndex::pskip pointer. */
+static inline int GetSkipHeight(int height)
+{
+    if (height < 2)
+        return 0;
+
+    // Determine which height to jump back to. Any number strictly lower than height is acceptable,
+    // but the following expression seems to perform well in simulations (max 110 steps to go back
+    // up to 2**18 blocks).
+    return (height & 1) ? InvertLowestOne(InvertLowestOne(height - 1)) + 1 : InvertLowestOne(height);
+}
+
+CBlockIndex* CBlockIndex::GetAncestor(int height)
+{
+    if (height > nHeight || height < 0)
+        return NULL;
+
+    CBlockIndex* pindexWalk = this;
+    int heightWalk = nHeight;
+    while (heightWalk > height)
+    {
+        int heightSkip = GetSkipHeight(heightWalk);
+        int heightSkipPrev = GetSkipHeight(heightWalk - 1);
+        if (pindexWalk->pskip != NULL &&
+            (heightSkip == height ||
+             (heightSkip > height && !(heightSkipPrev < heightSkip - 2 &&
+                                       heightSkipPrev >= height))))
+        {
+            // Only follow pskip if pprev->pskip isn't better than pskip->pprev.
+            pindexWalk = pindexWalk->pskip;
+            heightWalk = heightSkip;
+        }
+        else
+        {
+            pindexWalk = pindexWalk->pprev;
+            heightWalk--;
+        }
+    }
+    return pindexWalk;
+}
+
+const CBlockIndex* CBlockIndex::GetAncestor(int height) const
+{
+    return const_cast<CBlockIndex*>(this)->GetAncestor(height);
+}
+
+void CBlockIndex::BuildSkip()
+{
+    if (pprev)
+        pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
+}
+
+void CChain::SetTip(CBlockIndex* pindex)
+{
+    if (pindex == NULL)
+    {
+        vChain.clear();
+        return;
+    }
+    vChain.resize(pindex->nHeight + 1);
+    while (pindex && vChain[pindex->nHeight] != pindex)
+    {
+        vChain[pindex->nHeight] = pindex;
+        pindex = pindex->pprev;
+    }
 }
 
 bool CBlock::ReadFromDisk(const CBlockIndex* pindex, bool fReadTransactions)
@@ -1401,52 +1671,15 @@ bool CBlock::ReadFromDisk(const CBlockIndex* pindex, bool fReadTransactions)
 
 uint256 static GetOrphanRoot(const uint256& hash)
 {
-    map<uint256, COrphanBlock*>::iterator it = mapOrphanBlocks.find(hash);
-    if (it == mapOrphanBlocks.end())
-        return hash;
-
-    // Work back to the first block in the orphan chain
-    do {
-        map<uint256, COrphanBlock*>::iterator it2 = mapOrphanBlocks.find(it->second->hashPrev);
-        if (it2 == mapOrphanBlocks.end())
-            return it->first;
-        it = it2;
-    } while(true);
+    const COrphanBlock* pblockRoot = orphanBlocks.GetRoot(hash);
+    return pblockRoot ? pblockRoot->hashBlock : hash;
 }
 
 // ppcoin: find block wanted by given orphan block
-uint256 WantedByOrphan(const COrphanBlock* pblockOrphan)
+uint256 static WantedByOrphan(const uint256& hash)
 {
-    // Work back to the first block in the orphan chain
-    while (mapOrphanBlocks.count(pblockOrphan->hashPrev))
-        pblockOrphan = mapOrphanBlocks[pblockOrphan->hashPrev];
-    return pblockOrphan->hashPrev;
-}
-
-// Remove a random orphan block (which does not have any dependent orphans).
-void static PruneOrphanBlocks()
-{
-    if (mapOrphanBlocksByPrev.size() <= (size_t)std::max((int64_t)0, GetArg("-maxorphanblocks", DEFAULT_MAX_ORPHAN_BLOCKS)))
-        return;
-
-    // Pick a random orphan block.
-    int pos = insecure_rand() % mapOrphanBlocksByPrev.size();
-    std::multimap<uint256, COrphanBlock*>::iterator it = mapOrphanBlocksByPrev.begin();
-    while (pos--) it++;
-
-    // As long as this block has other orphans depending on it, move to one of those successors.
-    do {
-        std::multimap<uint256, COrphanBlock*>::iterator it2 = mapOrphanBlocksByPrev.find(it->second->hashBlock);
-        if (it2 == mapOrphanBlocksByPrev.end())
-            break;
-        it = it2;
-    } while(1);
-
-    setStakeSeenOrphan.erase(it->second->stake);
-    uint256 hash = it->second->hashBlock;
-    delete it->second;
-    mapOrphanBlocksByPrev.erase(it);
-    mapOrphanBlocks.erase(hash);
+    const COrphanBlock* pblockRoot = orphanBlocks.GetRoot(hash);
+    return pblockRoot ? pblockRoot->hashPrev : hash;
 }
 
 // ppcoin: find last block index up to pindex
@@ -1612,9 +1845,13 @@ bool CTransaction::FetchInputs(CTxDB& txdb, const map<uint256, CTxIndex>& mapTes
         }
         else
         {
-            // Get prev tx from disk
-            if (!txPrev.ReadFromDisk(txindex.pos))
-                return error("FetchInputs() : %s ReadFromDisk prev tx %s failed", GetHash().ToString(),  prevout.hash.ToString());
+            // Get prev tx from the read cache, or from disk
+            if (!txReadCache.Get(prevout.hash, txindex.pos, txPrev))
+            {
+                if (!txPrev.ReadFromDisk(txindex.pos))
+                    return error("FetchInputs() : %s ReadFromDisk prev tx %s failed", GetHash().ToString(),  prevout.hash.ToString());
+                txReadCache.Add(prevout.hash, txindex.pos, txPrev);
+            }
         }
     }
 
@@ -1664,8 +1901,24 @@ int64_t CTransaction::GetValueMapIn(const MapPrevTx& inputs) const
 
 }
 
+bool CScriptCheck::operator()() const
+{
+    const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
+    if (!VerifyScript(scriptSig, scriptPubKey, *ptxTo, nIn, nFlags, nHashType))
+        return error("CScriptCheck() : %s VerifySignature failed", ptxTo->GetHash().ToString());
+    return true;
+}
+
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
+void ThreadScriptCheck()
+{
+    RenameThread("CampusCash-scriptch");
+    scriptcheckqueue.Thread();
+}
+
 bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs, map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-    const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, unsigned int flags, bool fValidateSig)
+    const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, unsigned int flags, bool fValidateSig, std::vector<CScriptCheck> *pvChecks) const
 {
     // Take over previous transactions' spent pointers
     // fBlock is true when this is called from AcceptBlock when a new best-block is added to the blockchain
@@ -1730,7 +1983,9 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs, map<uint256, CTx
                 if (!(fBlock && !IsInitialBlockDownload()))
                 {
                     // Verify signature
-                    if (!VerifySignature(txPrev, *this, i, flags, 0))
+                    if (pvChecks)
+                        pvChecks->push_back(CScriptCheck(txPrev, *this, i, flags, 0));
+                    else if (!VerifySignature(txPrev, *this, i, flags, 0))
                     {
                         if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS) {
                             // Check whether the failure was caused by a
@@ -1783,30 +2038,6 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs, map<uint256, CTx
     return true;
 }
 
-bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
-{
-    // Disconnect in reverse order
-    for (int i = vtx.size()-1; i >= 0; i--)
-        if (!vtx[i].DisconnectInputs(txdb))
-            return false;
-
-    // Update block index on disk without changing it in memory.
-    // The memory index structure will be changed after the db commits.
-    if (pindex->pprev)
-    {
-        CDiskBlockIndex blockindexPrev(pindex->pprev);
-        blockindexPrev.hashNext = 0;
-        if (!txdb.WriteBlockIndex(blockindexPrev))
-            return error("DisconnectBlock() : WriteBlockIndex failed");
-    }
-
-    // ppcoin: clean up wallet after disconnecting coinstake
-    BOOST_FOREACH(CTransaction& tx, vtx)
-        SyncWithWallets(tx, this, false);
-
-    return true;
-}
-
 bool static BuildAddrIndex(const CScript &script, std::vector<uint160>& addrIds)
 {
     CScript::const_iterator pc = script.begin();
@@ -1841,7 +2072,64 @@ bool static BuildAddrIndex(const CScript &script, std::vector<uint160>& addrIds)
     }
 }
 
-bool FindTransactionsByDestination(const CTxDestination &dest, std::vector<uint256> &vtxhash) {
+bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
+{
+    if(GetBoolArg("-addrindex", false))
+    {
+        // Erase the address index records ConnectBlock wrote, while the
+        // inputs can still be fetched
+        for (unsigned int nTxIndex = 0; nTxIndex < vtx.size(); nTxIndex++)
+        {
+            const CTransaction& tx = vtx[nTxIndex];
+            std::vector<uint160> addrIds;
+            if(!tx.IsCoinBase())
+            {
+                MapPrevTx mapInputs;
+                map<uint256, CTxIndex> mapQueuedChangesT;
+                bool fInvalid;
+                if (tx.FetchInputs(txdb, mapQueuedChangesT, true, false, mapInputs, fInvalid))
+                {
+                    for(MapPrevTx::const_iterator mi = mapInputs.begin(); mi != mapInputs.end(); ++mi)
+                        BOOST_FOREACH(const CTxOut &atxout, (*mi).second.second.vout)
+                            BuildAddrIndex(atxout.scriptPubKey, addrIds);
+                }
+                else
+                    LogPrintf("DisconnectBlock(): FetchInputs failed for %s, input addresses stay indexed\n", tx.GetHash().ToString());
+            }
+            BOOST_FOREACH(const CTxOut &atxout, tx.vout)
+                BuildAddrIndex(atxout.scriptPubKey, addrIds);
+
+            BOOST_FOREACH(const uint160& addrId, addrIds)
+            {
+                if(!txdb.EraseAddrIndex(addrId, pindex->nHeight, nTxIndex))
+                    LogPrintf("DisconnectBlock(): EraseAddrIndex failed addrId: %s txhash: %s\n", addrId.ToString().c_str(), tx.GetHash().ToString().c_str());
+            }
+        }
+    }
+
+    // Disconnect in reverse order
+    for (int i = vtx.size()-1; i >= 0; i--)
+        if (!vtx[i].DisconnectInputs(txdb))
+            return false;
+
+    // Update block index on disk without changing it in memory.
+    // The memory index structure will be changed after the db commits.
+    if (pindex->pprev)
+    {
+        CDiskBlockIndex blockindexPrev(pindex->pprev);
+        blockindexPrev.hashNext = 0;
+        if (!txdb.WriteBlockIndex(blockindexPrev))
+            return error("DisconnectBlock() : WriteBlockIndex failed");
+    }
+
+    // ppcoin: clean up wallet after disconnecting coinstake
+    BOOST_FOREACH(CTransaction& tx, vtx)
+        SyncWithWallets(tx, this, false);
+
+    return true;
+}
+
+bool FindTransactionsByDestination(const CTxDestination &dest, std::vector<uint256> &vtxhash, int nSkip, int nCount) {
     uint160 addrid = 0;
     const CKeyID *pkeyid = boost::get<CKeyID>(&dest);
     if (pkeyid)
@@ -1859,7 +2147,7 @@ bool FindTransactionsByDestination(const CTxDestination &dest, std::vector<uint2
 
     LOCK(cs_main);
     CTxDB txdb("r");
-    if(!txdb.ReadAddrIndex(addrid, vtxhash))
+    if(!txdb.ReadAddrIndex(addrid, vtxhash, nSkip, nCount))
     {
         LogPrintf("FindTransactionsByDestination(): txdb.ReadAddrIndex failed\n");
         return false;
@@ -1867,10 +2155,11 @@ bool FindTransactionsByDestination(const CTxDestination &dest, std::vector<uint2
     return true;
 }
 
-void CBlock::RebuildAddressIndex(CTxDB& txdb)
+void CBlock::RebuildAddressIndex(CTxDB& txdb, int nHeight)
 {
-    BOOST_FOREACH(CTransaction& tx, vtx)
+    for (unsigned int nTxIndex = 0; nTxIndex < vtx.size(); nTxIndex++)
     {
+        CTransaction& tx = vtx[nTxIndex];
         uint256 hashTx = tx.GetHash();
         // inputs
         if(!tx.IsCoinBase())
@@ -1891,7 +2180,7 @@ void CBlock::RebuildAddressIndex(CTxDB& txdb)
                     {
                         BOOST_FOREACH(uint160 addrId, addrIds)
                         {
-                            if(!txdb.WriteAddrIndex(addrId, hashTx))
+                            if(!txdb.WriteAddrIndex(addrId, nHeight, nTxIndex, hashTx))
                                 LogPrintf("RebuildAddressIndex(): txins WriteAddrIndex failed addrId: %s txhash: %s\n", addrId.ToString().c_str(), hashTx.ToString().c_str());
                         }
                     }
@@ -1905,7 +2194,7 @@ void CBlock::RebuildAddressIndex(CTxDB& txdb)
             {
                 BOOST_FOREACH(uint160 addrId, addrIds)
                 {
-                    if(!txdb.WriteAddrIndex(addrId, hashTx))
+                    if(!txdb.WriteAddrIndex(addrId, nHeight, nTxIndex, hashTx))
                         LogPrintf("RebuildAddressIndex(): txouts WriteAddrIndex failed addrId: %s txhash: %s\n", addrId.ToString().c_str(), hashTx.ToString().c_str());
                 }
             }
@@ -1915,11 +2204,17 @@ void CBlock::RebuildAddressIndex(CTxDB& txdb)
 
 bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
 {
+    int64_t nTimeStart = GetTimeMicros();
+    uint64_t nTxHashesStart = nTransactionHashesComputed;
+    uint64_t nBlockHashesStart = nBlockHashesComputed;
+
     // Check it again in case a previous version let a bad block in, but skip BlockSig checking
     if (!CheckBlock(!fJustCheck, !fJustCheck, false))
         return false;
 
-    unsigned int flags = SCRIPT_VERIFY_NOCACHE;
+    // SCRIPT_VERIFY_NOCACHE used to share its bit with SCRIPT_VERIFY_P2SH,
+    // which blocks have always been checked with
+    unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_NOCACHE;
 
     //// issue here: it doesn't know the version
     unsigned int nTxPos;
@@ -1942,6 +2237,11 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
     MAX_BLOCK_SIGOPS = MAX_BLOCK_SIZE/50;
     MAX_TX_SIGOPS = MAX_BLOCK_SIGOPS/5;
 
+    // Signature checks are handed to the script check threads while this
+    // thread carries on with the inputs of the next transactions
+    CCheckQueueControl<CScriptCheck> control(nScriptCheckThreads ? &scriptcheckqueue : NULL);
+    unsigned int nChecks = 0;
+
     BOOST_FOREACH(CTransaction& tx, vtx)
     {
         uint256 hashTx = tx.GetHash();
@@ -1981,11 +2281,19 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
                 nStakeReward = nTxValueOut - nTxValueIn;
 
 
-            if (!tx.ConnectInputs(txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, flags))
+            vector<CScriptCheck> vChecks;
+            if (!tx.ConnectInputs(txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, flags, true, nScriptCheckThreads ? &vChecks : NULL))
                 return false;
+            nChecks += vChecks.size();
+            control.Add(vChecks);
         }
 
         mapQueuedChanges[hashTx] = CTxIndex(posThisTx, tx.vout.size());
+
+        // Outputs created by recent blocks are the ones most likely to be
+        // spent next, so seed the read cache while the block is in memory
+        if (!fJustCheck)
+            txReadCache.Add(hashTx, posThisTx, tx);
     }
 
     if (IsProofOfWork())
@@ -2015,6 +2323,13 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
         }
     }
 
+    int64_t nTimeWait = GetTimeMicros();
+    if (!control.Wait())
+        return DoS(100, error("ConnectBlock() : failed scripts"));
+    if (nChecks)
+        LogPrint("bench", "ConnectBlock() : %u script checks on %d threads, %.2fms waiting for them\n",
+            nChecks, nScriptCheckThreads, (GetTimeMicros() - nTimeWait) * 0.001);
+
     // ppcoin: track money supply and mint amount info
     pindex->nMint = nValueOut - nValueIn + nFees;
     pindex->nMoneySupply = (pindex->pprev? pindex->pprev->nMoneySupply : 0) + nValueOut - nValueIn;
@@ -2034,8 +2349,9 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
     if(GetBoolArg("-addrindex", false))
     {
         // Write Address Index
-        BOOST_FOREACH(CTransaction& tx, vtx)
+        for (unsigned int nTxIndex = 0; nTxIndex < vtx.size(); nTxIndex++)
         {
+            CTransaction& tx = vtx[nTxIndex];
             uint256 hashTx = tx.GetHash();
             // inputs
             if(!tx.IsCoinBase())
@@ -2056,7 +2372,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
                         {
                             BOOST_FOREACH(uint160 addrId, addrIds)
                             {
-                                if(!txdb.WriteAddrIndex(addrId, hashTx))
+                                if(!txdb.WriteAddrIndex(addrId, pindex->nHeight, nTxIndex, hashTx))
                                     LogPrintf("ConnectBlock(): txins WriteAddrIndex failed addrId: %s txhash: %s\n", addrId.ToString().c_str(), hashTx.ToString().c_str());
                             }
                         }
@@ -2072,7 +2388,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
                 {
                     BOOST_FOREACH(uint160 addrId, addrIds)
                     {
-                        if(!txdb.WriteAddrIndex(addrId, hashTx))
+                        if(!txdb.WriteAddrIndex(addrId, pindex->nHeight, nTxIndex, hashTx))
                             LogPrintf("ConnectBlock(): txouts WriteAddrIndex failed addrId: %s txhash: %s\n", addrId.ToString().c_str(), hashTx.ToString().c_str());
                     }
                 }
@@ -2094,6 +2410,11 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
     BOOST_FOREACH(CTransaction& tx, vtx)
         SyncWithWallets(tx, this);
 
+    // Counters are process wide, other threads hashing at the same time are included
+    LogPrint("bench", "ConnectBlock() : %u transactions, %u transaction hashes and %u header hashes computed, %.2fms\n",
+        vtx.size(), nTransactionHashesComputed - nTxHashesStart, nBlockHashesComputed - nBlockHashesStart,
+        (GetTimeMicros() - nTimeStart) * 0.001);
+
     return true;
 }
 
@@ -2343,7 +2664,7 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
     // New best block
     hashBestChain = hash;
     pindexBest = pindexNew;
-    pblockindexFBBHLast = NULL;
+    chainActive.SetTip(pindexNew);
     nBestHeight = pindexBest->nHeight;
     nBestChainTrust = pindexNew->nChainTrust;
     nTimeBestReceived = GetTime();
@@ -2411,6 +2732,7 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos, const u
         pindexNew->pprev = (*miPrev).second;
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
     }
+    pindexNew->BuildSkip();
 
     // ppcoin: compute chain trust score
     pindexNew->nChainTrust = (pindexNew->pprev ? pindexNew->pprev->nChainTrust : 0) + pindexNew->GetBlockTrust();
@@ -2790,6 +3112,14 @@ void PushGetBlocks(CNode* pnode, CBlockIndex* pindexBegin, uint256 hashEnd)
     pnode->pindexLastGetBlocksBegin = pindexBegin;
     pnode->hashLastGetBlocksEnd = hashEnd;
 
+    // The reply lists the blocks that follow, which tells roughly where they sit
+    CNodeState *state = State(pnode->GetId());
+    if (state != NULL)
+    {
+        state->nGetBlocksHeight = pindexBegin->nHeight + 1;
+        state->nGetBlocksLeft = MAX_GETBLOCKS_RESULTS;
+    }
+
     pnode->PushMessage("getblocks", CBlockLocator(pindexBegin), hashEnd);
 }
 
@@ -2828,13 +3158,13 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock)
     uint256 hash = pblock->GetHash();
     if (mapBlockIndex.count(hash))
         return error("ProcessBlock() : already have block %d %s", mapBlockIndex[hash]->nHeight, hash.ToString());
-    if (mapOrphanBlocks.count(hash))
+    if (orphanBlocks.Contains(hash))
         return error("ProcessBlock() : already have block (orphan) %s", hash.ToString());
 
     // ppcoin: check proof-of-stake
     // Limited duplicity on stake: prevents block flood attack
     // Duplicate stake allowed only when there is orphan child block
-    if (!fReindex && !fImporting && pblock->IsProofOfStake() && setStakeSeen.count(pblock->GetProofOfStake()) && !mapOrphanBlocksByPrev.count(hash))
+    if (!fReindex && !fImporting && pblock->IsProofOfStake() && setStakeSeen.count(pblock->GetProofOfStake()) && !orphanBlocks.HasChildren(hash))
         return error("ProcessBlock() : duplicate proof-of-stake (%s, %d) for block %s", pblock->GetProofOfStake().first.ToString(), pblock->GetProofOfStake().second, hash.ToString());
 
     if (pblock->hashPrevBlock != hashBestChain)
@@ -2863,7 +3193,7 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock)
     // If we don't already have its previous block, shunt it off to holding area until we get it
     if (!mapBlockIndex.count(pblock->hashPrevBlock))
     {
-        //LogPrintf("ProcessBlock: ORPHAN BLOCK %lu, prev=%s, time=%s\n", (unsigned long)mapOrphanBlocks.size(), pblock->hashPrevBlock.ToString(), DateTimeStrFormat("%x %H:%M:%S", pblock->GetBlockTime()));
+        //LogPrintf("ProcessBlock: ORPHAN BLOCK %lu, prev=%s, time=%s\n", (unsigned long)orphanBlocks.size(), pblock->hashPrevBlock.ToString(), DateTimeStrFormat("%x %H:%M:%S", pblock->GetBlockTime()));
 
         // Accept orphans as long as there is a node to request its parents from
         if (pfrom) {
@@ -2872,30 +3202,25 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock)
             {
                 // Limited duplicity on stake: prevents block flood attack
                 // Duplicate stake allowed only when there is orphan child block
-                if (setStakeSeenOrphan.count(pblock->GetProofOfStake()) && !mapOrphanBlocksByPrev.count(hash))
+                if (orphanBlocks.HasStake(pblock->GetProofOfStake()) && !orphanBlocks.HasChildren(hash))
                     return error("ProcessBlock() : duplicate proof-of-stake (%s, %d) for orphan block %s", pblock->GetProofOfStake().first.ToString(), pblock->GetProofOfStake().second, hash.ToString());
             }
-            PruneOrphanBlocks();
-            COrphanBlock* pblock2 = new COrphanBlock();
-            {
-                CDataStream ss(SER_DISK, CLIENT_VERSION);
-                ss << *pblock;
-                pblock2->vchBlock = std::vector<unsigned char>(ss.begin(), ss.end());
-            }
-            pblock2->hashBlock = hash;
-            pblock2->hashPrev = pblock->hashPrevBlock;
-            pblock2->stake = pblock->GetProofOfStake();
-            mapOrphanBlocks.insert(make_pair(hash, pblock2));
-            mapOrphanBlocksByPrev.insert(make_pair(pblock2->hashPrev, pblock2));
-            if (pblock->IsProofOfStake())
-                setStakeSeenOrphan.insert(pblock->GetProofOfStake());
+            CDataStream ss(SER_DISK, CLIENT_VERSION);
+            ss << *pblock;
+            size_t nMaxOrphanBlocks = (size_t)std::max((int64_t)1, GetArg("-maxorphanblocks", DEFAULT_MAX_ORPHAN_BLOCKS));
+            size_t nMaxOrphanBytes = (size_t)std::max((int64_t)0, GetArg("-maxorphanblocksize", DEFAULT_MAX_ORPHAN_BLOCKS_SIZE)) * 1000000;
+            unsigned int nEvicted = orphanBlocks.Prune(nMaxOrphanBlocks, nMaxOrphanBytes, ss.size());
+            if (nEvicted > 0)
+                LogPrint("net", "ProcessBlock: evicted %u orphan blocks\n", nEvicted);
+            orphanBlocks.Add(hash, pblock->hashPrevBlock, pblock->GetProofOfStake(), pblock->IsProofOfStake(),
+                             std::vector<unsigned char>(ss.begin(), ss.end()));
 
             // Ask this guy to fill in what we're missing
             PushGetBlocks(pfrom, pindexBest, GetOrphanRoot(hash));
             // ppcoin: getblocks may not obtain the ancestor block rejected
             // earlier by duplicate-stake check so we ask for it again directly
             if (!IsInitialBlockDownload())
-                pfrom->AskFor(CInv(MSG_BLOCK, WantedByOrphan(pblock2)));
+                pfrom->AskFor(CInv(MSG_BLOCK, WantedByOrphan(hash)));
         }
         return true;
     }
@@ -2909,24 +3234,20 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock)
     vWorkQueue.push_back(hash);
     for (unsigned int i = 0; i < vWorkQueue.size(); i++)
     {
-        uint256 hashPrev = vWorkQueue[i];
-        for (multimap<uint256, COrphanBlock*>::iterator mi = mapOrphanBlocksByPrev.lower_bound(hashPrev);
-             mi != mapOrphanBlocksByPrev.upper_bound(hashPrev);
-             ++mi)
+        vector<uint256> vChildren;
+        orphanBlocks.GetChildren(vWorkQueue[i], vChildren);
+        BOOST_FOREACH(const uint256& hashChild, vChildren)
         {
             CBlock block;
             {
-                CDataStream ss(mi->second->vchBlock, SER_DISK, CLIENT_VERSION);
+                CDataStream ss(orphanBlocks.Get(hashChild)->vchBlock, SER_DISK, CLIENT_VERSION);
                 ss >> block;
             }
+            orphanBlocks.Remove(hashChild);
             block.BuildMerkleTree();
             if (block.AcceptBlock())
-                vWorkQueue.push_back(mi->second->hashBlock);
-            mapOrphanBlocks.erase(mi->second->hashBlock);
-            setStakeSeenOrphan.erase(block.GetProofOfStake());
-            delete mi->second;
+                vWorkQueue.push_back(hashChild);
         }
-        mapOrphanBlocksByPrev.erase(hashPrev);
     }
 
     return true;
@@ -3051,6 +3372,39 @@ FILE* OpenBlockFile(unsigned int nFile, unsigned int nBlockPos, const char* pszM
     return file;
 }
 
+bool ReadRawBlockFromDisk(CDataStream& ssBlock, const CBlockIndex* pindex)
+{
+    // WriteToDisk stores the message start and the block size right before
+    // nBlockPos, and disk serialization of a block matches the network one.
+    if (pindex->nBlockPos < sizeof(Params().MessageStart()) + sizeof(unsigned int))
+        return error("ReadRawBlockFromDisk() : invalid block position");
+    CAutoFile filein = CAutoFile(OpenBlockFile(pindex->nFile, pindex->nBlockPos - sizeof(Params().MessageStart()) - sizeof(unsigned int), "rb"), SER_DISK, CLIENT_VERSION);
+    if (!filein)
+        return error("ReadRawBlockFromDisk() : OpenBlockFile failed");
+
+    try {
+        MessageStartChars pchMessageStart;
+        unsigned int nSize;
+        filein >> FLATDATA(pchMessageStart) >> nSize;
+        if (memcmp(pchMessageStart, Params().MessageStart(), sizeof(pchMessageStart)) != 0)
+            return error("ReadRawBlockFromDisk() : message start mismatch");
+        if (nSize < 80 || nSize > MAX_SIZE)
+            return error("ReadRawBlockFromDisk() : invalid block size %u", nSize);
+        ssBlock.resize(nSize);
+        filein.read((char*)&ssBlock[0], nSize);
+    }
+    catch (std::exception &e) {
+        return error("%s() : I/O error", __PRETTY_FUNCTION__);
+    }
+
+    // The 80 byte header is all that identifies the block, checking its hash
+    // is much cheaper than deserializing the whole thing
+    if (Hash_bmw512(ssBlock.begin(), ssBlock.begin() + 80) != pindex->GetBlockHash())
+        return error("ReadRawBlockFromDisk() : block hash mismatch at %d", pindex->nHeight);
+
+    return true;
+}
+
 static unsigned int nCurrentBlockFile = 1;
 
 FILE* AppendBlockFile(unsigned int& nFileRet)
@@ -3085,6 +3439,10 @@ bool LoadBlockIndex(bool fAllowNew)
     if (!txdb.LoadBlockIndex())
         return false;
 
+    // Convert an address index written in the old per-address vector format
+    if (!txdb.MigrateAddrIndex())
+        LogPrintf("LoadBlockIndex() : address index migration failed, use -reindexaddr to rebuild it\n");
+
     //
     // Init with genesis block
     //
@@ -3260,6 +3618,7 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
 {
     RenameThread("CampusCash-loadblk");
 
+    {
     CImportingNow imp;
 
     // -loadblock=
@@ -3279,6 +3638,147 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
             RenameOver(pathBootstrap, pathBootstrapOld);
         }
     }
+    } // CImportingNow
+
+    // Reload the transactions saved at the last shutdown, on top of the blocks
+    if (GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
+        LoadMempool();
+    mempool.SetIsLoaded(!ShutdownRequested());
+}
+
+// mempool.dat: version, network magic, number of entries, then each
+// transaction followed by the time it entered the pool
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+
+// Transactions accepted per cs_main hold while loading mempool.dat
+static const unsigned int MEMPOOL_LOAD_BATCH = 100;
+
+bool LoadMempool()
+{
+    int64_t nExpiryTimeout = GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+    filesystem::path pathMempool = GetDataDir() / "mempool.dat";
+    FILE *file = fopen(pathMempool.string().c_str(), "rb");
+    CAutoFile filein = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    if (!filein)
+    {
+        LogPrintf("LoadMempool : no mempool.dat, starting with an empty pool\n");
+        return false;
+    }
+
+    int64_t nStart = GetTimeMillis();
+    int nLoaded = 0, nFailed = 0, nExpired = 0, nPresent = 0;
+    try {
+        uint64_t nVersion;
+        filein >> nVersion;
+        if (nVersion != MEMPOOL_DUMP_VERSION)
+            return error("LoadMempool : unknown mempool.dat version %d", nVersion);
+
+        unsigned char pchMessageStart[4];
+        filein >> FLATDATA(pchMessageStart);
+        if (memcmp(pchMessageStart, Params().MessageStart(), sizeof(pchMessageStart)))
+            return error("LoadMempool : mempool.dat is for a different network");
+
+        uint64_t nRemaining;
+        filein >> nRemaining;
+        while (nRemaining > 0)
+        {
+            // Let the network and RPC threads have cs_main between batches
+            boost::this_thread::interruption_point();
+            if (ShutdownRequested())
+                return false;
+
+            LOCK(cs_main);
+            for (unsigned int i = 0; i < MEMPOOL_LOAD_BATCH && nRemaining > 0; i++, nRemaining--)
+            {
+                CTransaction tx;
+                int64_t nTime;
+                filein >> tx >> nTime;
+
+                if (nTime + nExpiryTimeout <= GetTime())
+                    nExpired++;
+                else if (mempool.exists(tx.GetHash()))
+                    nPresent++;
+                else if (AcceptToMemoryPool(mempool, tx, true, NULL, false, false, false, nTime))
+                    nLoaded++;
+                else
+                    nFailed++;
+            }
+        }
+    }
+    catch (std::exception &e) {
+        return error("LoadMempool : failed to read mempool.dat: %s", e.what());
+    }
+
+    LogPrintf("LoadMempool : %d transactions loaded, %d expired, %d failed, %d already present  %dms\n",
+              nLoaded, nExpired, nFailed, nPresent, GetTimeMillis() - nStart);
+    return true;
+}
+
+bool DumpMempool()
+{
+    int64_t nStart = GetTimeMillis();
+
+    // Copy out so the pool is not held while writing
+    vector<pair<CTransaction, int64_t> > vEntries;
+    {
+        LOCK(mempool.cs);
+        vEntries.reserve(mempool.mapTx.size());
+        for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it)
+            vEntries.push_back(make_pair(it->GetTx(), it->GetTime()));
+    }
+
+    // Write parents before their children, mapTx is in hash order and a
+    // child read back before its parent would be rejected for missing inputs
+    map<uint256, unsigned int> mapPosition;
+    for (unsigned int i = 0; i < vEntries.size(); i++)
+        mapPosition[vEntries[i].first.GetHash()] = i;
+    vector<unsigned int> vParentsLeft(vEntries.size(), 0);
+    vector<vector<unsigned int> > vChildren(vEntries.size());
+    for (unsigned int i = 0; i < vEntries.size(); i++)
+    {
+        set<unsigned int> setParents;
+        BOOST_FOREACH(const CTxIn& txin, vEntries[i].first.vin)
+        {
+            map<uint256, unsigned int>::const_iterator mi = mapPosition.find(txin.prevout.hash);
+            if (mi != mapPosition.end() && setParents.insert(mi->second).second)
+                vChildren[mi->second].push_back(i);
+        }
+        vParentsLeft[i] = setParents.size();
+    }
+    vector<unsigned int> vOrder;
+    vOrder.reserve(vEntries.size());
+    for (unsigned int i = 0; i < vEntries.size(); i++)
+        if (vParentsLeft[i] == 0)
+            vOrder.push_back(i);
+    for (unsigned int n = 0; n < vOrder.size(); n++)
+        BOOST_FOREACH(unsigned int nChild, vChildren[vOrder[n]])
+            if (--vParentsLeft[nChild] == 0)
+                vOrder.push_back(nChild);
+
+    filesystem::path pathTmp = GetDataDir() / "mempool.dat.new";
+    FILE *file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    if (!fileout)
+        return error("DumpMempool : open failed");
+
+    try {
+        fileout << MEMPOOL_DUMP_VERSION;
+        fileout << FLATDATA(Params().MessageStart());
+        fileout << (uint64_t)vOrder.size();
+        BOOST_FOREACH(unsigned int i, vOrder)
+            fileout << vEntries[i].first << vEntries[i].second;
+    }
+    catch (std::exception &e) {
+        return error("DumpMempool : I/O error: %s", e.what());
+    }
+    FileCommit(fileout);
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, GetDataDir() / "mempool.dat"))
+        return error("DumpMempool : rename-into-place failed");
+
+    LogPrintf("DumpMempool : %u transactions written  %dms\n", vOrder.size(), GetTimeMillis() - nStart);
+    return true;
 }
 
 
@@ -3371,7 +3871,7 @@ bool static AlreadyHave(CTxDB& txdb, const CInv& inv)
 
     case MSG_BLOCK:
         return mapBlockIndex.count(inv.hash) ||
-               mapOrphanBlocks.count(inv.hash);
+               orphanBlocks.Contains(inv.hash);
     case MSG_TXLOCK_REQUEST:
         return mapTxLockReq.count(inv.hash) ||
                mapTxLockReqRejected.count(inv.hash);
@@ -3387,6 +3887,65 @@ bool static AlreadyHave(CTxDB& txdb, const CInv& inv)
 }
 
 
+// Recently served blocks and transactions as complete "block" and "tx"
+// messages. A burst of getdata requests for the same object, typically the
+// new tip or a just relayed transaction, is answered by queueing the same
+// buffer for every peer, without touching the block files or serializing
+// and checksumming it again. Guarded by cs_main.
+static std::list<std::pair<CInv, CNetMessageRef> > listServedMessages;
+static std::map<CInv, std::list<std::pair<CInv, CNetMessageRef> >::iterator> mapServedMessages;
+static size_t nServedMessagesBytes = 0;
+
+static CNetMessageRef GetServedMessage(const CInv& inv)
+{
+    AssertLockHeld(cs_main);
+    std::map<CInv, std::list<std::pair<CInv, CNetMessageRef> >::iterator>::iterator mi = mapServedMessages.find(inv);
+    if (mi == mapServedMessages.end())
+        return CNetMessageRef();
+    listServedMessages.splice(listServedMessages.begin(), listServedMessages, mi->second);
+    return mi->second->second;
+}
+
+static void AddServedMessage(const CInv& inv, const CNetMessageRef& msg)
+{
+    AssertLockHeld(cs_main);
+    size_t nMaxBytes = std::max((int64_t)0, GetArg("-rawblockcache", DEFAULT_RAW_BLOCK_CACHE_SIZE)) * 1048576;
+    if (msg->size() > nMaxBytes || mapServedMessages.count(inv))
+        return;
+    listServedMessages.push_front(std::make_pair(inv, msg));
+    mapServedMessages[inv] = listServedMessages.begin();
+    nServedMessagesBytes += msg->size();
+    while (nServedMessagesBytes > nMaxBytes)
+    {
+        nServedMessagesBytes -= listServedMessages.back().second->size();
+        mapServedMessages.erase(listServedMessages.back().first);
+        listServedMessages.pop_back();
+    }
+}
+
+// The "block" message for a block, from the cache or built from the stored bytes
+static CNetMessageRef GetBlockMessage(const CBlockIndex* pindex)
+{
+    CInv inv(MSG_BLOCK, pindex->GetBlockHash());
+    CNetMessageRef msg = GetServedMessage(inv);
+    if (msg)
+        return msg;
+
+    // Serve the stored bytes as they are, the block was fully validated
+    // before it was written
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    if (ReadRawBlockFromDisk(ssBlock, pindex))
+        msg = MakeNetMessage("block", ssBlock);
+    else
+    {
+        CBlock block;
+        block.ReadFromDisk(pindex);
+        msg = MakeNetMessage("block", block);
+    }
+    AddServedMessage(inv, msg);
+    return msg;
+}
+
 void static ProcessGetData(CNode* pfrom)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
@@ -3411,9 +3970,7 @@ void static ProcessGetData(CNode* pfrom)
                 map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(inv.hash);
                 if (mi != mapBlockIndex.end())
                 {
-                    CBlock block;
-                    block.ReadFromDisk((*mi).second);
-                    pfrom->PushMessage("block", block);
+                    pfrom->PushMessage(GetBlockMessage((*mi).second));
 
                     // Trigger them to send a getblocks request for the next batch of inventory
                     if (inv.hash == pfrom->hashContinue)
@@ -3427,6 +3984,8 @@ void static ProcessGetData(CNode* pfrom)
                         pfrom->hashContinue = 0;
                     }
                 }
+                else
+                    vNotFound.push_back(inv);
             }
             else if (inv.IsKnownType())
             {
@@ -3442,14 +4001,15 @@ void static ProcessGetData(CNode* pfrom)
                         pushed = true;
                     }
                 }*/
-                if (!pushed && inv.type == MSG_TX) {
-
+                if (!pushed && inv.type == MSG_TX && mempool.exists(inv.hash)) {
+                    CNetMessageRef msg = GetServedMessage(inv);
                     CTransaction tx;
-                    if (mempool.lookup(inv.hash, tx)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << tx;
-                        pfrom->PushMessage("tx", ss);
+                    if (!msg && mempool.lookup(inv.hash, tx)) {
+                        msg = MakeNetMessage("tx", tx);
+                        AddServedMessage(inv, msg);
+                    }
+                    if (msg) {
+                        pfrom->PushMessage(msg);
                         pushed = true;
                     }
                 }
@@ -3530,6 +4090,163 @@ void static ProcessGetData(CNode* pfrom)
     }
 }
 
+// Requires cs_main. Whether a block is queued, in flight, buffered or known by its header.
+bool static IsBlockExpected(const uint256& hash)
+{
+    return blocksToDownload.Contains(hash) || mapBlocksInFlight.count(hash) || blocksBuffered.Contains(hash) ||
+           headerChain.Contains(hash);
+}
+
+// Requires cs_main.
+void static ProcessDownloadedBlock(CNode* pfrom, NodeId nodeFrom, CBlock& block)
+{
+    uint256 hashBlock = block.GetHash();
+    ProcessBlock(pfrom, &block);
+    if (block.nDoS) Misbehaving(nodeFrom, block.nDoS);
+    headerChain.Prune(nBestHeight);
+
+    // Orphans may have been waiting for transactions this block confirmed
+    if (!mapOrphanTransactions.empty() && mapBlockIndex.count(hashBlock) && mapBlockIndex[hashBlock]->IsInMainChain())
+    {
+        vector<uint256> vWorkQueue;
+        BOOST_FOREACH(const CTransaction& txBlock, block.vtx)
+            vWorkQueue.push_back(txBlock.GetHash());
+        ProcessOrphanTxs(vWorkQueue);
+    }
+    if (fSecMsgEnabled) {
+        SecureMsgScanBlock(block);
+    }
+}
+
+// Requires cs_main. Process a buffered block as coming from the peer that
+// sent it. A block whose parent is still missing goes to the orphan pool,
+// with that peer asked for the parents; if it has gone there is no one to
+// ask and the block is dropped.
+void static ProcessBufferedBlock(CBufferedBlock& buffered)
+{
+    CNode* pnodeFrom = NULL;
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+        {
+            if (pnode->GetId() == buffered.nodeFrom && !pnode->fDisconnect)
+            {
+                pnodeFrom = pnode;
+                pnodeFrom->AddRef();
+                break;
+            }
+        }
+    }
+    if (pnodeFrom == NULL && !mapBlockIndex.count(buffered.block.hashPrevBlock))
+        LogPrint("net", "dropping buffered block %s, its peer has gone\n", buffered.hashBlock.ToString());
+    ProcessDownloadedBlock(pnodeFrom, buffered.nodeFrom, buffered.block);
+    if (pnodeFrom)
+        pnodeFrom->Release();
+}
+
+// Requires cs_main. Hold a block until its parent is accepted. The buffer
+// stays within the download window unless parents go missing, and then the
+// blocks held longest move on to the orphan pool.
+void static BufferBlock(CNode* pfrom, const CBlock& block)
+{
+    CBufferedBlock buffered;
+    while (blocksBuffered.size() >= (size_t)BLOCK_DOWNLOAD_WINDOW && blocksBuffered.TakeOldest(buffered))
+        ProcessBufferedBlock(buffered);
+    blocksBuffered.Add(block, pfrom->GetId());
+}
+
+// Requires cs_main. Process the buffered blocks that were waiting for
+// hashParent, and the ones waiting for them in turn.
+void static ProcessBufferedBlocks(uint256 hashParent)
+{
+    CBufferedBlock buffered;
+    while (mapBlockIndex.count(hashParent) && blocksBuffered.TakeChildOf(hashParent, buffered))
+    {
+        hashParent = buffered.hashBlock;
+        ProcessBufferedBlock(buffered);
+    }
+}
+
+// Requires cs_main. Ask a peer for the headers that follow hashFrom, a block
+// of our chain or one it sent the header of.
+void static PushGetHeaders(CNode* pnode, CNodeState* state, const uint256& hashFrom)
+{
+    CBlockLocator locator(pindexBest);
+    if (hashFrom != hashBestChain)
+        locator.PushFront(hashFrom);
+    state->nGetHeadersTime = GetTimeMicros();
+    pnode->PushMessage("getheaders", locator, uint256(0));
+}
+
+// The work a header adds to the header chain. Proof-of-work can be checked
+// from the header alone, so a header meeting its own target at a height that
+// may be mined is credited with it. Proof-of-stake cannot, so any other
+// header counts as a block at the lowest difficulty.
+uint256 static GetHeaderWork(const CBlock& header, int nHeight)
+{
+    CBigNum bnLimit = std::max(Params().ProofOfWorkLimit(), Params().ProofOfStakeLimit());
+    CBigNum bnTarget;
+    bnTarget.SetCompact(header.nBits);
+    if (nHeight > Params().EndPoWBlock_v2() || bnTarget <= 0 || bnTarget > bnLimit ||
+        header.GetHash() > bnTarget.getuint256())
+        bnTarget = bnLimit;
+
+    return ((CBigNum(1)<<256) / (bnTarget+1)).getuint256();
+}
+
+// Requires cs_main. Check a header as far as it can be without its block and
+// add it to the header chain, setting nHeightRet. Proof-of-stake needs the
+// coinstake, so that and everything else is left to ProcessBlock.
+bool static AcceptHeader(const CBlock& header, NodeId nodeFrom, int& nHeightRet)
+{
+    uint256 hash = header.GetHash();
+    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+    if (mi != mapBlockIndex.end())
+    {
+        nHeightRet = mi->second->nHeight;
+        return true;
+    }
+
+    int nPrevHeight = -1;
+    int64_t nPrevTime = 0;
+    uint256 nPrevChainWork = 0;
+    mi = mapBlockIndex.find(header.hashPrevBlock);
+    if (mi != mapBlockIndex.end())
+    {
+        nPrevHeight = mi->second->nHeight;
+        nPrevTime = mi->second->GetBlockTime();
+        nPrevChainWork = mi->second->nChainTrust;
+    }
+    else if (const CHeaderIndex* pprev = headerChain.Get(header.hashPrevBlock))
+    {
+        nPrevHeight = pprev->nHeight;
+        nPrevTime = pprev->nTime;
+    }
+    else
+        return error("AcceptHeader() : header %s does not connect", hash.ToString());
+
+    if (!Checkpoints::CheckHardened(nPrevHeight + 1, hash))
+    {
+        Misbehaving(nodeFrom, 100);
+        return error("AcceptHeader() : rejected by hardened checkpoint lock-in at %d", nPrevHeight + 1);
+    }
+    CBigNum bnTarget;
+    bnTarget.SetCompact(header.nBits);
+    if (bnTarget <= 0 || bnTarget > std::max(Params().ProofOfWorkLimit(), Params().ProofOfStakeLimit()))
+    {
+        Misbehaving(nodeFrom, 50);
+        return error("AcceptHeader() : nBits below minimum difficulty");
+    }
+    if (header.GetBlockTime() > FutureDrift(GetAdjustedTime()))
+        return error("AcceptHeader() : header timestamp too far in the future");
+    if (FutureDrift(header.GetBlockTime()) < nPrevTime)
+        return error("AcceptHeader() : header timestamp too early");
+
+    nHeightRet = headerChain.Add(hash, header.hashPrevBlock, header.nTime, GetHeaderWork(header, nPrevHeight + 1),
+                                 nodeFrom, nPrevHeight, nPrevChainWork)->nHeight;
+    return true;
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
 {
     // this is a snapshot node. will only sync until certain block
@@ -3759,6 +4476,18 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         LOCK(cs_main);
         CTxDB txdb("r");
 
+        // Only a getblocks reply lists many blocks, in chain order from the
+        // height asked for. During initial download that lets any peer that
+        // is far enough ahead be asked for them.
+        CNodeState *state = State(pfrom->GetId());
+        int nBlockInvs = 0;
+        BOOST_FOREACH(const CInv& inv, vInv)
+            if (inv.type == MSG_BLOCK)
+                nBlockInvs++;
+        bool fReply = (nBlockInvs > 1 && state->nGetBlocksHeight >= 0);
+        bool fGetBlocksReply = (fReply && IsInitialBlockDownload());
+        int nHeight = state->nGetBlocksHeight;
+
         for (unsigned int nInv = 0; nInv < vInv.size(); nInv++)
         {
             const CInv &inv = vInv[nInv];
@@ -3766,23 +4495,72 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
             boost::this_thread::interruption_point();
             pfrom->AddInventoryKnown(inv);
 
+            int nBlockHeight = -1;
+            if (inv.type == MSG_BLOCK && fGetBlocksReply)
+            {
+                nBlockHeight = nHeight++;
+                state->hashLastAnnounced = inv.hash;
+                state->nLastAnnouncedHeight = nBlockHeight;
+            }
+
             bool fAlreadyHave = AlreadyHave(txdb, inv);
             LogPrint("net", "  got inventory: %s  %s\n", inv.ToString(), fAlreadyHave ? "have" : "new");
 
             if (!fAlreadyHave) {
                 if (!fImporting && !fReindex) {
                     if (inv.type == MSG_BLOCK)
-                        AddBlockToQueue(pfrom->GetId(), inv.hash);
+                        AddBlockToQueue(pfrom->GetId(), inv.hash, nBlockHeight);
                     else
                         pfrom->AskFor(inv);
                 }
-            } else if (inv.type == MSG_BLOCK && mapOrphanBlocks.count(inv.hash)) {
+            } else if (inv.type == MSG_BLOCK && orphanBlocks.Contains(inv.hash) && !fGetBlocksReply) {
                 PushGetBlocks(pfrom, pindexBest, GetOrphanRoot(inv.hash));
             }
 
             // Track requests for our stuff
             g_signals.Inventory(inv.hash);
         }
+        // The reply comes in invs of up to 1000 entries, see SendMessages.
+        // It is complete after a shorter one or once it listed as many
+        // blocks as a reply can hold; other invs are not part of it.
+        if (fReply)
+        {
+            state->nGetBlocksLeft -= nBlockInvs;
+            if (vInv.size() < 1000 || state->nGetBlocksLeft <= 0)
+                state->nGetBlocksHeight = -1;
+            else
+                state->nGetBlocksHeight += nBlockInvs;
+        }
+    }
+
+
+    else if (strCommand == "notfound")
+    {
+        vector<CInv> vInv;
+        vRecv >> vInv;
+        if (vInv.size() > MAX_INV_SZ)
+        {
+            Misbehaving(pfrom->GetId(), 20);
+            return error("message notfound size() = %u", vInv.size());
+        }
+
+        // A peer that does not have a block we asked for is behind: ask
+        // someone else, and do not ask it for blocks that high again
+        LOCK(cs_main);
+        CNodeState *state = State(pfrom->GetId());
+        BOOST_FOREACH(const CInv& inv, vInv)
+        {
+            if (inv.type != MSG_BLOCK)
+                continue;
+            map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(inv.hash);
+            if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != pfrom->GetId())
+                continue;
+            int nHeight = itInFlight->second.second->nHeight;
+            if (nHeight >= 0)
+                state->nMaxDownloadHeight = std::min(state->nMaxDownloadHeight, nHeight - 1);
+            LogPrint("net", "Peer %s does not have block %s\n", state->name, inv.hash.ToString());
+            ReassignBlock(inv.hash);
+        }
     }
 
 
@@ -3821,7 +4599,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         // Send the rest of the chain
         if (pindex)
             pindex = pindex->pnext;
-        int nLimit = 5000;
+        int nLimit = MAX_GETBLOCKS_RESULTS;
         LogPrint("net", "getblocks %d to %s limit %d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), nLimit);
         for (; pindex; pindex = pindex->pnext)
         {
@@ -3871,7 +4649,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         }
 
         vector<CBlock> vHeaders;
-        int nLimit = 2000;
+        int nLimit = MAX_HEADERS_RESULTS;
         LogPrint("net", "getheaders %d to %s\n", (pindex ? pindex->nHeight : -1), hashStop.ToString());
         for (; pindex; pindex = pindex->pnext)
         {
@@ -3883,10 +4661,74 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
     }
 
 
+    else if (strCommand == "headers" && !fImporting && !fReindex)
+    {
+        vector<CBlock> vHeaders;
+        vRecv >> vHeaders;
+        if (vHeaders.size() > MAX_HEADERS_RESULTS)
+        {
+            Misbehaving(pfrom->GetId(), 20);
+            return error("message headers size() = %u", vHeaders.size());
+        }
+
+        LOCK(cs_main);
+        CNodeState *state = State(pfrom->GetId());
+        if (state->nGetHeadersTime == 0)
+        {
+            LogPrint("net", "ignoring unsolicited headers from %s\n", state->name);
+            return true;
+        }
+        state->nGetHeadersTime = 0;
+
+        // Queue the blocks in chain order with their height known, so that
+        // any peer that far ahead can be asked for them
+        CTxDB txdb("r");
+        unsigned int nAccepted = 0;
+        BOOST_FOREACH(const CBlock& header, vHeaders)
+        {
+            if (headerChain.CountFrom(pfrom->GetId()) >= MAX_HEADERS_PER_PEER)
+            {
+                LogPrint("net", "peer %s has %u headers pending, ignoring the rest\n", state->name, MAX_HEADERS_PER_PEER);
+                break;
+            }
+            int nHeight;
+            if (!AcceptHeader(header, pfrom->GetId(), nHeight))
+                break;
+            nAccepted++;
+            CInv inv(MSG_BLOCK, header.GetHash());
+            pfrom->AddInventoryKnown(inv);
+            if (!AlreadyHave(txdb, inv))
+                AddBlockToQueue(pfrom->GetId(), inv.hash, nHeight);
+        }
+        LogPrint("net", "received %u headers from %s, %u accepted, best header %d\n",
+                 vHeaders.size(), state->name, nAccepted, headerChain.GetBestHeight());
+
+        // Branches that fell a whole reply behind the best one lost to it;
+        // their blocks are not worth fetching
+        vector<uint256> vPruned;
+        headerChain.PruneForks(MAX_HEADERS_RESULTS, vPruned);
+        BOOST_FOREACH(const uint256& hash, vPruned)
+        {
+            NodeId nodeQueued;
+            if (blocksToDownload.Remove(hash, nodeQueued))
+            {
+                CNodeState *stateQueued = State(nodeQueued);
+                if (stateQueued != NULL)
+                    stateQueued->nBlocksToDownload--;
+            }
+        }
+        if (!vPruned.empty())
+            LogPrint("net", "pruned %u headers of side branches\n", vPruned.size());
+
+        // A full reply means there are more to ask for
+        if (nAccepted == MAX_HEADERS_RESULTS)
+            state->hashMoreHeaders = vHeaders.back().GetHash();
+    }
+
+
     else if (strCommand == "tx"|| strCommand == "dstx")
     {
         vector<uint256> vWorkQueue;
-        vector<uint256> vEraseQueue;
         CTransaction tx;
 
         //masternode signed transaction
@@ -3962,45 +4804,16 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
             vWorkQueue.push_back(inv.hash);
 
             // Recursively process any orphan transactions that depended on this one
-            for (unsigned int i = 0; i < vWorkQueue.size(); i++)
-            {
-                map<uint256, set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
-                if (itByPrev == mapOrphanTransactionsByPrev.end())
-                    continue;
-                for (set<uint256>::iterator mi = itByPrev->second.begin();
-                     mi != itByPrev->second.end();
-                     ++mi)
-                {
-                    const uint256& orphanTxHash = *mi;
-                    CTransaction& orphanTx = mapOrphanTransactions[orphanTxHash];
-                    bool fMissingInputs2 = false;
-
-                    if (AcceptToMemoryPool(mempool, orphanTx, true, &fMissingInputs2))
-                    {
-                        LogPrint("mempool", "   accepted orphan tx %s\n", orphanTxHash.ToString());
-                        RelayTransaction(orphanTx, orphanTxHash);
-                        vWorkQueue.push_back(orphanTxHash);
-                        vEraseQueue.push_back(orphanTxHash);
-                    }
-                    else if (!fMissingInputs2)
-                    {
-                        // Has inputs but not accepted to mempool
-                        // Probably non-standard or insufficient fee/priority
-                        vEraseQueue.push_back(orphanTxHash);
-                        LogPrint("mempool", "   removed orphan tx %s\n", orphanTxHash.ToString());
-                    }
-                }
-            }
-
-            BOOST_FOREACH(uint256 hash, vEraseQueue)
-                EraseOrphanTx(hash);
+            ProcessOrphanTxs(vWorkQueue);
         }
         else if (fMissingInputs)
         {
-            AddOrphanTx(tx);
+            AddOrphanTx(tx, pfrom->GetId());
 
             // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-            unsigned int nEvicted = LimitOrphanTxSize(MAX_ORPHAN_TRANSACTIONS);
+            unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+            uint64_t nMaxOrphanBytes = (uint64_t)std::max((int64_t)0, GetArg("-maxorphantxsize", DEFAULT_MAX_ORPHAN_TX_SIZE)) * 1000000;
+            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx, nMaxOrphanBytes);
             if (nEvicted > 0)
                 LogPrint("mempool", "mapOrphan overflow, removed %u tx\n", nEvicted);
         }
@@ -4024,14 +4837,28 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         pfrom->AddInventoryKnown(inv);
 
         LOCK(cs_main);
+        if (blocksBuffered.Contains(hashBlock))
+            return true;
+
         // Remember who we got this block from.
         mapBlockSource[inv.hash] = pfrom->GetId();
+        map<uint256, pair<NodeId, list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hashBlock);
+        bool fScheduled = (itInFlight != mapBlocksInFlight.end() && itInFlight->second.second->nHeight >= 0);
         MarkBlockAsReceived(inv.hash, pfrom->GetId());
 
-        ProcessBlock(pfrom, &block);
-        if (block.nDoS) Misbehaving(pfrom->GetId(), block.nDoS);
-        if (fSecMsgEnabled) {
-            SecureMsgScanBlock(block);
+        // A block of the initial download that overtook its parent waits for
+        // it here. The orphan pool would also ask for the parent again,
+        // although it is already on its way.
+        if (fScheduled && !mapBlockIndex.count(block.hashPrevBlock) && !blocksBuffered.HasChildOf(block.hashPrevBlock) &&
+            IsBlockExpected(block.hashPrevBlock))
+        {
+            BufferBlock(pfrom, block);
+        }
+        else
+        {
+            ProcessDownloadedBlock(pfrom, pfrom->GetId(), block);
+            ProcessBufferedBlocks(hashBlock);
+            ProcessBufferedBlocks(hashBestChain);
         }
     }
 
@@ -4242,6 +5069,24 @@ boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char
     return GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, pos.nFile);
 }
 
+// With several message handler threads, messages for different peers are
+// processed at the same time. These handlers only share state under
+// cs_main; the rest, the masternode, InstantX and secure messaging ones
+// among them, still run one at a time as they did on a single thread.
+// The InstantX, spork and mixing pool state is written by those handlers
+// without cs_main, so everything that reads it stays serial as well:
+// "inv" and "getdata" (AlreadyHave, ProcessGetData), "block" (CheckBlock
+// and AcceptToMemoryPool read mapLockedInputs, ProcessBlock starts a new
+// mixing round) and the getdata requests of SendMessages.
+// Always taken before cs_main.
+static CCriticalSection cs_serialMessages;
+
+static bool IsParallelMessage(const string& strCommand)
+{
+    return strCommand == "getblocks" || strCommand == "getheaders" || strCommand == "headers" ||
+           strCommand == "notfound" || strCommand == "mempool" || strCommand == "ping" || strCommand == "pong";
+}
+
 // requires LOCK(cs_vRecvMsg)
 bool ProcessMessages(CNode* pfrom)
 {
@@ -4259,7 +5104,10 @@ bool ProcessMessages(CNode* pfrom)
     bool fOk = true;
 
     if (!pfrom->vRecvGetData.empty())
+    {
+        LOCK(cs_serialMessages);
         ProcessGetData(pfrom);
+    }
 
     // this maintains the order of responses
     if (!pfrom->vRecvGetData.empty()) return fOk;
@@ -4320,7 +5168,13 @@ bool ProcessMessages(CNode* pfrom)
         bool fRet = false;
         try
         {
-            fRet = ProcessMessage(pfrom, strCommand, vRecv);
+            if (IsParallelMessage(strCommand))
+                fRet = ProcessMessage(pfrom, strCommand, vRecv);
+            else
+            {
+                LOCK(cs_serialMessages);
+                fRet = ProcessMessage(pfrom, strCommand, vRecv);
+            }
             boost::this_thread::interruption_point();
         }
         catch (std::ios_base::failure& e)
@@ -4365,6 +5219,8 @@ bool ProcessMessages(CNode* pfrom)
 
 bool SendMessages(CNode* pto, bool fSendTrickle)
 {
+    // Only tried: a serial handler holding it may be waiting for our cs_vSend
+    TRY_LOCK(cs_serialMessages, lockSerial);
     TRY_LOCK(cs_main, lockMain);
     if (lockMain) {
         // Don't send anything until we get their version message
@@ -4407,7 +5263,11 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         // Start block sync
         if (pto->fStartSync && !fImporting && !fReindex) {
             pto->fStartSync = false;
-            PushGetBlocks(pto, pindexBest, uint256(0));
+            if (GetBoolArg("-headersfirst", DEFAULT_HEADERS_FIRST) && IsInitialBlockDownload())
+                PushGetHeaders(pto, State(pto->GetId()),
+                               headerChain.Contains(headerChain.GetBestHash()) ? headerChain.GetBestHash() : hashBestChain);
+            else
+                PushGetBlocks(pto, pindexBest, uint256(0));
         }
 
         // Resend wallet transactions that haven't gotten in a block yet
@@ -4544,27 +5404,68 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         }
 
 
+        // Take requests back from a peer that has not delivered a block for a
+        // while, oldest first, so that it does not hold up the download window
+        while (!pto->fDisconnect && state.nBlocksInFlight) {
+            const QueuedBlock &entry = state.vBlocksInFlight.front();
+            if (entry.nHeight < 0 || nNow - std::max(entry.nTime, state.nLastBlockReceive) < BLOCK_STALLING_TIMEOUT*1000000)
+                break;
+            LogPrint("net", "Peer %s is slow to send block %s, asking others\n", state.name, entry.hash.ToString());
+            state.fStalling = true;
+            ReassignBlock(uint256(entry.hash));
+        }
+
+        // Headers-first sync: ask for more headers once the blocks are within
+        // MAX_HEADERS_AHEAD of the best one, and go back to getblocks with a
+        // peer that does not answer getheaders, as peers in initial download
+        // do not
+        if (!pto->fDisconnect && state.hashMoreHeaders != 0 && headerChain.GetBestHeight() < nBestHeight + MAX_HEADERS_AHEAD)
+        {
+            PushGetHeaders(pto, &state, state.hashMoreHeaders);
+            state.hashMoreHeaders = 0;
+        }
+        if (!pto->fDisconnect && state.nGetHeadersTime && nNow - state.nGetHeadersTime > BLOCK_DOWNLOAD_TIMEOUT*1000000)
+        {
+            LogPrint("net", "Peer %s did not answer getheaders, syncing with getblocks\n", state.name);
+            state.nGetHeadersTime = 0;
+            PushGetBlocks(pto, pindexBest, uint256(0));
+        }
+
+        // During initial download, ask for what follows the last block this
+        // peer announced before the window reaches it, so the queue does not
+        // run dry between getblocks replies
+        if (!pto->fDisconnect && state.nLastAnnouncedHeight >= 0 && state.hashGetBlocksAfter != state.hashLastAnnounced &&
+            state.nLastAnnouncedHeight < pto->nStartingHeight && state.nLastAnnouncedHeight < nBestHeight + BLOCK_DOWNLOAD_WINDOW &&
+            IsInitialBlockDownload())
+        {
+            state.hashGetBlocksAfter = state.hashLastAnnounced;
+            state.nGetBlocksHeight = state.nLastAnnouncedHeight + 1;
+            state.nGetBlocksLeft = MAX_GETBLOCKS_RESULTS;
+            CBlockLocator locator(pindexBest);
+            locator.PushFront(state.hashLastAnnounced);
+            pto->PushMessage("getblocks", locator, uint256(0));
+        }
+
         //
         // Message: getdata (blocks)
         //
         vector<CInv> vGetData;
         CTxDB txdb("r");
-        while (!pto->fDisconnect && state.nBlocksToDownload && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
-            uint256 hash = state.vBlocksToDownload.front();
-            vGetData.push_back(CInv(MSG_BLOCK, hash));
-            MarkBlockAsInFlight(pto->GetId(), hash);
-            LogPrint("net", "Requesting block %s from %s\n", hash.ToString().c_str(), state.name.c_str());
-            if (vGetData.size() >= 1000)
-            {
-                pto->PushMessage("getdata", vGetData);
-                vGetData.clear();
+        if (!pto->fDisconnect && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+            vector<CBlockToDownload> vToDownload;
+            FindNextBlocksToDownload(pto, state, MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload);
+            BOOST_FOREACH(const CBlockToDownload& entry, vToDownload) {
+                vGetData.push_back(CInv(MSG_BLOCK, entry.hash));
+                MarkBlockAsInFlight(pto->GetId(), entry.hash, entry.nHeight);
+                LogPrint("net", "Requesting block %s from %s\n", entry.hash.ToString().c_str(), state.name.c_str());
             }
         }
 
         //
-        // Message: getdata (non-blocks)
+        // Message: getdata (non-blocks), left for the next pass while a
+        // serial handler may be writing the maps AlreadyHave reads
         //
-        while (!pto->fDisconnect && !pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow)
+        while (lockSerial && !pto->fDisconnect && !pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow)
         {
             const CInv& inv = (*pto->mapAskFor.begin()).second;
             if (!AlreadyHave(txdb, inv))
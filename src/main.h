@@ -8,7 +8,6 @@
 #include "chain.h"
 #include "bignum.h"
 #include "sync.h"
-#include "txmempool.h"
 #include "net.h"
 #include "script.h"
 #include "scrypt.h"
@@ -18,6 +17,7 @@
 #include "genesis.h"
 #include "mining.h"
 
+#include <atomic>
 #include <list>
 
 class CValidationState;
@@ -27,6 +27,7 @@ class CInv;
 class CKeyItem;
 class CNode;
 class CReserveKey;
+class CTxMemPool;
 class CWallet;
 
 /** The maximum allowed multiple for the computed block size */
@@ -49,10 +50,40 @@ static unsigned int MAX_BLOCK_SIGOPS = MAX_BLOCK_SIZE/50;
 static const unsigned int MAX_P2SH_SIGOPS = 15;
 /** The maximum number of sigops we're willing to relay/mine in a single tx */
 static unsigned int MAX_TX_SIGOPS = MAX_BLOCK_SIGOPS/5;
-/** The maximum number of orphan transactions kept in memory */
-static const unsigned int MAX_ORPHAN_TRANSACTIONS = MAX_BLOCK_SIZE/100;
+/** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
+static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = MAX_BLOCK_SIZE/100;
+/** Default for -maxorphantxsize, maximum megabytes of orphan transactions kept in memory */
+static const unsigned int DEFAULT_MAX_ORPHAN_TX_SIZE = 10;
+/** Larger orphan transactions are not kept */
+static const unsigned int MAX_ORPHAN_TX_SIZE = 5000;
+/** Seconds an orphan transaction is kept waiting for its inputs */
+static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+/** Minimum seconds between two sweeps for expired orphan transactions */
+static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+/** Default for -rawblockcache, megabytes of recently served block and transaction messages kept in memory */
+static const unsigned int DEFAULT_RAW_BLOCK_CACHE_SIZE = 16;
 /** Default for -maxorphanblocks, maximum number of orphan blocks kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_BLOCKS = 10000;
+/** Default for -maxorphanblocksize, maximum megabytes of orphan blocks kept in memory */
+static const unsigned int DEFAULT_MAX_ORPHAN_BLOCKS_SIZE = 100;
+/** Default for -headersfirst, fetch the headers of the chain before its blocks during initial sync */
+static const bool DEFAULT_HEADERS_FIRST = false;
+/** Default for -maxmempool, maximum megabytes of memory the transaction memory pool may use */
+static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
+/** Default for -mempoolexpiry, hours a transaction may stay in the memory pool */
+static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
+/** Default for -persistmempool, save the memory pool on shutdown and reload it on startup */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -stakethreads, number of threads searching for a stake kernel */
+static const int DEFAULT_STAKE_THREADS = 1;
+/** Maximum for -stakethreads */
+static const int MAX_STAKE_THREADS = 16;
+/** Default for -par, number of script verification threads (0 = one per core) */
+static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum for -par */
+static const int MAX_SCRIPTCHECK_THREADS = 16;
+/** Default for -genproclimit, number of proof-of-work mining threads (-1 = one per core) */
+static const int DEFAULT_GENERATE_THREADS = -1;
 /** Fees smaller than this (in satoshi) are considered zero fee (for transaction creation) */
 static const int64_t MIN_TX_FEE = 0.0001*COIN;
 /** Fees smaller than this (in satoshi) are considered zero fee (for relaying) */
@@ -71,6 +102,20 @@ static const unsigned int LOCKTIME_THRESHOLD = 500000000; // Tue Nov  5 00:53:20
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 128;
 /** Timeout in seconds before considering a block download peer unresponsive. */
 static const unsigned int BLOCK_DOWNLOAD_TIMEOUT = 60;
+/** Number of blocks past the tip that initial download may request, from any peer, ahead of the first missing one. */
+static const int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Seconds a peer may go without delivering a requested block before its requests are given to other peers. */
+static const int BLOCK_STALLING_TIMEOUT = 10;
+/** Maximum number of blocks a getblocks reply lists. */
+static const int MAX_GETBLOCKS_RESULTS = 5000;
+/** Maximum number of headers in a headers message. */
+static const unsigned int MAX_HEADERS_RESULTS = 2000;
+/** Number of headers past the tip that headers-first sync fetches before waiting for the blocks to catch up. */
+static const int MAX_HEADERS_AHEAD = 20000;
+/** Maximum number of headers of blocks we do not have yet that one peer may have sent. */
+static const unsigned int MAX_HEADERS_PER_PEER = MAX_HEADERS_AHEAD + MAX_HEADERS_RESULTS;
+/** Number of queued blocks a peer may have announced before it is penalized for each one more. */
+static const int MAX_BLOCKS_TO_DOWNLOAD = MAX_HEADERS_PER_PEER;
 /** Maximum block reorganize depth (consider else an invalid fork) */
 static const int BLOCK_REORG_MAX_DEPTH = 91; // 1 block after confimation of a block.
 /** Depth for rolling checkpoing block */
@@ -101,12 +146,14 @@ extern CBlockIndex* pindexBest;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
 extern int64_t nLastCoinStakeSearchInterval;
+extern int64_t nLastCoinStakeSearchTime;
+extern uint64_t nLastCoinStakeKernels;
+extern int nStakeThreads;
+extern int nScriptCheckThreads;
 extern const std::string strMessageMagic;
 extern int64_t nTimeBestReceived;
 extern bool fImporting;
 extern bool fReindex;
-struct COrphanBlock;
-extern std::map<uint256, COrphanBlock*> mapOrphanBlocks;
 extern bool fHaveGUI;
 
 // Settings
@@ -120,6 +167,7 @@ extern bool fLargeWorkInvalidChainFound;
 static const uint64_t nMinDiskSpace = 52428800;
 
 class CReserveKey;
+class CScriptCheck;
 class CTxDB;
 class CTxIndex;
 class CWalletInterface;
@@ -145,8 +193,11 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock);
 bool CheckDiskSpace(uint64_t nAdditionalBytes=0);
 FILE* OpenBlockFile(unsigned int nFile, unsigned int nBlockPos, const char* pszMode="rb");
 FILE* AppendBlockFile(unsigned int& nFileRet);
+/** Read the serialized bytes of a block as stored in the block file, without deserializing it */
+bool ReadRawBlockFromDisk(CDataStream& ssBlock, const CBlockIndex* pindex);
 bool LoadBlockIndex(bool fAllowNew=true);
 void PrintBlockTree();
+/** The active chain block at nHeight, or NULL; requires cs_main */
 CBlockIndex* FindBlockByHeight(int nHeight);
 bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto, bool fSendTrickle);
@@ -156,20 +207,33 @@ bool IsInitialBlockDownload();
 bool IsConfirmedInNPrevBlocks(const CTxIndex& txindex, const CBlockIndex* pindexFrom, int nMaxDepth, int& nActualDepth);
 std::string GetWarnings(const std::string strFor);
 bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock);
-uint256 WantedByOrphan(const COrphanBlock* pblockOrphan);
 const CBlockIndex* GetLastBlockIndex(const CBlockIndex* pindex, bool fProofOfStake);
 void ThreadStakeMiner(CWallet *pwallet);
+/** Run an instance of the script checking thread */
+void ThreadScriptCheck();
 
 
 /** (try to) add transaction to memory pool **/
+/** nAcceptTime is when the transaction entered the pool, 0 for now */
 bool AcceptToMemoryPool(CTxMemPool& pool, CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fRejectinsaneFee=false, bool ignoreFees=false, bool fFixSpentCoins=false);
+                        bool* pfMissingInputs, bool fRejectinsaneFee=false, bool ignoreFees=false, bool fFixSpentCoins=false,
+                        int64_t nAcceptTime=0);
+/** Keep a transaction with missing inputs until its parents arrive; requires cs_main */
+bool AddOrphanTx(const CTransaction& tx, NodeId peer);
+/** Drop the orphan transactions a peer sent us; requires cs_main */
+void EraseOrphansFor(NodeId peer);
+/** Drop expired orphans, then random ones down to the limits; returns how many went */
+unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, uint64_t nMaxBytes);
+/** Load mempool.dat back into the pool, through AcceptToMemoryPool */
+bool LoadMempool();
+/** Write the pool to mempool.dat */
+bool DumpMempool();
 
 bool AcceptableInputs(CTxMemPool& pool, const CTransaction &txo, bool fLimitFree,
                         bool* pfMissingInputs, bool fRejectinsaneFee=false, bool isDSTX=false);
 
 
-bool FindTransactionsByDestination(const CTxDestination &dest, std::vector<uint256> &vtxhash);
+bool FindTransactionsByDestination(const CTxDestination &dest, std::vector<uint256> &vtxhash, int nSkip=0, int nCount=-1);
 
 int GetInputAge(CTxIn& vin);
 int GetInputAgeIX(uint256 nTXHash, CTxIn& vin);
@@ -184,6 +248,7 @@ void Misbehaving(NodeId nodeid, int howmuch);
 
 struct CNodeStateStats {
     int nMisbehavior;
+    int nBlocksInFlight;
 };
 
 
@@ -245,6 +310,10 @@ enum GetMinFee_mode
 
 typedef std::map<uint256, std::pair<CTxIndex, CTransaction> > MapPrevTx;
 
+/** Number of transaction and block header hashes actually computed (cache misses) */
+extern std::atomic<uint64_t> nTransactionHashesComputed;
+extern std::atomic<uint64_t> nBlockHashesComputed;
+
 int64_t GetMinFee(const CTransaction& tx, unsigned int nBytes, bool fAllowFree, enum GetMinFee_mode mode);
 
 
@@ -266,13 +335,20 @@ public:
     mutable int nDoS;
     bool DoS(int nDoSIn, bool fIn) const { nDoS += nDoSIn; return fIn; }
 
+    // memory only
+    // The hash is only memoized for deserialized transactions. Code that
+    // modifies one of those in place must call InvalidateHash() afterwards.
+    mutable bool fHashCacheable;
+    mutable bool fHashCached;
+    mutable uint256 hashCached;
+
     CTransaction()
     {
         SetNull();
     }
 
     CTransaction(int nVersion, unsigned int nTime, const std::vector<CTxIn>& vin, const std::vector<CTxOut>& vout, unsigned int nLockTime)
-        : nVersion(nVersion), nTime(nTime), vin(vin), vout(vout), nLockTime(nLockTime), nDoS(0)
+        : nVersion(nVersion), nTime(nTime), vin(vin), vout(vout), nLockTime(nLockTime), nDoS(0), fHashCacheable(false), fHashCached(false)
     {
     }
 
@@ -284,6 +360,13 @@ public:
         READWRITE(vin);
         READWRITE(vout);
         READWRITE(nLockTime);
+        if (fRead)
+        {
+            // Transactions that come off the wire or the disk are normally
+            // only read afterwards, so their hash is worth remembering
+            fHashCacheable = true;
+            fHashCached = false;
+        }
     )
 
     void SetNull()
@@ -294,6 +377,8 @@ public:
         vout.clear();
         nLockTime = 0;
         nDoS = 0;  // Denial-of-service prevention
+        fHashCacheable = false;
+        fHashCached = false;
     }
 
     bool IsNull() const
@@ -303,7 +388,21 @@ public:
 
     uint256 GetHash() const
     {
-        return SerializeHash(*this);
+        if (fHashCached)
+            return hashCached;
+        nTransactionHashesComputed++;
+        uint256 hash = SerializeHash(*this);
+        if (fHashCacheable)
+        {
+            hashCached = hash;
+            fHashCached = true;
+        }
+        return hash;
+    }
+
+    void InvalidateHash() const
+    {
+        fHashCached = false;
     }
 
     bool IsCoinBase() const
@@ -433,16 +532,57 @@ public:
         @param[in] pindexBlock
         @param[in] fBlock   true if called from ConnectBlock
         @param[in] fMiner   true if called from CreateNewBlock
+        @param[out] pvChecks    If not NULL, signature checks are appended here instead of being run
         @return Returns true if all checks succeed
      */
     bool ConnectInputs(CTxDB& txdb, MapPrevTx inputs,
                        std::map<uint256, CTxIndex>& mapTestPool, const CDiskTxPos& posThisTx,
-                       const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, unsigned int flags = STANDARD_SCRIPT_VERIFY_FLAGS, bool fValidateSig = true);
+                       const CBlockIndex* pindexBlock, bool fBlock, bool fMiner, unsigned int flags = STANDARD_SCRIPT_VERIFY_FLAGS, bool fValidateSig = true,
+                       std::vector<CScriptCheck> *pvChecks = NULL) const;
     bool CheckTransaction() const;
 
     const CTxOut& GetOutputFor(const CTxIn& input, const MapPrevTx& inputs) const;
 };
 
+/** A transaction waiting for its parents, see AddOrphanTx */
+struct COrphanTx {
+    CTransaction tx;
+    NodeId fromPeer;
+    int64_t nTimeExpire;
+    unsigned int nTxSize;
+};
+extern std::map<uint256, COrphanTx> mapOrphanTransactions;
+extern std::map<COutPoint, std::set<uint256> > mapOrphanTransactionsByPrev; // orphans spending each outpoint
+extern uint64_t nOrphanTxBytes; // sum of the orphans' serialized sizes
+
+/** Closure representing one script verification
+ *  Note that this stores references to the spending transaction */
+class CScriptCheck
+{
+private:
+    CScript scriptPubKey;
+    const CTransaction *ptxTo;
+    unsigned int nIn;
+    unsigned int nFlags;
+    int nHashType;
+
+public:
+    CScriptCheck() : ptxTo(0), nIn(0), nFlags(0), nHashType(0) {}
+    CScriptCheck(const CTransaction& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, int nHashTypeIn) :
+        scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
+        ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), nHashType(nHashTypeIn) { }
+
+    bool operator()() const;
+
+    void swap(CScriptCheck &check) {
+        scriptPubKey.swap(check.scriptPubKey);
+        std::swap(ptxTo, check.ptxTo);
+        std::swap(nIn, check.nIn);
+        std::swap(nFlags, check.nFlags);
+        std::swap(nHashType, check.nHashType);
+    }
+};
+
 
 /** wrapper for CTxOut that provides a more compact serialization */
 class CTxOutCompressor
@@ -480,6 +620,16 @@ unsigned int GetLegacySigOpCount(const CTransaction& tx);
  */
 unsigned int GetP2SHSigOpCount(const CTransaction& tx, const MapPrevTx& mapInputs);
 
+/** Priority of a transaction, sum(valuein * age) / nSize over its confirmed inputs.
+
+    Inputs from the memory pool, whose index position is null or the
+    CDiskTxPos(1,1,1) marker, count for nothing.
+    @param[in] mapInputs            Map of previous transactions that have outputs we're spending
+    @param[out] nInChainInputValue  Value of the confirmed inputs, which keep ageing in the pool
+    @see CTxMemPoolEntry::GetPriority
+ */
+double GetTxPriority(const CTransaction& tx, const MapPrevTx& mapInputs, unsigned int nSize, int64_t& nInChainInputValue);
+
 inline bool AllowFree(double dPriority)
 {
     // Large (in bytes) low-priority (new, small-coin) transactions
@@ -644,6 +794,14 @@ public:
     // memory only
     mutable std::vector<uint256> vMerkleTree;
 
+    // memory only
+    // Header bytes the cached hash was computed over. The header fields are
+    // public and get changed in place (miner nonce, time, merkle root), so the
+    // cache is checked against them instead of being invalidated explicitly.
+    mutable bool fHeaderHashCached;
+    mutable unsigned char vchHeaderCached[80];
+    mutable uint256 hashHeaderCached;
+
     // Denial-of-service detection:
     mutable int nDoS;
     bool DoS(int nDoSIn, bool fIn) const { nDoS += nDoSIn; return fIn; }
@@ -687,6 +845,7 @@ public:
         vtx.clear();
         vchBlockSig.clear();
         vMerkleTree.clear();
+        fHeaderHashCached = false;
         nDoS = 0;
     }
 
@@ -697,15 +856,20 @@ public:
 
     uint256 GetHash() const
     {
-        if (nVersion > 6)
-            return Hash_bmw512(BEGIN(nVersion), END(nNonce));
-        else
-            return GetPoWHash();
+        return GetPoWHash();
     }
 
     uint256 GetPoWHash() const
     {
-     return Hash_bmw512(BEGIN(nVersion), END(nNonce));
+        // Both hashes are BMW-512 over the 80 header bytes
+        BOOST_STATIC_ASSERT(sizeof(vchHeaderCached) == 80);
+        if (fHeaderHashCached && memcmp(vchHeaderCached, BEGIN(nVersion), sizeof(vchHeaderCached)) == 0)
+            return hashHeaderCached;
+        nBlockHashesComputed++;
+        hashHeaderCached = Hash_bmw512(BEGIN(nVersion), END(nNonce));
+        memcpy(vchHeaderCached, BEGIN(nVersion), sizeof(vchHeaderCached));
+        fHeaderHashCached = true;
+        return hashHeaderCached;
     }
 
     int64_t GetBlockTime() const
@@ -757,11 +921,15 @@ public:
         int j = 0;
         for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
         {
-            for (int i = 0; i < nSize; i += 2)
+            // Each pair of nodes is already 64 contiguous bytes, so a whole
+            // level goes through the batched double hash at once
+            vMerkleTree.resize(j + nSize + (nSize + 1) / 2);
+            SHA256D64(vMerkleTree[j+nSize].begin(), vMerkleTree[j].begin(), nSize / 2);
+            if (nSize & 1)
             {
-                int i2 = std::min(i+1, nSize-1);
-                vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j+i]),  END(vMerkleTree[j+i]),
-                                           BEGIN(vMerkleTree[j+i2]), END(vMerkleTree[j+i2])));
+                // The odd one out is paired with itself
+                uint256 pair[2] = { vMerkleTree[j+nSize-1], vMerkleTree[j+nSize-1] };
+                SHA256D64(vMerkleTree[j+nSize+nSize/2].begin(), pair[0].begin(), 1);
             }
             j += nSize;
         }
@@ -790,10 +958,10 @@ public:
             return 0;
         BOOST_FOREACH(const uint256& otherside, vMerkleBranch)
         {
+            uint256 pair[2] = { hash, otherside };
             if (nIndex & 1)
-                hash = Hash(BEGIN(otherside), END(otherside), BEGIN(hash), END(hash));
-            else
-                hash = Hash(BEGIN(hash), END(hash), BEGIN(otherside), END(otherside));
+                std::swap(pair[0], pair[1]);
+            SHA256D64(hash.begin(), pair[0].begin(), 1);
             nIndex >>= 1;
         }
         return hash;
@@ -886,7 +1054,7 @@ public:
     bool AcceptBlock();
     bool SignBlock(CWallet& keystore, int64_t nFees);
     bool CheckBlockSignature() const;
-    void RebuildAddressIndex(CTxDB& txdb);
+    void RebuildAddressIndex(CTxDB& txdb, int nHeight);
     bool IsRewardStructureValid(CBlockIndex* pindexLast);
 
 private:
@@ -944,6 +1112,9 @@ public:
     const uint256* phashBlock;
     CBlockIndex* pprev;
     CBlockIndex* pnext;
+    // (memory only) Pointer to an earlier ancestor, chosen so that
+    // GetAncestor() needs O(log n) steps on any branch
+    CBlockIndex* pskip;
     unsigned int nFile;
     unsigned int nBlockPos;
     uint256 nChainTrust; // ppcoin: trust score of block chain
@@ -983,6 +1154,7 @@ public:
         phashBlock = NULL;
         pprev = NULL;
         pnext = NULL;
+        pskip = NULL;
         nFile = 0;
         nBlockPos = 0;
         nHeight = 0;
@@ -1009,6 +1181,7 @@ public:
         phashBlock = NULL;
         pprev = NULL;
         pnext = NULL;
+        pskip = NULL;
         nFile = nFileIn;
         nBlockPos = nBlockPosIn;
         nHeight = 0;
@@ -1072,6 +1245,14 @@ public:
 
     uint256 GetBlockTrust() const;
 
+    // Build the skip pointer; pprev and nHeight must be set, and pprev's own
+    // skip pointer already built
+    void BuildSkip();
+
+    // Efficiently find the ancestor of this block at the given height
+    CBlockIndex* GetAncestor(int height);
+    const CBlockIndex* GetAncestor(int height) const;
+
     bool IsInMainChain() const
     {
         return (pnext || this == pindexBest);
@@ -1159,6 +1340,57 @@ public:
 
 
 
+/** The blocks of the active (best) chain, indexed by height. Kept in step
+ * with pindexBest by SetBestChain, so height lookups on the main chain do
+ * not need to walk pprev/pnext pointers.
+ */
+class CChain
+{
+private:
+    std::vector<CBlockIndex*> vChain;
+
+public:
+    /** Returns the genesis block, or NULL if the chain is empty. */
+    CBlockIndex* Genesis() const
+    {
+        return vChain.size() > 0 ? vChain[0] : NULL;
+    }
+
+    /** Returns the tip, or NULL if the chain is empty. */
+    CBlockIndex* Tip() const
+    {
+        return vChain.size() > 0 ? vChain[vChain.size() - 1] : NULL;
+    }
+
+    /** Returns the block at nHeight, or NULL if it is out of range. */
+    CBlockIndex* operator[](int nHeight) const
+    {
+        if (nHeight < 0 || nHeight >= (int)vChain.size())
+            return NULL;
+        return vChain[nHeight];
+    }
+
+    /** Whether pindex is part of this chain. */
+    bool Contains(const CBlockIndex* pindex) const
+    {
+        return (*this)[pindex->nHeight] == pindex;
+    }
+
+    /** Height of the tip, -1 if the chain is empty. */
+    int Height() const
+    {
+        return vChain.size() - 1;
+    }
+
+    /** Make pindex the new tip. Only the entries above the fork point with
+     * the previous chain are rewritten. */
+    void SetTip(CBlockIndex* pindex);
+};
+
+extern CChain chainActive;
+
+
+
 /** Used to marshal pointers into hashes for db storage. */
 class CDiskBlockIndex : public CBlockIndex
 {
@@ -1286,6 +1518,12 @@ public:
         vHave = vHaveIn;
     }
 
+    // Put a block we do not have yet in front, to ask what follows it
+    void PushFront(const uint256& hash)
+    {
+        vHave.insert(vHave.begin(), hash);
+    }
+
     IMPLEMENT_SERIALIZE
     (
         if (!(nType & SER_GETHASH))
@@ -1467,6 +1705,9 @@ protected:
     friend void ::UnregisterAllWallets();
 };
 
+// Last, the pool holds CTransaction by value
+#include "txmempool.h"
+
 #endif
 /** Open a block file (blk?????.dat) */
 FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly);
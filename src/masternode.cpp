@@ -38,29 +38,19 @@ bool GetBlockHash(uint256& hash, int nBlockHeight)
         return true;
     }
 
-    const CBlockIndex *BlockLastSolved = pindexBest;
-    const CBlockIndex *BlockReading = pindexBest;
+    if (pindexBest->nHeight == 0 || pindexBest->nHeight+1 < nBlockHeight) return false;
 
-    if (BlockLastSolved == NULL || BlockLastSolved->nHeight == 0 || pindexBest->nHeight+1 < nBlockHeight) return false;
+    // The hash reported for nBlockHeight is that of the block before it;
+    // height 0 (genesis) is never returned
+    int nTargetHeight = nBlockHeight > 0 ? nBlockHeight - 1 : pindexBest->nHeight;
+    if (nTargetHeight <= 0) return false;
 
-    int nBlocksAgo = 0;
-    if(nBlockHeight > 0) nBlocksAgo = (pindexBest->nHeight+1)-nBlockHeight;
-    assert(nBlocksAgo >= 0);
+    const CBlockIndex *BlockReading = pindexBest->GetAncestor(nTargetHeight);
+    if (BlockReading == NULL) return false;
 
-    int n = 0;
-    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++) {
-        if(n >= nBlocksAgo){
-            hash = BlockReading->GetBlockHash();
-            mapCacheBlockHashes[nBlockHeight] = hash;
-            return true;
-        }
-        n++;
-
-        if (BlockReading->pprev == NULL) { assert(BlockReading); break; }
-        BlockReading = BlockReading->pprev;
-    }
-
-    return false;
+    hash = BlockReading->GetBlockHash();
+    mapCacheBlockHashes[nBlockHeight] = hash;
+    return true;
 }
 
 CMasternode::CMasternode()
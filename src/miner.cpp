@@ -13,6 +13,10 @@
 #include "masternode-payments.h"
 #include "mnengine.h"
 
+#include <atomic>
+
+#include <boost/thread.hpp>
+
 using namespace std;
 
 //////////////////////////////////////////////////////////////////////////////
@@ -62,12 +66,12 @@ void SHA256Transform(void* pstate, void* pinput, const void* pinit)
 class COrphan
 {
 public:
-    CTransaction* ptx;
+    const CTransaction* ptx;
     set<uint256> setDependsOn;
     double dPriority;
     double dFeePerKb;
 
-    COrphan(CTransaction* ptxIn)
+    COrphan(const CTransaction* ptxIn)
     {
         ptx = ptxIn;
         dPriority = dFeePerKb = 0;
@@ -78,9 +82,11 @@ public:
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 int64_t nLastCoinStakeSearchInterval = 0;
+int64_t nLastCoinStakeSearchTime = 0; // microseconds spent in the last kernel search
+uint64_t nLastCoinStakeKernels = 0; // kernel hashes evaluated in the last search
  
 // We want to sort transactions by priority and fee, so:
-typedef boost::tuple<double, double, CTransaction*> TxPriority;
+typedef boost::tuple<double, double, const CTransaction*> TxPriority;
 class TxPriorityCompare
 {
     bool byFee;
@@ -103,6 +109,302 @@ public:
     }
 };
 
+// Transactions picked for a block, and what is needed to extend the pick
+struct CTemplateSelection
+{
+    vector<CTransaction> vtx;
+    map<uint256, CTxIndex> mapTestPool;  // outputs created and spent by vtx
+    uint64_t nBlockSize;
+    uint64_t nBlockTx;
+    int nBlockSigOps;
+    int64_t nFees;
+
+    CTemplateSelection() : nBlockSize(1000), nBlockTx(0), nBlockSigOps(100), nFees(0) {}
+};
+
+// Connect tx on top of the transactions already selected and append it.
+// Fails if an input is not available yet, the sigop limit would be crossed,
+// or the fee is below nMinFeePerKb (when set).
+static bool AddToSelection(CTxDB& txdb, CTemplateSelection& sel, const CTransaction& tx,
+                           unsigned int nTxSize, unsigned int nTxSigOps, CBlockIndex* pindexPrev,
+                           int64_t nMinFeePerKb)
+{
+    map<uint256, CTxIndex> mapTestPoolTmp(sel.mapTestPool);
+    MapPrevTx mapInputs;
+    bool fInvalid;
+    if (!tx.FetchInputs(txdb, mapTestPoolTmp, false, true, mapInputs, fInvalid))
+        return false;
+
+    int64_t nTxFees = tx.GetValueMapIn(mapInputs)-tx.GetValueOut();
+    if (nMinFeePerKb > 0 && double(nTxFees) / (double(nTxSize)/1000.0) < nMinFeePerKb)
+        return false;
+
+    nTxSigOps += GetP2SHSigOpCount(tx, mapInputs);
+    if (sel.nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+        return false;
+
+    // Note that flags: we don't want to set mempool/IsStandard()
+    // policy here, but we still have to ensure that the block we
+    // create only contains transactions that are valid in new blocks.
+    if (!tx.ConnectInputs(txdb, mapInputs, mapTestPoolTmp, CDiskTxPos(1,1,1), pindexPrev, false, true, MANDATORY_SCRIPT_VERIFY_FLAGS))
+        return false;
+    mapTestPoolTmp[tx.GetHash()] = CTxIndex(CDiskTxPos(1,1,1), tx.vout.size());
+    swap(sel.mapTestPool, mapTestPoolTmp);
+
+    // Added
+    sel.vtx.push_back(tx);
+    sel.nBlockSize += nTxSize;
+    ++sel.nBlockTx;
+    sel.nBlockSigOps += nTxSigOps;
+    sel.nFees += nTxFees;
+    return true;
+}
+
+// Full pass over the memory pool: order transactions by priority, then fee,
+// and connect as many as fit
+static void SelectTransactions(CTxDB& txdb, CBlockIndex* pindexPrev, int nHeight, int64_t nTxTimeLimit,
+                               unsigned int nBlockMaxSize, unsigned int nBlockPrioritySize,
+                               unsigned int nBlockMinSize, int64_t nMinTxFee, CTemplateSelection& sel)
+{
+    // Priority order to process transactions
+    list<COrphan> vOrphan; // list memory doesn't move
+    map<uint256, vector<COrphan*> > mapDependers;
+
+    // This vector will be sorted into a priority queue:
+    vector<TxPriority> vecPriority;
+    vecPriority.reserve(mempool.mapTx.size());
+    for (CTxMemPool::txiter mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
+    {
+        const CTransaction& tx = mi->GetTx();
+        if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
+            continue;
+
+        // Fee and priority were worked out when the transaction entered the
+        // pool, so only inputs still in the pool need looking at here.
+        COrphan* porphan = NULL;
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        {
+            if (!mempool.mapTx.count(txin.prevout.hash))
+                continue;
+
+            // Has to wait for dependencies
+            if (!porphan)
+            {
+                // Use list for automatic deletion
+                vOrphan.push_back(COrphan(&tx));
+                porphan = &vOrphan.back();
+            }
+            mapDependers[txin.prevout.hash].push_back(porphan);
+            porphan->setDependsOn.insert(txin.prevout.hash);
+        }
+
+        double dPriority = mi->GetPriority(pindexPrev->nHeight);
+
+        // This is a more accurate fee-per-kilobyte than is used by the client code, because the
+        // client code rounds up the size to the nearest 1K. That's good, because it gives an
+        // incentive to create smaller transactions.
+        double dFeePerKb = mi->GetFeeRate();
+
+        if (porphan)
+        {
+            porphan->dPriority = dPriority;
+            porphan->dFeePerKb = dFeePerKb;
+        }
+        else
+            vecPriority.push_back(TxPriority(dPriority, dFeePerKb, &tx));
+    }
+
+    // Collect transactions into block
+    bool fSortedByFee = (nBlockPrioritySize <= 0);
+
+    TxPriorityCompare comparer(fSortedByFee);
+    std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+
+    while (!vecPriority.empty())
+    {
+        // Take highest priority transaction off the priority queue:
+        double dPriority = vecPriority.front().get<0>();
+        double dFeePerKb = vecPriority.front().get<1>();
+        const CTransaction& tx = *(vecPriority.front().get<2>());
+
+        std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+        vecPriority.pop_back();
+
+        // Size limits
+        unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        if (sel.nBlockSize + nTxSize >= nBlockMaxSize)
+            continue;
+
+        // Legacy limits on sigOps:
+        unsigned int nTxSigOps = GetLegacySigOpCount(tx);
+        if (sel.nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+            continue;
+
+        // Timestamp limit
+        if (tx.nTime > nTxTimeLimit)
+            continue;
+
+        // Skip free transactions if we're past the minimum block size:
+        if (fSortedByFee && (dFeePerKb < nMinTxFee) && (sel.nBlockSize + nTxSize >= nBlockMinSize))
+            continue;
+
+        // Prioritize by fee once past the priority size or we run out of high-priority
+        // transactions:
+        if (!fSortedByFee &&
+            ((sel.nBlockSize + nTxSize >= nBlockPrioritySize) || (dPriority < COIN * 144 / 250)))
+        {
+            fSortedByFee = true;
+            comparer = TxPriorityCompare(fSortedByFee);
+            std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+        }
+
+        // Connecting shouldn't fail due to dependency on other memory pool transactions
+        // because we're already processing them in order of dependency
+        if (!AddToSelection(txdb, sel, tx, nTxSize, nTxSigOps, pindexPrev, 0))
+            continue;
+
+        if (fDebug && GetBoolArg("-printpriority", false))
+        {
+            LogPrintf("priority %.1f feeperkb %.1f txid %s\n",
+                   dPriority, dFeePerKb, tx.GetHash().ToString());
+        }
+
+        // Add transactions that depend on this one to the priority queue
+        uint256 hash = tx.GetHash();
+        if (mapDependers.count(hash))
+        {
+            BOOST_FOREACH(COrphan* porphan, mapDependers[hash])
+            {
+                if (!porphan->setDependsOn.empty())
+                {
+                    porphan->setDependsOn.erase(hash);
+                    if (porphan->setDependsOn.empty())
+                    {
+                        vecPriority.push_back(TxPriority(porphan->dPriority, porphan->dFeePerKb, porphan->ptx));
+                        std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Rebuild a full template at most this often (seconds) once new
+// transactions stop fitting, so better-paying ones can displace old ones
+static const int64_t TEMPLATE_RESORT_INTERVAL = 30;
+
+// The last proof-of-stake selection, valid for pindexPrev while the pool's
+// transactions-updated counter equals nTransactionsUpdated. Transactions
+// entering the pool are queued in vPending and appended on the next call;
+// one of the selected transactions leaving the pool empties the cache.
+// Guarded by mempool.cs, which the pool's notifications are sent under.
+struct CTemplateCache
+{
+    CBlockIndex* pindexPrev;             // NULL when empty
+    unsigned int nTransactionsUpdated;
+    unsigned int nBits;
+    int64_t nTimeBuilt;
+    bool fFull;                          // a new transaction did not fit
+    CTemplateSelection sel;
+    set<uint256> setSelected;
+    vector<uint256> vPending;
+
+    CTemplateCache() : pindexPrev(NULL), nTransactionsUpdated(0), nBits(0), nTimeBuilt(0), fFull(false) {}
+};
+static CTemplateCache templateCache;
+
+static void TemplateCacheEntryAdded(const uint256& hash)
+{
+    if (templateCache.pindexPrev == NULL)
+        return;
+    templateCache.nTransactionsUpdated++;
+    templateCache.vPending.push_back(hash);
+}
+
+static void TemplateCacheEntryRemoved(const uint256& hash)
+{
+    if (templateCache.pindexPrev == NULL)
+        return;
+    templateCache.nTransactionsUpdated++;
+    if (templateCache.setSelected.count(hash))
+        templateCache.pindexPrev = NULL;
+}
+
+static void StoreTemplateCache(CBlockIndex* pindexPrev, unsigned int nBits, const CTemplateSelection& sel)
+{
+    static bool fConnected = false;
+    if (!fConnected)
+    {
+        mempool.NotifyEntryAdded.connect(&TemplateCacheEntryAdded);
+        mempool.NotifyEntryRemoved.connect(&TemplateCacheEntryRemoved);
+        fConnected = true;
+    }
+
+    templateCache.pindexPrev = pindexPrev;
+    templateCache.nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    templateCache.nBits = nBits;
+    templateCache.nTimeBuilt = GetTime();
+    templateCache.fFull = false;
+    templateCache.sel = sel;
+    templateCache.setSelected.clear();
+    BOOST_FOREACH(const CTransaction& tx, sel.vtx)
+        templateCache.setSelected.insert(tx.GetHash());
+    templateCache.vPending.clear();
+}
+
+// Bring the cached selection up to date with the transactions that entered
+// the pool since; false if it has to be rebuilt from scratch instead
+static bool UpdateTemplateCache(CTxDB& txdb, CBlockIndex* pindexPrev, int nHeight, int64_t nTxTimeLimit,
+                                unsigned int nBlockMaxSize, unsigned int nBlockMinSize, int64_t nMinTxFee)
+{
+    CTemplateCache& cache = templateCache;
+    if (cache.pindexPrev != pindexPrev || cache.nTransactionsUpdated != mempool.GetTransactionsUpdated())
+        return false;
+    if (cache.fFull && GetTime() - cache.nTimeBuilt >= TEMPLATE_RESORT_INTERVAL)
+        return false;
+
+    // In arrival order, so a parent is always tried before its children
+    vector<uint256> vPending;
+    vPending.swap(cache.vPending);
+    set<uint256> setDeferred;
+    BOOST_FOREACH(const uint256& hash, vPending)
+    {
+        CTxMemPool::txiter mi = mempool.mapTx.find(hash);
+        if (mi == mempool.mapTx.end())
+            continue;
+        const CTransaction& tx = mi->GetTx();
+        if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
+            continue;
+
+        // Not yet: keep it for a later call, and its children behind it,
+        // as they cannot connect before it is selected
+        bool fDefer = (tx.nTime > nTxTimeLimit);
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            if (setDeferred.count(txin.prevout.hash))
+                fDefer = true;
+        if (fDefer)
+        {
+            cache.vPending.push_back(hash);
+            setDeferred.insert(hash);
+            continue;
+        }
+
+        unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        unsigned int nTxSigOps = GetLegacySigOpCount(tx);
+        if (cache.sel.nBlockSize + nTxSize >= nBlockMaxSize || cache.sel.nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+        {
+            cache.fFull = true;
+            continue;
+        }
+
+        // Free transactions only while the block is below -blockminsize
+        int64_t nMinFeePerKb = (cache.sel.nBlockSize + nTxSize >= nBlockMinSize) ? nMinTxFee : 0;
+        if (AddToSelection(txdb, cache.sel, tx, nTxSize, nTxSigOps, pindexPrev, nMinFeePerKb))
+            cache.setSelected.insert(hash);
+    }
+    return true;
+}
+
 // CreateNewBlock: create new block (without proof-of-work/proof-of-stake)
 CBlock* CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, int64_t* pFees)
 {
@@ -177,197 +479,45 @@ CBlock* CreateNewBlock(CReserveKey& reservekey, bool fProofOfStake, int64_t* pFe
     if (mapArgs.count("-mintxfee"))
         ParseMoney(mapArgs["-mintxfee"], nMinTxFee);
 
-    pblock->nBits = GetNextTargetRequired(pindexPrev, fProofOfStake);
-
-
     // Collect memory pool transactions into the block
     int64_t nFees = 0;
     {
         LOCK2(cs_main, mempool.cs);
         CTxDB txdb("r");
-//> CCASH <
-        // Priority order to process transactions
-        list<COrphan> vOrphan; // list memory doesn't move
-        map<uint256, vector<COrphan*> > mapDependers;
-
-        // This vector will be sorted into a priority queue:
-        vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (map<uint256, CTransaction>::iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
+        int64_t nStart = GetTimeMicros();
+        CTemplateSelection sel;
+
+        // Staking asks for a template every few hundred milliseconds; reuse
+        // the last one as long as the pool changes only by additions
+        int64_t nTxTimeLimit = fProofOfStake ? std::min(GetAdjustedTime(), (int64_t)pblock->vtx[0].nTime) : GetAdjustedTime();
+        bool fCached = fProofOfStake && UpdateTemplateCache(txdb, pindexPrev, nHeight, nTxTimeLimit,
+                                                            nBlockMaxSize, nBlockMinSize, nMinTxFee);
+        if (fCached)
         {
-            CTransaction& tx = (*mi).second;
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
-                continue;
-
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            int64_t nTotalIn = 0;
-            bool fMissingInputs = false;
-            BOOST_FOREACH(const CTxIn& txin, tx.vin)
-            {
-                // Read prev transaction
-                CTransaction txPrev;
-                CTxIndex txindex;
-                if (!txPrev.ReadFromDisk(txdb, txin.prevout, txindex))
-                {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash))
-                    {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        if (fDebug) assert("mempool transaction missing input" == 0);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
-
-                    // Has to wait for dependencies
-                    if (!porphan)
-                    {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].vout[txin.prevout.n].nValue;
-                    continue;
-                }
-                int64_t nValueIn = txPrev.vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
-
-                int nConf = txindex.GetDepthInMainChain();
-                dPriority += (double)nValueIn * nConf;
-            }
-            if (fMissingInputs) continue;
-
-            // Priority is sum(valuein * age) / txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority /= nTxSize;
-
-            // This is a more accurate fee-per-kilobyte than is used by the client code, because the
-            // client code rounds up the size to the nearest 1K. That's good, because it gives an
-            // incentive to create smaller transactions.
-            double dFeePerKb =  double(nTotalIn-tx.GetValueOut()) / (double(nTxSize)/1000.0);
-
-            if (porphan)
-            {
-                porphan->dPriority = dPriority;
-                porphan->dFeePerKb = dFeePerKb;
-            }
-            else
-                vecPriority.push_back(TxPriority(dPriority, dFeePerKb, &(*mi).second));
+            pblock->nBits = templateCache.nBits;
+            sel.vtx = templateCache.sel.vtx;
+            sel.nBlockSize = templateCache.sel.nBlockSize;
+            sel.nBlockTx = templateCache.sel.nBlockTx;
+            sel.nFees = templateCache.sel.nFees;
         }
-
-        // Collect transactions into block
-        map<uint256, CTxIndex> mapTestPool;
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-        while (!vecPriority.empty())
+        else
         {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            double dFeePerKb = vecPriority.front().get<1>();
-            CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
-
-            // Legacy limits on sigOps:
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-                continue;
-
-            // Timestamp limit
-            if (tx.nTime > GetAdjustedTime() || (fProofOfStake && tx.nTime > pblock->vtx[0].nTime))
-                continue;
-
-            // Skip free transactions if we're past the minimum block size:
-            if (fSortedByFee && (dFeePerKb < nMinTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
-
-            // Prioritize by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || (dPriority < COIN * 144 / 250)))
-            {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
-
-            // Connecting shouldn't fail due to dependency on other memory pool transactions
-            // because we're already processing them in order of dependency
-            map<uint256, CTxIndex> mapTestPoolTmp(mapTestPool);
-            MapPrevTx mapInputs;
-            bool fInvalid;
-            if (!tx.FetchInputs(txdb, mapTestPoolTmp, false, true, mapInputs, fInvalid))
-                continue;
-
-            int64_t nTxFees = tx.GetValueMapIn(mapInputs)-tx.GetValueOut();
-
-            nTxSigOps += GetP2SHSigOpCount(tx, mapInputs);
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
-                continue;
-
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
-            if (!tx.ConnectInputs(txdb, mapInputs, mapTestPoolTmp, CDiskTxPos(1,1,1), pindexPrev, false, true, MANDATORY_SCRIPT_VERIFY_FLAGS))
-                continue;
-            mapTestPoolTmp[tx.GetHash()] = CTxIndex(CDiskTxPos(1,1,1), tx.vout.size());
-            swap(mapTestPool, mapTestPoolTmp);
-
-            // Added
-            pblock->vtx.push_back(tx);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            if (fDebug && GetBoolArg("-printpriority", false))
-            {
-                LogPrintf("priority %.1f feeperkb %.1f txid %s\n",
-                       dPriority, dFeePerKb, tx.GetHash().ToString());
-            }
-
-            // Add transactions that depend on this one to the priority queue
-            uint256 hash = tx.GetHash();
-            if (mapDependers.count(hash))
-            {
-                BOOST_FOREACH(COrphan* porphan, mapDependers[hash])
-                {
-                    if (!porphan->setDependsOn.empty())
-                    {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty())
-                        {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->dFeePerKb, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
-                }
-            }
+            pblock->nBits = GetNextTargetRequired(pindexPrev, fProofOfStake);
+            SelectTransactions(txdb, pindexPrev, nHeight, nTxTimeLimit, nBlockMaxSize, nBlockPrioritySize,
+                               nBlockMinSize, nMinTxFee, sel);
+            if (fProofOfStake)
+                StoreTemplateCache(pindexPrev, pblock->nBits, sel);
         }
 
-        nLastBlockTx = nBlockTx;
-        nLastBlockSize = nBlockSize;
+        nLastBlockTx = sel.nBlockTx;
+        nLastBlockSize = sel.nBlockSize;
+        nFees = sel.nFees;
+        pblock->vtx.insert(pblock->vtx.end(), sel.vtx.begin(), sel.vtx.end());
 
+        LogPrint("bench", "CreateNewBlock: %s template, %u transactions in %.2fms\n",
+                 fCached ? "cached" : "new", sel.nBlockTx, (GetTimeMicros() - nStart) * 0.001);
         if (fDebug && GetBoolArg("-printpriority", false))
-            LogPrintf("CreateNewBlock(): total size %u\n", nBlockSize);
+            LogPrintf("CreateNewBlock(): total size %u\n", sel.nBlockSize);
         // > CCASH <
         if (!fProofOfStake)
         {
@@ -649,3 +799,222 @@ void ThreadStakeMiner(CWallet *pwallet)
             MilliSleep(nMinerSleep);
     }
 }
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Proof-of-work miner
+//
+
+// Hashes per second of each worker, reported by getmininginfo
+static CCriticalSection cs_powHashRate;
+static vector<double> vPoWHashRate;
+
+// Serializes GeneratePoWBlocks, setgenerate calls it without cs_main
+static CCriticalSection cs_powMiner;
+
+// Set while ThreadPoWMiner runs, it clears it when it gives up on its own
+static std::atomic<bool> fPoWMinerRunning(false);
+
+// State shared by the threads hashing one block template
+struct CPoWSearch
+{
+    CBlockIndex* pindexPrev;
+    unsigned int nTransactionsUpdated;
+    int64_t nStart;                      // when the template was built
+    unsigned char vchHeader[80];         // serialized header, nNonce last
+    uint256 hashTarget;
+    std::atomic<bool> fFound;
+    std::atomic<unsigned int> nNonce;
+    std::atomic<bool> fAbort;
+};
+
+// Headers hashed per Hash_bmw512_headers call, a multiple of every lane count
+static const unsigned int POW_BATCH_SIZE = 64;
+
+// Worker nWorker of nWorkers scans its own slice of the nonce space until
+// someone finds a block or the template goes stale
+static void PoWSearchThread(CPoWSearch* search, unsigned int nWorker, unsigned int nWorkers)
+{
+    SetThreadPriority(THREAD_PRIORITY_LOWEST);
+    RenameThread(strprintf("CampusCash-pow-%d", nWorker).c_str());
+
+    uint64_t nBegin = ((uint64_t)1 << 32) * nWorker / nWorkers;
+    uint64_t nEnd = ((uint64_t)1 << 32) * (nWorker + 1) / nWorkers;
+
+    unsigned char vchHeaders[80 * POW_BATCH_SIZE];
+    uint256 vHash[POW_BATCH_SIZE];
+    for (unsigned int i = 0; i < POW_BATCH_SIZE; i++)
+        memcpy(vchHeaders + 80 * i, search->vchHeader, 80);
+
+    int64_t nRateStart = GetTimeMicros();
+    uint64_t nRateHashes = 0;
+    unsigned int nBatches = 0;
+    for (uint64_t nNonce = nBegin; nNonce < nEnd; nNonce += POW_BATCH_SIZE)
+    {
+        unsigned int nCount = std::min((uint64_t)POW_BATCH_SIZE, nEnd - nNonce);
+        for (unsigned int i = 0; i < nCount; i++)
+        {
+            unsigned int n = nNonce + i;
+            memcpy(vchHeaders + 80 * i + 76, &n, 4);
+        }
+        Hash_bmw512_headers(vchHeaders, nCount, vHash);
+        nRateHashes += nCount;
+
+        for (unsigned int i = 0; i < nCount; i++)
+        {
+            if (vHash[i] > search->hashTarget)
+                continue;
+            bool fFirst = false;
+            if (search->fFound.compare_exchange_strong(fFirst, true))
+                search->nNonce = nNonce + i;
+            break;
+        }
+        if (search->fFound || search->fAbort)
+            break;
+
+        // Every 16k hashes: is the template stale, and how fast are we going
+        if (++nBatches % 256 == 0)
+        {
+            if (search->pindexPrev != pindexBest ||
+                (mempool.GetTransactionsUpdated() != search->nTransactionsUpdated && GetTime() - search->nStart > 60))
+                break;
+
+            int64_t nNow = GetTimeMicros();
+            if (nNow - nRateStart >= 1000000)
+            {
+                LOCK(cs_powHashRate);
+                if (nWorker < vPoWHashRate.size())
+                    vPoWHashRate[nWorker] = nRateHashes * 1000000.0 / (nNow - nRateStart);
+                nRateStart = nNow;
+                nRateHashes = 0;
+            }
+        }
+    }
+}
+
+static void ThreadPoWMiner(CWallet* pwallet, unsigned int nThreads)
+{
+    LogPrintf("PoW miner started with %u threads, hashing %d headers at a time\n", nThreads, BMW512HeaderLanes());
+    SetThreadPriority(THREAD_PRIORITY_LOWEST);
+    RenameThread("CampusCash-pow");
+
+    CReserveKey reservekey(pwallet);
+    unsigned int nExtraNonce = 0;
+    {
+        LOCK(cs_powHashRate);
+        vPoWHashRate.assign(nThreads, 0);
+    }
+
+    try {
+        while (true)
+        {
+            // Regtest mines alone, everywhere else wait until we are in sync
+            if (Params().NetworkID() != CChainParams::REGTEST)
+            {
+                while (vNodes.empty() || IsInitialBlockDownload())
+                    MilliSleep(1000);
+            }
+
+            if (pindexBest->nHeight >= Params().EndPoWBlock_v2())
+            {
+                MilliSleep(60000);
+                continue;
+            }
+
+            //
+            // Create new block
+            //
+            CPoWSearch search;
+            search.nTransactionsUpdated = mempool.GetTransactionsUpdated();
+            search.pindexPrev = pindexBest;
+            search.nStart = GetTime();
+
+            std::unique_ptr<CBlock> pblock(CreateNewBlock(reservekey, false));
+            if (!pblock.get())
+            {
+                LogPrintf("PoW miner: keypool ran out, call keypoolrefill before restarting it\n");
+                fPoWMinerRunning = false;
+                LOCK(cs_powHashRate);
+                vPoWHashRate.clear();
+                return;
+            }
+            IncrementExtraNonce(pblock.get(), search.pindexPrev, nExtraNonce);
+
+            memcpy(search.vchHeader, BEGIN(pblock->nVersion), sizeof(search.vchHeader));
+            search.hashTarget = CBigNum().SetCompact(pblock->nBits).getuint256();
+            search.fFound = false;
+            search.nNonce = 0;
+            search.fAbort = false;
+
+            //
+            // Search
+            //
+            boost::thread_group threads;
+            for (unsigned int i = 0; i < nThreads; i++)
+                threads.create_thread(boost::bind(&PoWSearchThread, &search, i, nThreads));
+            try {
+                threads.join_all();
+            } catch (boost::thread_interrupted&) {
+                // The workers reference this stack frame, stop them before unwinding
+                search.fAbort = true;
+                threads.join_all();
+                throw;
+            }
+
+            if (search.fFound)
+            {
+                pblock->nNonce = search.nNonce;
+                SetThreadPriority(THREAD_PRIORITY_NORMAL);
+                CheckWork(pblock.get(), *pwallet, reservekey);
+                SetThreadPriority(THREAD_PRIORITY_LOWEST);
+            }
+        }
+    }
+    catch (boost::thread_interrupted&)
+    {
+        LogPrintf("PoW miner stopped\n");
+        fPoWMinerRunning = false;
+        LOCK(cs_powHashRate);
+        vPoWHashRate.clear();
+        throw;
+    }
+}
+
+void GeneratePoWBlocks(bool fGenerate, CWallet* pwallet, int nThreads)
+{
+    static boost::thread_group* minerThreads = NULL;
+
+    // Must not hold cs_main or cs_wallet here: the threads joined below take
+    // both while building a block, and ~CReserveKey takes cs_wallet
+    LOCK(cs_powMiner);
+
+    if (nThreads < 0)
+        nThreads = std::max(1, (int)boost::thread::hardware_concurrency());
+
+    if (minerThreads != NULL)
+    {
+        minerThreads->interrupt_all();
+        minerThreads->join_all();
+        delete minerThreads;
+        minerThreads = NULL;
+        fPoWMinerRunning = false;
+    }
+
+    if (!fGenerate || nThreads == 0 || pwallet == NULL)
+        return;
+
+    fPoWMinerRunning = true;
+    minerThreads = new boost::thread_group();
+    minerThreads->create_thread(boost::bind(&ThreadPoWMiner, pwallet, (unsigned int)nThreads));
+}
+
+bool IsPoWMinerRunning()
+{
+    return fPoWMinerRunning;
+}
+
+vector<double> GetPoWHashRates()
+{
+    LOCK(cs_powHashRate);
+    return vPoWHashRate;
+}
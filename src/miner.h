@@ -24,6 +24,15 @@ bool CheckWork(CBlock* pblock, CWallet& wallet, CReserveKey& reservekey);
 /** Check mined proof-of-stake block */
 bool CheckStake(CBlock* pblock, CWallet& wallet);
 
+/** Start or stop the proof-of-work miner; nThreads < 0 uses one thread per core */
+void GeneratePoWBlocks(bool fGenerate, CWallet* pwallet, int nThreads);
+
+/** Whether the proof-of-work miner is running, false once it stopped by itself */
+bool IsPoWMinerRunning();
+
+/** Hashes per second of each running proof-of-work thread, empty when stopped */
+std::vector<double> GetPoWHashRates();
+
 /** Base sha256 mining transform */
 void SHA256Transform(void* pstate, void* pinput, const void* pinit);
 
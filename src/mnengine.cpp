@@ -75,6 +75,7 @@ void CMNenginePool::SetNull(){
     entries.clear();
     finalTransaction.vin.clear();
     finalTransaction.vout.clear();
+    finalTransaction.InvalidateHash();
     lastTimeChanged = GetTimeMillis();
 
     // -- seed random number generator (used for ordering output lists)
@@ -746,6 +747,7 @@ bool CMNenginePool::AddScriptSig(const CTxIn& newVin){
             LogPrint("mnengine", "CMNenginePool::AddScriptSig -- adding to finalTransaction  %s\n", newVin.scriptSig.ToString().substr(0,24));
         }
     }
+    finalTransaction.InvalidateHash();
     for(unsigned int i = 0; i < entries.size(); i++){
         if(entries[i].AddSig(newVin)){
             LogPrint("mnengine", "CMNenginePool::AddScriptSig -- adding  %s\n", newVin.scriptSig.ToString().substr(0,24));
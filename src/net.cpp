@@ -16,6 +16,7 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_UPNP
@@ -54,9 +55,10 @@ static CNode* pnodeLocalHost = NULL;
 static CNode* pnodeSync = NULL;
 uint64_t nLocalHostNonce = 0;
 static std::vector<SOCKET> vhListenSocket;
+static CSocketEvents socketEvents;
 CAddrMan addrman;
 std::string strSubVersion;
-int nMaxConnections = GetArg("-maxconnections", 125);
+int nMaxConnections = DEFAULT_MAX_PEER_CONNECTIONS;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
@@ -436,6 +438,12 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest, bool mnEngineMaste
         // Add node
         CNode* pnode = new CNode(hSocket, addrConnect, pszDest ? pszDest : "", false);
         pnode->AddRef();
+        if (!socketEvents.Add(hSocket, pnode))
+        {
+            LogPrintf("connection to %s dropped (too many sockets for %s)\n", pnode->addrName,
+                      SocketEventsModeName(socketEvents.GetMode()));
+            pnode->CloseSocketDisconnect();
+        }
 
         {
             LOCK(cs_vNodes);
@@ -457,6 +465,7 @@ void CNode::CloseSocketDisconnect()
     if (hSocket != INVALID_SOCKET)
     {
         LogPrint("net", "disconnecting node %s\n", addrName);
+        socketEvents.Remove(hSocket);
         closesocket(hSocket);
         hSocket = INVALID_SOCKET;
     }
@@ -654,8 +663,9 @@ void CNode::copyStats(CNodeStats &stats)
 #undef X
 
 // requires LOCK(cs_vRecvMsg)
-bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
+bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& fComplete)
 {
+    fComplete = false;
     while (nBytes > 0) {
 
         // get current incomplete message, or create a new one
@@ -677,6 +687,9 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
 
         pch += handled;
         nBytes -= handled;
+
+        if (msg.complete())
+            fComplete = true;
     }
 
     return true;
@@ -920,27 +933,83 @@ void IdleNodeCheck(CNode *pnode)
     return;
 }
 
+CNetMessageRef FinishNetMessage(CVectorWriter& ss)
+{
+    assert(ss.size() >= CMessageHeader::HEADER_SIZE);
+
+    // Set the size
+    unsigned int nSize = ss.size() - CMessageHeader::HEADER_SIZE;
+    memcpy(&ss[CMessageHeader::MESSAGE_SIZE_OFFSET], &nSize, sizeof(nSize));
+
+    // Set the checksum
+    uint256 hash = Hash_bmw512(ss.data() + CMessageHeader::HEADER_SIZE, ss.data() + ss.size());
+    unsigned int nChecksum = 0;
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    memcpy(&ss[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+
+    boost::shared_ptr<std::vector<char> > msg(new std::vector<char>());
+    ss.GetAndClear(*msg);
+    return msg;
+}
+
+// Most queued messages handed to the kernel in one sendmsg() call
+static const int MAX_SEND_IOV = 64;
+
 // requires LOCK(cs_vSend)
-void SocketSendData(CNode *pnode)
+void SocketSendData(CNode *pnode, bool fOptimistic)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CNetMessageRef>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData &data = *it;
-        assert(data.size() > pnode->nSendOffset);
-        int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        assert((*it)->size() > pnode->nSendOffset);
+#ifdef WIN32
+        const std::vector<char>& data = **it;
+        size_t nToSend = data.size() - pnode->nSendOffset;
+        int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], nToSend, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+        // Gather the queued messages into one call rather than one per message
+        struct iovec iov[MAX_SEND_IOV];
+        int nIov = 0;
+        size_t nToSend = 0;
+        for (std::deque<CNetMessageRef>::iterator itIov = it; itIov != pnode->vSendMsg.end() && nIov < MAX_SEND_IOV; ++itIov, ++nIov) {
+            const std::vector<char>& data = **itIov;
+            size_t nOffset = (nIov == 0 ? pnode->nSendOffset : 0);
+            iov[nIov].iov_base = (void*)&data[nOffset];
+            iov[nIov].iov_len = data.size() - nOffset;
+            nToSend += iov[nIov].iov_len;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = nIov;
+        int nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         if (nBytes > 0) {
             pnode->nLastSend = GetTime();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             pnode->RecordBytesSent(nBytes);
-            if (pnode->nSendOffset == data.size()) {
+
+            // Drop the messages that went out completely
+            size_t nSent = nBytes;
+            while (nSent > 0) {
+                size_t nLeft = (*it)->size() - pnode->nSendOffset;
+                if (nSent < nLeft) {
+                    pnode->nSendOffset += nSent;
+                    break;
+                }
+                nSent -= nLeft;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= (*it)->size();
                 it++;
-            } else {
-                // could not send full message; stop sending more
-                LogPrintf("socket send error: interruption\n");
+            }
+
+            if ((size_t)nBytes < nToSend) {
+                // the send buffer filled up, which is normal under load; stop sending more
+                LogPrint("net", "socket send buffer full after %d of %u bytes, peer=%d\n", nBytes, nToSend, pnode->id);
+                // With edge-triggered epoll the socket thread may already have
+                // seen the socket become writable again, leave the flag to it
+                if (!fOptimistic)
+                    pnode->fCanSendData = false;
                 IdleNodeCheck(pnode);
                 break;
             }
@@ -952,6 +1021,14 @@ void SocketSendData(CNode *pnode)
               break;
             }
 
+            // the send buffer is full, wait until the socket is writable again
+            int nErr = WSAGetLastError();
+            if (nErr == WSAEWOULDBLOCK || nErr == WSAEINTR) {
+                if (!fOptimistic)
+                    pnode->fCanSendData = false;
+                break;
+            }
+
             pnode->CloseSocketDisconnect();
             break;
         }
@@ -966,9 +1043,57 @@ void SocketSendData(CNode *pnode)
 
 static list<CNode*> vNodesDisconnected;
 
+SocketEventsMode InitSocketEvents(SocketEventsMode mode)
+{
+    if (!socketEvents.Init(mode))
+    {
+        LogPrintf("Socket events mode %s not available, using select\n", SocketEventsModeName(mode));
+        socketEvents.Init(SOCKETEVENTS_SELECT);
+    }
+    LogPrintf("Using %s for socket events\n", SocketEventsModeName(socketEvents.GetMode()));
+    return socketEvents.GetMode();
+}
+
+// Implement the following logic:
+// * If there is data to send, wait for sending data. As this only
+//   happens when optimistic write failed, we choose to first drain the
+//   write buffer in this case before receiving more. This avoids
+//   needlessly queueing received data, if the remote peer is not themselves
+//   receiving data. This means properly utilizing TCP flow control signalling.
+// * Otherwise, if there is no (complete) message in the receive buffer,
+//   or there is space left in the buffer, wait for receiving data.
+// * (if neither of the above applies, there is certainly one message
+//   in the receiver buffer ready to be processed).
+// Together, that means that at least one of the following is always possible,
+// so we don't deadlock:
+// * We send some data.
+// * We wait for data to be received (and disconnect after timeout).
+// * We process a message in the buffer (message handler thread).
+static void GetSocketInterest(CNode* pnode, bool& fWantRecv, bool& fWantSend)
+{
+    fWantRecv = false;
+    fWantSend = false;
+    {
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        if (lockSend && !pnode->vSendMsg.empty()) {
+            fWantSend = true;
+            return;
+        }
+    }
+    {
+        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+        if (lockRecv && (
+            pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+            pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+            fWantRecv = true;
+    }
+}
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    bool fMoreWork = false;
+    vector<CSocketEvent> vEvents;
     while (true)
     {
         //
@@ -1038,82 +1163,41 @@ void ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH(SOCKET hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket);
-            have_fds = true;
-        }
+        if (socketEvents.GetMode() == SOCKETEVENTS_SELECT)
         {
             LOCK(cs_vNodes);
             BOOST_FOREACH(CNode* pnode, vNodes)
             {
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
-                }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (
-                        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
+                bool fWantRecv, fWantSend;
+                GetSocketInterest(pnode, fWantRecv, fWantSend);
+                socketEvents.SetInterest(pnode->hSocket, fWantRecv, fWantSend);
             }
         }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        // Wake up to poll pnode->vSend, or straight away if a socket had
+        // more data than we read last time
+        int nTimeout = fMoreWork ? 0 : 50;
+        fMoreWork = false;
+        if (!socketEvents.Wait(nTimeout, vEvents))
+            MilliSleep(50);
         boost::this_thread::interruption_point();
 
-        if (nSelect == SOCKET_ERROR)
+        // Nodes are only deleted above, so the pointers are still good
+        set<SOCKET> setListenReady;
+        BOOST_FOREACH(const CSocketEvent& event, vEvents)
         {
-            if (have_fds)
+            if (event.pvData == NULL)
             {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %d\n", nErr);
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
+                setListenReady.insert(event.hSocket);
+                continue;
             }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec/1000);
+            CNode* pnode = (CNode*)event.pvData;
+            if (event.fRecv || event.fError)
+                pnode->fHasRecvData = true;
+            if (event.fSend)
+                pnode->fCanSendData = true;
         }
 
 
@@ -1121,7 +1205,7 @@ void ThreadSocketHandler()
         // Accept new connections
         //
         BOOST_FOREACH(SOCKET hListenSocket, vhListenSocket)
-        if (hListenSocket != INVALID_SOCKET && FD_ISSET(hListenSocket, &fdsetRecv))
+        if (hListenSocket != INVALID_SOCKET && setListenReady.count(hListenSocket))
         {
             struct sockaddr_storage sockaddr;
             socklen_t len = sizeof(sockaddr);
@@ -1168,6 +1252,12 @@ void ThreadSocketHandler()
                 LogPrint("net", "accepted connection %s\n", addr.ToString());
                 CNode* pnode = new CNode(hSocket, addr, "", true);
                 pnode->AddRef();
+                if (!socketEvents.Add(hSocket, pnode))
+                {
+                    LogPrintf("connection from %s dropped (too many sockets for %s)\n", addr.ToString(),
+                              SocketEventsModeName(socketEvents.GetMode()));
+                    pnode->CloseSocketDisconnect();
+                }
                 {
                     LOCK(cs_vNodes);
                     vNodes.push_back(pnode);
@@ -1195,7 +1285,12 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
+            bool fWantRecv = false;
+            bool fWantSend = false;
+            if (pnode->fHasRecvData || (pnode->fCanSendData && pnode->nSendSize > 0))
+                GetSocketInterest(pnode, fWantRecv, fWantSend);
+            bool fMessageComplete = false;
+            if (pnode->fHasRecvData && fWantRecv)
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
@@ -1211,11 +1306,17 @@ void ThreadSocketHandler()
                         int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
                         if (nBytes > 0)
                         {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, fMessageComplete))
                                 pnode->CloseSocketDisconnect();
                             pnode->nLastRecv = GetTime();
                             pnode->nRecvBytes += nBytes;
                             pnode->RecordBytesRecv(nBytes);
+
+                            // A full buffer may have left more behind
+                            if (nBytes < (int)sizeof(pchBuf))
+                                pnode->fHasRecvData = false;
+                            else
+                                fMoreWork = true;
                         }
                         else if (nBytes == 0)
                         {
@@ -1228,7 +1329,9 @@ void ThreadSocketHandler()
                         {
                             // error
                             int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+                            if (nErr == WSAEWOULDBLOCK)
+                                pnode->fHasRecvData = false;
+                            else if (nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
                             {
                                 if (!pnode->fDisconnect)
                                     LogPrintf("socket recv error %d\n", nErr);
@@ -1239,12 +1342,16 @@ void ThreadSocketHandler()
                 }
             }
 
+            // Only now that cs_vRecvMsg is free can the handler take the message
+            if (fMessageComplete)
+                WakeMessageHandler();
+
             //
             // Send
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend))
+            if (pnode->fCanSendData && fWantSend)
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
@@ -1767,11 +1874,35 @@ void static StartSync(const vector<CNode*> &vNodes) {
     }
 }
 
-void ThreadMessageHandler()
+// Message handler wakeups, counted so that a worker that was busy when
+// one came in still sees it
+static boost::mutex mutexMsgProc;
+static boost::condition_variable condMsgProc;
+static uint64_t nMsgProcWakeups = 0;
+
+void WakeMessageHandler()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(mutexMsgProc);
+        nMsgProcWakeups++;
+    }
+    condMsgProc.notify_all();
+}
+
+// Run by each of the -msghandlerthreads workers. A peer is served by one
+// worker at a time, so its messages stay in order; worker 0 also picks the
+// sync and trickle peers, so there are no more of those than with one.
+void ThreadMessageHandler(int nWorker)
 {
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
     while (true)
     {
+        uint64_t nWakeups;
+        {
+            boost::lock_guard<boost::mutex> lock(mutexMsgProc);
+            nWakeups = nMsgProcWakeups;
+        }
+
         bool fHaveSyncNode = false;
 
         vector<CNode*> vNodesCopy;
@@ -1785,12 +1916,12 @@ void ThreadMessageHandler()
             }
         }
 
-        if (!fHaveSyncNode)
+        if (nWorker == 0 && !fHaveSyncNode)
             StartSync(vNodesCopy);
 
         // Poll the connected nodes for messages
         CNode* pnodeTrickle = NULL;
-        if (!vNodesCopy.empty())
+        if (nWorker == 0 && !vNodesCopy.empty())
             pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
 
         bool fSleep = true;
@@ -1800,11 +1931,22 @@ void ThreadMessageHandler()
             if (pnode->fDisconnect)
                 continue;
 
+            // Another worker is serving this peer
+            bool fIdle = false;
+            if (!pnode->fInMessageHandler.compare_exchange_strong(fIdle, true))
+                continue;
+
             // Receive messages
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
                 {
+                    // Go round again after handling something, whatever it
+                    // relayed to the peers already passed goes out then
+                    if (pnode->nSendSize < SendBufferSize() &&
+                        (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete())))
+                        fSleep = false;
+
                     if (!g_signals.ProcessMessages(pnode))
                     {
                         pnode->CloseSocketDisconnect();
@@ -1822,14 +1964,6 @@ void ThreadMessageHandler()
                             }
                         }
                     }
-
-                    if (pnode->nSendSize < SendBufferSize())
-                    {
-                        if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
-                        {
-                            fSleep = false;
-                        }
-                    }
                 }
             }
             boost::this_thread::interruption_point();
@@ -1840,6 +1974,7 @@ void ThreadMessageHandler()
                 if (lockSend)
                     g_signals.SendMessages(pnode, pnode == pnodeTrickle);
             }
+            pnode->fInMessageHandler = false;
             boost::this_thread::interruption_point();
         }
 
@@ -1849,8 +1984,15 @@ void ThreadMessageHandler()
                 pnode->Release();
         }
 
+        // Sleep until a message comes in, or for the 100ms tick that keeps
+        // pings, trickling and sends over the buffer limit going
         if (fSleep)
-            MilliSleep(100);
+        {
+            boost::unique_lock<boost::mutex> lock(mutexMsgProc);
+            if (nMsgProcWakeups == nWakeups)
+                condMsgProc.timed_wait(lock, boost::posix_time::milliseconds(100));
+        }
+        boost::this_thread::interruption_point();
     }
 }
 
@@ -1961,6 +2103,13 @@ bool BindListenPort(const CService &addrBind, string& strError)
         return false;
     }
 
+    if (!socketEvents.Add(hListenSocket, NULL, true))
+    {
+        strError = strprintf("Error: Couldn't wait for incoming connections on %s", addrBind.ToString());
+        LogPrintf("%s\n", strError);
+        closesocket(hListenSocket);
+        return false;
+    }
     vhListenSocket.push_back(hListenSocket);
 
     if (addrBind.IsRoutable() && fDiscover)
@@ -2068,7 +2217,13 @@ void StartNode(boost::thread_group& threadGroup)
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "opencon", &ThreadOpenConnections));
 
     // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    int nMessageHandlerThreads = GetArg("-msghandlerthreads", DEFAULT_MESSAGE_HANDLER_THREADS);
+    nMessageHandlerThreads = max(1, min(nMessageHandlerThreads, MAX_MESSAGE_HANDLER_THREADS));
+    if (nMessageHandlerThreads > 1)
+        LogPrintf("Using %d message handler threads\n", nMessageHandlerThreads);
+    for (int i = 0; i < nMessageHandlerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "msghand",
+                                              boost::function<void()>(boost::bind(&ThreadMessageHandler, i))));
 
     // Dump network addresses
     threadGroup.create_thread(boost::bind(&LoopForever<void (*)()>, "dumpaddr", &DumpData, DUMP_ADDRESSES_INTERVAL * 1000));
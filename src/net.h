@@ -12,10 +12,12 @@
 #include "mruset.h"
 #include "netbase.h"
 #include "protocol.h"
+#include "socketevents.h"
 #include "sync.h"
 #include "uint256.h"
 #include "util.h"
 
+#include <atomic>
 #include <deque>
 #include <stdint.h>
 
@@ -25,6 +27,7 @@
 
 #include <boost/array.hpp>
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/signals2/signal.hpp>
 #include <openssl/rand.h>
 
@@ -57,10 +60,35 @@ static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
 static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
 /** The maximum number of new addresses to accumulate before announcing. */
 static const unsigned int MAX_ADDR_TO_SEND = 1000;
+/** Default for -maxconnections */
+static const int DEFAULT_MAX_PEER_CONNECTIONS = 125;
+/** File descriptors kept free for everything but peer connections */
+static const int MIN_CORE_FILEDESCRIPTORS = 150;
+/** Default for -msghandlerthreads */
+static const int DEFAULT_MESSAGE_HANDLER_THREADS = 1;
+/** Maximum for -msghandlerthreads */
+static const int MAX_MESSAGE_HANDLER_THREADS = 16;
 
 inline unsigned int ReceiveFloodSize() { return 1000*GetArg("-maxreceivebuffer", 5*1000); }
 inline unsigned int SendBufferSize() { return 1000*GetArg("-maxsendbuffer", 1*1000); }
 
+/** A complete message, header and payload, as it goes on the wire. It is not
+ *  changed once built, so one copy can sit in the send queue of every peer it
+ *  goes to. */
+typedef boost::shared_ptr<const std::vector<char> > CNetMessageRef;
+
+/** Fill in the size and checksum of a message serialized after its header, and take its buffer */
+CNetMessageRef FinishNetMessage(CVectorWriter& ss);
+
+/** Serialize a message once, to be pushed to any number of peers */
+template<typename T>
+CNetMessageRef MakeNetMessage(const char* pszCommand, const T& obj)
+{
+    CVectorWriter ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CMessageHeader(pszCommand, 0) << obj;
+    return FinishNetMessage(ss);
+}
+
 void AddOneShot(std::string strDest);
 bool RecvLine(SOCKET hSocket, std::string& strLine);
 void AddressCurrentlyConnected(const CService& addr);
@@ -75,7 +103,13 @@ unsigned short GetListenPort();
 bool BindListenPort(const CService &bindAddr, std::string& strError=REF(std::string()));
 void StartNode(boost::thread_group& threadGroup);
 bool StopNode();
-void SocketSendData(CNode *pnode);
+/** Send what is queued for pnode; requires cs_vSend. Only the socket handler
+  * thread clears fCanSendData, fOptimistic marks calls from other threads. */
+void SocketSendData(CNode *pnode, bool fOptimistic = false);
+/** Pick how the socket handler waits, falls back to select() if the mode cannot be set up */
+SocketEventsMode InitSocketEvents(SocketEventsMode mode);
+/** Have the message handler look at the peers now rather than on its next tick */
+void WakeMessageHandler();
 
 typedef int NodeId;
 
@@ -317,12 +351,19 @@ public:
     // socket
     uint64_t nServices;
     SOCKET hSocket;
-    CDataStream ssSend;
+    CVectorWriter ssSend;
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CNetMessageRef> vSendMsg;
     CCriticalSection cs_vSend;
+    // Readiness as last reported for the socket, cleared by the socket
+    // handler thread when a recv() or send() comes back short. Another
+    // thread clearing it could overwrite a readiness edge reported since.
+    std::atomic<bool> fHasRecvData;
+    std::atomic<bool> fCanSendData;
+    // Set while a message handler thread is serving this peer
+    std::atomic<bool> fInMessageHandler;
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
@@ -428,6 +469,9 @@ public:
         nRefCount = 0;
         nSendSize = 0;
         nSendOffset = 0;
+        fHasRecvData = false;
+        fCanSendData = false;
+        fInMessageHandler = false;
         hashContinue = 0;
         pindexLastGetBlocksBegin = 0;
         hashLastGetBlocksEnd = 0;
@@ -495,7 +539,7 @@ public:
     }
 
     // requires LOCK(cs_vRecvMsg)
-    bool ReceiveMsgBytes(const char *pch, unsigned int nBytes);
+    bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& fComplete);
 
     // requires LOCK(cs_vRecvMsg)
     void SetRecvVersion(int nVersionIn)
@@ -626,28 +670,32 @@ public:
         if (ssSend.size() == 0)
             return;
 
-        // Set the size
-        unsigned int nSize = ssSend.size() - CMessageHeader::HEADER_SIZE;
-        memcpy((char*)&ssSend[CMessageHeader::MESSAGE_SIZE_OFFSET], &nSize, sizeof(nSize));
-
-        // Set the checksum
-        uint256 hash = Hash_bmw512(ssSend.begin() + CMessageHeader::HEADER_SIZE, ssSend.end());
-        unsigned int nChecksum = 0;
-        memcpy(&nChecksum, &hash, sizeof(nChecksum));
-        assert(ssSend.size () >= CMessageHeader::CHECKSUM_OFFSET + sizeof(nChecksum));
-        memcpy((char*)&ssSend[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+        CNetMessageRef msg = FinishNetMessage(ssSend);
+        LogPrint("net", "(%d bytes)\n", msg->size() - CMessageHeader::HEADER_SIZE);
+        QueueMessage(msg);
 
-        LogPrint("net", "(%d bytes)\n", nSize);
+        LEAVE_CRITICAL_SECTION(cs_vSend);
+    }
 
-        std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-        ssSend.GetAndClear(*it);
-        nSendSize += (*it).size();
+    // requires LOCK(cs_vSend)
+    void QueueMessage(const CNetMessageRef& msg)
+    {
+        vSendMsg.push_back(msg);
+        nSendSize += msg->size();
 
         // If write queue empty, attempt "optimistic write"
-        if (it == vSendMsg.begin())
-            SocketSendData(this);
+        if (vSendMsg.size() == 1)
+            SocketSendData(this, true);
+    }
 
-        LEAVE_CRITICAL_SECTION(cs_vSend);
+    /** Queue a message built by MakeNetMessage(), sharing its buffer */
+    void PushMessage(const CNetMessageRef& msg)
+    {
+        LOCK(cs_vSend);
+        LogPrint("net", "sending: %s (%d bytes, shared)\n",
+                 std::string(&(*msg)[MESSAGE_START_SIZE], CMessageHeader::COMMAND_SIZE).c_str(),
+                 msg->size() - CMessageHeader::HEADER_SIZE);
+        QueueMessage(msg);
     }
 
     void PushVersion();
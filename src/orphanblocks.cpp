@@ -0,0 +1,170 @@
+// Copyright (c) 2026 The CampusCash developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "orphanblocks.h"
+
+#include "util.h"
+
+using namespace std;
+
+COrphanBlockPool::COrphanBlockPool() : nBytes(0), nRootEpoch(0)
+{
+}
+
+COrphanBlockPool::~COrphanBlockPool()
+{
+    for (map<uint256, COrphanBlock*>::iterator it = mapBlocks.begin(); it != mapBlocks.end(); ++it)
+        delete it->second;
+}
+
+COrphanBlock* COrphanBlockPool::Find(const uint256& hash) const
+{
+    map<uint256, COrphanBlock*>::const_iterator it = mapBlocks.find(hash);
+    return it == mapBlocks.end() ? NULL : it->second;
+}
+
+void COrphanBlockPool::AddLeaf(COrphanBlock* pblock)
+{
+    pblock->nLeafPos = vLeaves.size();
+    vLeaves.push_back(pblock);
+}
+
+void COrphanBlockPool::RemoveLeaf(COrphanBlock* pblock)
+{
+    // Move the last leaf into the hole
+    COrphanBlock* plast = vLeaves.back();
+    vLeaves[pblock->nLeafPos] = plast;
+    plast->nLeafPos = pblock->nLeafPos;
+    vLeaves.pop_back();
+}
+
+const COrphanBlock* COrphanBlockPool::Add(const uint256& hash, const uint256& hashPrev,
+                                          const pair<COutPoint, unsigned int>& stake, bool fProofOfStake,
+                                          const vector<unsigned char>& vchBlock)
+{
+    COrphanBlock* pblock = Find(hash);
+    if (pblock)
+        return pblock;
+
+    pblock = new COrphanBlock();
+    pblock->hashBlock = hash;
+    pblock->hashPrev = hashPrev;
+    pblock->stake = stake;
+    pblock->fProofOfStake = fProofOfStake;
+    pblock->vchBlock = vchBlock;
+    pblock->nChildren = 0;
+
+    // Hang it below its parent...
+    pblock->pprev = Find(hashPrev);
+    if (pblock->pprev)
+    {
+        if (pblock->pprev->nChildren++ == 0)
+            RemoveLeaf(pblock->pprev);
+        bool fRootValid = pblock->pprev->nRootEpoch == nRootEpoch;
+        pblock->hashRoot = fRootValid ? pblock->pprev->hashRoot : hashPrev;
+    }
+    else
+        pblock->hashRoot = hash;
+    pblock->nRootEpoch = nRootEpoch;
+
+    // ...and the children that came first below it
+    for (multimap<uint256, COrphanBlock*>::iterator mi = mapBlocksByPrev.lower_bound(hash);
+         mi != mapBlocksByPrev.upper_bound(hash); ++mi)
+    {
+        mi->second->pprev = pblock;
+        pblock->nChildren++;
+    }
+    if (pblock->nChildren == 0)
+        AddLeaf(pblock);
+
+    mapBlocks.insert(make_pair(hash, pblock));
+    mapBlocksByPrev.insert(make_pair(hashPrev, pblock));
+    if (fProofOfStake)
+        setStakeSeen.insert(stake);
+    nBytes += vchBlock.size();
+    return pblock;
+}
+
+void COrphanBlockPool::Remove(const uint256& hash)
+{
+    COrphanBlock* pblock = Find(hash);
+    if (!pblock)
+        return;
+
+    // Children start their own chains, and cached roots at or above this
+    // block no longer lead back to their descendants
+    if (pblock->nChildren > 0)
+        nRootEpoch++;
+    for (multimap<uint256, COrphanBlock*>::iterator mi = mapBlocksByPrev.lower_bound(hash);
+         mi != mapBlocksByPrev.upper_bound(hash); ++mi)
+        mi->second->pprev = NULL;
+
+    if (pblock->pprev && --pblock->pprev->nChildren == 0)
+        AddLeaf(pblock->pprev);
+    if (pblock->nChildren == 0)
+        RemoveLeaf(pblock);
+
+    for (multimap<uint256, COrphanBlock*>::iterator mi = mapBlocksByPrev.lower_bound(pblock->hashPrev);
+         mi != mapBlocksByPrev.upper_bound(pblock->hashPrev); ++mi)
+    {
+        if (mi->second == pblock)
+        {
+            mapBlocksByPrev.erase(mi);
+            break;
+        }
+    }
+    if (pblock->fProofOfStake)
+        setStakeSeen.erase(pblock->stake);
+    nBytes -= pblock->vchBlock.size();
+    mapBlocks.erase(hash);
+    delete pblock;
+}
+
+const COrphanBlock* COrphanBlockPool::GetRoot(const uint256& hash)
+{
+    COrphanBlock* pblock = Find(hash);
+    if (!pblock)
+        return NULL;
+
+    // A root cached in the current epoch is still an ancestor: evicting a
+    // leaf cannot cut the path to it. It may have gained orphan parents
+    // since, so carry on from there.
+    vector<COrphanBlock*> vVisited;
+    COrphanBlock* p = pblock;
+    while (p->pprev)
+    {
+        vVisited.push_back(p);
+        COrphanBlock* pcached = NULL;
+        if (p->nRootEpoch == nRootEpoch && p->hashRoot != p->hashBlock)
+            pcached = Find(p->hashRoot);
+        p = pcached ? pcached : p->pprev;
+    }
+
+    BOOST_FOREACH(COrphanBlock* pvisited, vVisited)
+    {
+        pvisited->hashRoot = p->hashBlock;
+        pvisited->nRootEpoch = nRootEpoch;
+    }
+    return p;
+}
+
+void COrphanBlockPool::GetChildren(const uint256& hashPrev, vector<uint256>& vHashes) const
+{
+    vHashes.clear();
+    for (multimap<uint256, COrphanBlock*>::const_iterator mi = mapBlocksByPrev.lower_bound(hashPrev);
+         mi != mapBlocksByPrev.upper_bound(hashPrev); ++mi)
+        vHashes.push_back(mi->second->hashBlock);
+}
+
+unsigned int COrphanBlockPool::Prune(size_t nMaxCount, size_t nMaxBytes, size_t nNewBytes)
+{
+    unsigned int nEvicted = 0;
+    while (!vLeaves.empty() && (mapBlocks.size() >= nMaxCount || nBytes + nNewBytes > nMaxBytes))
+    {
+        // Leaves only, evicting a block in the middle would strand its descendants
+        Remove(vLeaves[insecure_rand() % vLeaves.size()]->hashBlock);
+        nEvicted++;
+    }
+    return nEvicted;
+}
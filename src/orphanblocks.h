@@ -0,0 +1,87 @@
+// Copyright (c) 2026 The CampusCash developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_ORPHANBLOCKS_H
+#define BITCOIN_ORPHANBLOCKS_H
+
+#include "chain.h"
+#include "uint256.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+/** A block received before its parent, kept serialized until the parent arrives */
+struct COrphanBlock
+{
+    uint256 hashBlock;
+    uint256 hashPrev;
+    std::pair<COutPoint, unsigned int> stake;
+    bool fProofOfStake;
+    std::vector<unsigned char> vchBlock;
+
+    COrphanBlock* pprev;    // the parent, when it is an orphan too
+    unsigned int nChildren; // orphans whose parent this is
+    size_t nLeafPos;        // position in vLeaves while nChildren is 0
+    uint256 hashRoot;       // an orphan ancestor, the start of the chain when last looked up
+    uint64_t nRootEpoch;    // hashRoot is only trusted while this matches the pool's
+};
+
+/*
+ * COrphanBlockPool holds the orphan blocks. Besides the lookups by hash and
+ * by parent it keeps the orphans without orphan children in a vector, so a
+ * random one of them can be evicted in constant time without breaking a
+ * chain, and remembers for each orphan where its chain started, so finding
+ * the block to ask a peer for does not walk the whole chain every time.
+ *
+ * Bounded by count and by the serialized size of the blocks. Not locked,
+ * callers hold cs_main.
+ */
+class COrphanBlockPool
+{
+private:
+    std::map<uint256, COrphanBlock*> mapBlocks;
+    std::multimap<uint256, COrphanBlock*> mapBlocksByPrev;
+    std::vector<COrphanBlock*> vLeaves;
+    std::set<std::pair<COutPoint, unsigned int> > setStakeSeen;
+    size_t nBytes;
+    uint64_t nRootEpoch; // bumped whenever an orphan with orphan children goes
+
+    COrphanBlock* Find(const uint256& hash) const;
+    void AddLeaf(COrphanBlock* pblock);
+    void RemoveLeaf(COrphanBlock* pblock);
+
+public:
+    COrphanBlockPool();
+    ~COrphanBlockPool();
+
+    /** Store a serialized block, returns the stored copy */
+    const COrphanBlock* Add(const uint256& hash, const uint256& hashPrev,
+                            const std::pair<COutPoint, unsigned int>& stake, bool fProofOfStake,
+                            const std::vector<unsigned char>& vchBlock);
+    void Remove(const uint256& hash);
+
+    /** The orphan with this hash, or NULL */
+    const COrphanBlock* Get(const uint256& hash) const { return Find(hash); }
+
+    /** The first orphan of the chain hash belongs to, or NULL if hash is not an orphan */
+    const COrphanBlock* GetRoot(const uint256& hash);
+
+    /** Hashes of the orphans whose parent is hashPrev */
+    void GetChildren(const uint256& hashPrev, std::vector<uint256>& vHashes) const;
+
+    /** Evict random orphans without orphan children until there are fewer
+      * than nMaxCount left and nNewBytes more would fit under nMaxBytes.
+      * Returns the number evicted. */
+    unsigned int Prune(size_t nMaxCount, size_t nMaxBytes, size_t nNewBytes);
+
+    bool Contains(const uint256& hash) const { return mapBlocks.count(hash) != 0; }
+    bool HasChildren(const uint256& hashPrev) const { return mapBlocksByPrev.count(hashPrev) != 0; }
+    bool HasStake(const std::pair<COutPoint, unsigned int>& stake) const { return setStakeSeen.count(stake) != 0; }
+
+    size_t size() const { return mapBlocks.size(); }
+    size_t GetBytes() const { return nBytes; }
+    size_t GetLeafCount() const { return vLeaves.size(); }
+};
+
+#endif
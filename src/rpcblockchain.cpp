@@ -217,6 +217,40 @@ Value getrawmempool(const Array& params, bool fHelp)
     return a;
 }
 
+Value getmempoolinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getmempoolinfo\n"
+            "Returns details on the memory pool:\n"
+            "  size: number of transactions\n"
+            "  bytes: sum of the transactions' serialized sizes\n"
+            "  usage: approximate memory used by the pool, in bytes\n"
+            "  maxmempool: -maxmempool in bytes, the pool evicts the lowest fee rates above it");
+
+    Object obj;
+    obj.push_back(Pair("size", (uint64_t)mempool.size()));
+    obj.push_back(Pair("bytes", (uint64_t)mempool.GetTotalTxSize()));
+    obj.push_back(Pair("usage", (uint64_t)mempool.DynamicMemoryUsage()));
+    obj.push_back(Pair("maxmempool", (uint64_t)GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000));
+    return obj;
+}
+
+Value savemempool(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "savemempool\n"
+            "Writes the memory pool to mempool.dat in the data directory.");
+
+    if (!mempool.IsLoaded())
+        throw JSONRPCError(RPC_MISC_ERROR, "The mempool was not loaded yet");
+    if (!DumpMempool())
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to write mempool.dat");
+
+    return Value::null;
+}
+
 Value getblockhash(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -266,13 +300,7 @@ Value getblockbynumber(const Array& params, bool fHelp)
         throw runtime_error("Block number out of range.");
 
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hashBestChain];
-    while (pblockindex->nHeight > nHeight)
-        pblockindex = pblockindex->pprev;
-
-    uint256 hash = *pblockindex->phashBlock;
-
-    pblockindex = mapBlockIndex[hash];
+    CBlockIndex* pblockindex = FindBlockByHeight(nHeight);
     block.ReadFromDisk(pblockindex, true);
 
     return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
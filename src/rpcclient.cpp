@@ -161,6 +161,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "keypoolrefill", 0 },
     { "importprivkey", 2 },
     { "importaddress", 2 },
+    { "setgenerate", 0 },
+    { "setgenerate", 1 },
     { "checkkernel", 0 },
     { "checkkernel", 1 },
     { "setban", 2 },
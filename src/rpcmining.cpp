@@ -82,6 +82,42 @@ Value getstakesubsidy(const Array& params, bool fHelp)
     return (uint64_t)GetProofOfStakeReward(pindexBest, 0);
 }
 
+Value getgenerate(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getgenerate\n"
+            "Returns true or false, whether the node is mining proof-of-work blocks.");
+
+    return IsPoWMinerRunning();
+}
+
+Value setgenerate(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "setgenerate <generate> [genproclimit]\n"
+            "<generate> is true or false to turn proof-of-work mining on or off.\n"
+            "Mining uses [genproclimit] threads, -1 for one per core.");
+
+    bool fGenerate = true;
+    if (params.size() > 0)
+        fGenerate = params[0].get_bool();
+
+    int nGenProcLimit = GetArg("-genproclimit", DEFAULT_GENERATE_THREADS);
+    if (params.size() > 1)
+        nGenProcLimit = params[1].get_int();
+    if (nGenProcLimit == 0)
+        fGenerate = false;
+
+    assert(pwalletMain != NULL);
+    mapArgs["-gen"] = (fGenerate ? "1" : "0");
+    mapArgs["-genproclimit"] = itostr(nGenProcLimit);
+    GeneratePoWBlocks(fGenerate, pwalletMain, nGenProcLimit);
+
+    return Value::null;
+}
+
 Value getmininginfo(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -115,6 +151,19 @@ Value getmininginfo(const Array& params, bool fHelp)
     diff.push_back(Pair("search-interval", (int)nLastCoinStakeSearchInterval));
     obj.push_back(Pair("difficulty", diff));
 
+    vector<double> vHashRate = GetPoWHashRates();
+    Array threadrates;
+    double dHashRate = 0;
+    BOOST_FOREACH(double d, vHashRate)
+    {
+        threadrates.push_back((int64_t)d);
+        dHashRate += d;
+    }
+    obj.push_back(Pair("generate", IsPoWMinerRunning()));
+    obj.push_back(Pair("genproclimit", (int)GetArg("-genproclimit", DEFAULT_GENERATE_THREADS)));
+    obj.push_back(Pair("hashespersec", (int64_t)dHashRate));
+    obj.push_back(Pair("threadhashespersec", threadrates));
+
     obj.push_back(Pair("blockvalue-PoS", (uint64_t)nRewardPoS));
     obj.push_back(Pair("blockvalue-PoW", (uint64_t)nRewardPoW));
     obj.push_back(Pair("netmhashps",  GetPoWMHashPS()));
@@ -161,6 +210,9 @@ Value getstakinginfo(const Array& params, bool fHelp)
 
     obj.push_back(Pair("difficulty", GetDifficulty(GetLastBlockIndex(pindexBest, true))));
     obj.push_back(Pair("search-interval", (int)nLastCoinStakeSearchInterval));
+    obj.push_back(Pair("search-threads", nStakeThreads));
+    obj.push_back(Pair("search-time", (double)nLastCoinStakeSearchTime / 1000.0));
+    obj.push_back(Pair("search-kernels", nLastCoinStakeKernels));
 
     obj.push_back(Pair("weight", (uint64_t)nWeight));
     obj.push_back(Pair("netstakeweight", (uint64_t)nNetworkWeight));
@@ -542,6 +542,7 @@ Value signrawtransaction(const Array& params, bool fHelp)
         if (!VerifyScript(txin.scriptSig, prevPubKey, mergedTx, i, STANDARD_SCRIPT_VERIFY_FLAGS, 0))
             fComplete = false;
     }
+    mergedTx.InvalidateHash();
 
     Object result;
     CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
@@ -609,10 +610,6 @@ Value searchrawtransactions(const Array &params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid CampusCash address");
     CTxDestination dest = address.Get();
 
-    std::vector<uint256> vtxhash;
-    if (!FindTransactionsByDestination(dest, vtxhash))
-        throw JSONRPCError(RPC_DATABASE_ERROR, "Cannot search for address");
-
     int nSkip = 0;
     int nCount = 100;
     bool fVerbose = true;
@@ -623,18 +620,18 @@ Value searchrawtransactions(const Array &params, bool fHelp)
     if (params.size() > 3)
         nCount = params[3].get_int();
 
-    if (nSkip < 0)
-        nSkip += vtxhash.size();
-    if (nSkip < 0)
-        nSkip = 0;
     if (nCount < 0)
         nCount = 0;
 
+    // The address index is range scanned, so only the requested page is read
+    std::vector<uint256> vtxhash;
+    if (!FindTransactionsByDestination(dest, vtxhash, nSkip, nCount))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Cannot search for address");
+
     std::vector<uint256>::const_iterator it = vtxhash.begin();
-    while (it != vtxhash.end() && nSkip--) it++;
 
     Array result;
-    while (it != vtxhash.end() && nCount--) {
+    while (it != vtxhash.end()) {
         CTransaction tx;
         uint256 hashBlock;
         if (!GetTransaction(*it, tx, hashBlock))
@@ -248,6 +248,8 @@ static const CRPCCommand vRPCCommands[] =
     { "getinfo",                &getinfo,                true,      false,     false },
     { "getvelocityinfo",        &getvelocityinfo,        true,      false,     false },
     { "getrawmempool",          &getrawmempool,          true,      false,     false },
+    { "getmempoolinfo",         &getmempoolinfo,         true,      false,     false },
+    { "savemempool",            &savemempool,            true,      false,     false },
     { "getblock",               &getblock,               false,     false,     false },
     { "getblockbynumber",       &getblockbynumber,       false,     false,     false },
     { "getblockhash",           &getblockhash,           false,     false,     false },
@@ -270,6 +272,8 @@ static const CRPCCommand vRPCCommands[] =
     { "masternodelist",         &masternodelist,         true,      false,      false },
     
 #ifdef ENABLE_WALLET
+    { "getgenerate",            &getgenerate,            true,      false,     false },
+    { "setgenerate",            &setgenerate,            true,      true,      true },
     { "getmininginfo",          &getmininginfo,          true,      false,     false },
     { "getstakinginfo",         &getstakinginfo,         true,      false,     false },
     { "getnewaddress",          &getnewaddress,          true,      false,     true },
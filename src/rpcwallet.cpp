@@ -2721,6 +2721,8 @@ Value cclistcoins(const Array& params, bool fHelp)
         Object coutput;
         int64_t nHeight = nBestHeight - out.nDepth;
         CBlockIndex* pindex = FindBlockByHeight(nHeight);
+        if (!pindex)
+            continue;
 
         CTxDestination outputAddress;
         ExtractDestination(out.tx->vout[out.i].scriptPubKey, outputAddress);
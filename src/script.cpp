@@ -4,8 +4,6 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <boost/foreach.hpp>
-#include <boost/tuple/tuple.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
 
 using namespace std;
 using namespace boost;
@@ -2016,60 +2014,129 @@ bool EvalScript(vector<vector<unsigned char> >& stack, const CScript& script, un
 
 
 
-uint256 SignatureHash(CScript scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+namespace {
+
+/** Wrapper that serializes like CTransaction, but with the modifications
+ *  required for the signature hash done in-place, so SignatureHash does not
+ *  have to copy the transaction for every input it hashes
+ */
+class CTransactionSignatureSerializer
 {
-    if (nIn >= txTo.vin.size())
-    {
-        LogPrintf("ERROR: SignatureHash() : nIn=%d out of range\n", nIn);
-        return 1;
+private:
+    const CTransaction& txTo;  // reference to the spending transaction (the one being serialized)
+    const CScript& scriptCode; // output script being consumed
+    const unsigned int nIn;    // input index of txTo being signed
+    const bool fAnyoneCanPay;  // whether the hashtype has the SIGHASH_ANYONECANPAY flag set
+    const bool fHashSingle;    // whether the hashtype is SIGHASH_SINGLE
+    const bool fHashNone;      // whether the hashtype is SIGHASH_NONE
+
+public:
+    CTransactionSignatureSerializer(const CTransaction& txToIn, const CScript& scriptCodeIn, unsigned int nInIn, int nHashTypeIn) :
+        txTo(txToIn), scriptCode(scriptCodeIn), nIn(nInIn),
+        fAnyoneCanPay(!!(nHashTypeIn & SIGHASH_ANYONECANPAY)),
+        fHashSingle((nHashTypeIn & 0x1f) == SIGHASH_SINGLE),
+        fHashNone((nHashTypeIn & 0x1f) == SIGHASH_NONE) {}
+
+    /** Serialize the passed scriptCode, skipping OP_CODESEPARATORs
+     *  (the same bytes scriptCode.FindAndDelete(CScript(OP_CODESEPARATOR)) would leave) */
+    template<typename S>
+    void SerializeScriptCode(S &s, int nType, int nVersion) const {
+        CScript::const_iterator it = scriptCode.begin();
+        CScript::const_iterator itBegin = it;
+        opcodetype opcode;
+        unsigned int nCodeSeparators = 0;
+        while (scriptCode.GetOp(it, opcode)) {
+            if (opcode == OP_CODESEPARATOR)
+                nCodeSeparators++;
+        }
+        ::WriteCompactSize(s, scriptCode.size() - nCodeSeparators);
+        it = itBegin;
+        while (scriptCode.GetOp(it, opcode)) {
+            if (opcode == OP_CODESEPARATOR) {
+                s.write((char*)&itBegin[0], it-itBegin-1);
+                itBegin = it;
+            }
+        }
+        // A malformed push ends the scan; whatever follows is kept as it is
+        if (itBegin != scriptCode.end())
+            s.write((char*)&itBegin[0], scriptCode.end()-itBegin);
+    }
+
+    /** Serialize an input of txTo */
+    template<typename S>
+    void SerializeInput(S &s, unsigned int nInput, int nType, int nVersion) const {
+        // In case of SIGHASH_ANYONECANPAY, only the input being signed is serialized
+        if (fAnyoneCanPay)
+            nInput = nIn;
+        // Serialize the prevout
+        ::Serialize(s, txTo.vin[nInput].prevout, nType, nVersion);
+        // Serialize the script
+        if (nInput != nIn)
+            // Blank out other inputs' signatures
+            ::WriteCompactSize(s, 0);
+        else
+            SerializeScriptCode(s, nType, nVersion);
+        // Serialize the nSequence
+        if (nInput != nIn && (fHashSingle || fHashNone))
+            // let the others update at will
+            ::Serialize(s, (unsigned int)0, nType, nVersion);
+        else
+            ::Serialize(s, txTo.vin[nInput].nSequence, nType, nVersion);
     }
-    CTransaction txTmp(txTo);
 
-    // In case concatenating two scripts ends up with two codeseparators,
-    // or an extra one at the end, this prevents all those possible incompatibilities.
-    scriptCode.FindAndDelete(CScript(OP_CODESEPARATOR));
+    /** Serialize an output of txTo */
+    template<typename S>
+    void SerializeOutput(S &s, unsigned int nOutput, int nType, int nVersion) const {
+        if (fHashSingle && nOutput != nIn)
+            // Do not lock-in the txout payee at other indices as txin
+            ::Serialize(s, CTxOut(), nType, nVersion);
+        else
+            ::Serialize(s, txTo.vout[nOutput], nType, nVersion);
+    }
+
+    /** Serialize txTo */
+    template<typename S>
+    void Serialize(S &s, int nType, int nVersion) const {
+        // Serialize nVersion and nTime
+        ::Serialize(s, txTo.nVersion, nType, nVersion);
+        ::Serialize(s, txTo.nTime, nType, nVersion);
+        // Serialize vin
+        unsigned int nInputs = fAnyoneCanPay ? 1 : txTo.vin.size();
+        ::WriteCompactSize(s, nInputs);
+        for (unsigned int nInput = 0; nInput < nInputs; nInput++)
+             SerializeInput(s, nInput, nType, nVersion);
+        // Serialize vout
+        unsigned int nOutputs = fHashNone ? 0 : (fHashSingle ? nIn+1 : txTo.vout.size());
+        ::WriteCompactSize(s, nOutputs);
+        for (unsigned int nOutput = 0; nOutput < nOutputs; nOutput++)
+             SerializeOutput(s, nOutput, nType, nVersion);
+        // Serialize nLockTime
+        ::Serialize(s, txTo.nLockTime, nType, nVersion);
+    }
+};
 
-    // Blank out other inputs' signatures
-    for (unsigned int i = 0; i < txTmp.vin.size(); i++)
-        txTmp.vin[i].scriptSig = CScript();
-    txTmp.vin[nIn].scriptSig = scriptCode;
+} // anon namespace
 
-    // Blank out some of the outputs
-    if ((nHashType & 0x1f) == SIGHASH_NONE)
+uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+{
+    if (nIn >= txTo.vin.size())
     {
-        // Wildcard payee
-        txTmp.vout.clear();
-
-        // Let the others update at will
-        for (unsigned int i = 0; i < txTmp.vin.size(); i++)
-            if (i != nIn)
-                txTmp.vin[i].nSequence = 0;
+        LogPrintf("ERROR: SignatureHash() : nIn=%d out of range\n", nIn);
+        return 1;
     }
-    else if ((nHashType & 0x1f) == SIGHASH_SINGLE)
+
+    // Check for invalid use of SIGHASH_SINGLE
+    if ((nHashType & 0x1f) == SIGHASH_SINGLE)
     {
-        // Only lock-in the txout payee at same index as txin
-        unsigned int nOut = nIn;
-        if (nOut >= txTmp.vout.size())
+        if (nIn >= txTo.vout.size())
         {
-            LogPrintf("ERROR: SignatureHash() : nOut=%d out of range\n", nOut);
+            LogPrintf("ERROR: SignatureHash() : nOut=%d out of range\n", nIn);
             return 1;
         }
-        txTmp.vout.resize(nOut+1);
-        for (unsigned int i = 0; i < nOut; i++)
-            txTmp.vout[i].SetNull();
-
-        // Let the others update at will
-        for (unsigned int i = 0; i < txTmp.vin.size(); i++)
-            if (i != nIn)
-                txTmp.vin[i].nSequence = 0;
     }
 
-    // Blank out other inputs completely, not recommended for open transactions
-    if (nHashType & SIGHASH_ANYONECANPAY)
-    {
-        txTmp.vin[0] = txTmp.vin[nIn];
-        txTmp.vin.resize(1);
-    }
+    // Wrapper to serialize only the necessary parts of the transaction being signed
+    CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
@@ -2082,6 +2149,7 @@ bool SignSignature(const CKeyStore &keystore, const CScript& fromPubKey, CTransa
 {
     assert(nIn < txTo.vin.size());
     CTxIn& txin = txTo.vin[nIn];
+    txTo.InvalidateHash();
 
     // Leave out the signature from the hash, since a signature can't sign itself.
     // The checksig op will also drop the signatures from its hash.
@@ -2129,56 +2197,92 @@ bool SignSignature(const CKeyStore &keystore, const CTransaction& txFrom, CTrans
 // Valid signature cache, to avoid doing expensive ECDSA signature checking
 // twice for every transaction (once when accepted into memory pool, and
 // again when accepted into the block chain)
+//
+// Entries are SHA256(salt, signature hash, public key, signature), so every
+// entry takes 32 bytes and peers cannot predict where their signatures land.
+// The table is split into buckets of SIGCACHE_BUCKET_SIZE entries; a full
+// bucket evicts one of its entries chosen by the new entry's hash. Buckets
+// are spread over SIGCACHE_SHARDS locks so that script check threads rarely
+// wait on each other.
+
+static const unsigned int SIGCACHE_BUCKET_SIZE = 8;
+static const unsigned int SIGCACHE_SHARDS = 64;
 
 class CSignatureCache
 {
 private:
-     // sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
-    boost::shared_mutex cs_sigcache;
+    std::vector<uint256> vEntries; // zero marks a free slot
+    uint64_t nBuckets;
+    uint256 salt;
+    boost::shared_mutex cs_shard[SIGCACHE_SHARDS];
+
+    uint256 ComputeEntry(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey) const
+    {
+        uint256 entry;
+        CSHA256().Write(salt.begin(), 32).Write(hash.begin(), 32).Write(pubKey.begin(), pubKey.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+        return entry;
+    }
 
 public:
+    CSignatureCache()
+    {
+        int64_t nMaxCacheSize = std::min((int64_t)MAX_SIG_CACHE_SIZE, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE));
+        nBuckets = std::max((int64_t)0, nMaxCacheSize) * 1048576 / (sizeof(uint256) * SIGCACHE_BUCKET_SIZE);
+        vEntries.resize(nBuckets * SIGCACHE_BUCKET_SIZE);
+        salt = GetRandHash();
+    }
+
+    // fErase drops the entry on a hit, for callers that will not ask again
     bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey, bool fErase)
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        if (nBuckets == 0)
+            return false;
 
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
+        uint256 entry = ComputeEntry(hash, vchSig, pubKey);
+        uint64_t nBucket = entry.Get64(0) % nBuckets;
+        uint256* pbucket = &vEntries[nBucket * SIGCACHE_BUCKET_SIZE];
+
+        if (!fErase)
+        {
+            boost::shared_lock<boost::shared_mutex> lock(cs_shard[nBucket % SIGCACHE_SHARDS]);
+            for (unsigned int i = 0; i < SIGCACHE_BUCKET_SIZE; i++)
+                if (pbucket[i] == entry)
+                    return true;
+            return false;
+        }
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_shard[nBucket % SIGCACHE_SHARDS]);
+        for (unsigned int i = 0; i < SIGCACHE_BUCKET_SIZE; i++)
+        {
+            if (pbucket[i] == entry)
+            {
+                pbucket[i] = 0;
+                return true;
+            }
+        }
         return false;
     }
 
     void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
     {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
+        if (nBuckets == 0)
+            return;
 
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        uint256 entry = ComputeEntry(hash, vchSig, pubKey);
+        uint64_t nBucket = entry.Get64(0) % nBuckets;
+        uint256* pbucket = &vEntries[nBucket * SIGCACHE_BUCKET_SIZE];
 
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
+        boost::unique_lock<boost::shared_mutex> lock(cs_shard[nBucket % SIGCACHE_SHARDS]);
+        unsigned int nSlot = entry.Get64(1) % SIGCACHE_BUCKET_SIZE;
+        for (unsigned int i = 0; i < SIGCACHE_BUCKET_SIZE; i++)
         {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
+            if (pbucket[i] == entry)
+                return;
+            if (pbucket[i] == 0)
+                nSlot = i;
         }
-
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+        pbucket[nSlot] = entry;
     }
 };
 
@@ -2202,7 +2306,9 @@ bool CheckSig(vector<unsigned char> vchSig, const vector<unsigned char> &vchPubK
 
     uint256 sighash = SignatureHash(scriptCode, txTo, nIn, nHashType);
 
-    if (signatureCache.Get(sighash, vchSig, pubkey))
+    // Signatures checked for the memory pool are found here again when the
+    // block arrives; blocks only read the cache, and free what they used
+    if (signatureCache.Get(sighash, vchSig, pubkey, flags & SCRIPT_VERIFY_NOCACHE))
         return true;
 
     if (!pubkey.Verify(sighash, vchSig))
@@ -2656,30 +2762,6 @@ bool ExtractDestinations(const CScript& scriptPubKey, txnouttype& typeRet, vecto
     return true;
 }
 
-/*uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
-{
-    if (nIn >= txTo.vin.size()) {
-        //  nIn out of range
-        return 1;
-    }
-
-    // Check for invalid use of SIGHASH_SINGLE
-    if ((nHashType & 0x1f) == SIGHASH_SINGLE) {
-        if (nIn >= txTo.vout.size()) {
-            //  nOut out of range
-            return 1;
-        }
-    }
-
-    // Wrapper to serialize only the necessary parts of the transaction being signed
-    CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
-
-    // Serialize and hash
-    CHashWriter ss(SER_GETHASH, 0);
-    ss << txTmp << nHashType;
-    return ss.GetHash();
-}*/
-
 bool SignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     return pubkey.Verify(sighash, vchSig);
@@ -2801,6 +2883,7 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigne
 {
     assert(nIn < txTo.vin.size());
     CTxIn& txin = txTo.vin[nIn];
+    txTo.InvalidateHash();
 
     // Leave out the signature from the hash, since a signature can't sign itself.
     // The checksig op will also drop the signatures from its hash.
@@ -97,7 +97,7 @@ enum
 enum
 {
     SCRIPT_VERIFY_NONE      = 0,
-    SCRIPT_VERIFY_NOCACHE   = (1U << 0),
+
     // Evaluate P2SH subscripts (softfork safe, BIP16).
     SCRIPT_VERIFY_P2SH      = (1U << 0),
 
@@ -134,10 +134,18 @@ enum
     // discouraged NOPs fails the script. This verification flag will never be
     // a mandatory flag applied to scripts in a block. NOPs that are not
     // executed, e.g.  within an unexecuted IF ENDIF block, are *not* rejected.
-    SCRIPT_VERIFY_DISCOURAGE_UPGRADABLE_NOPS  = (1U << 7)
+    SCRIPT_VERIFY_DISCOURAGE_UPGRADABLE_NOPS  = (1U << 7),
 
+    // Not a script rule: look valid signatures up in the signature cache, but
+    // do not add new ones (used when connecting blocks)
+    SCRIPT_VERIFY_NOCACHE   = (1U << 31)
 };
 
+/** Default for -maxsigcachesize, signature cache size in megabytes */
+static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+/** Maximum for -maxsigcachesize */
+static const unsigned int MAX_SIG_CACHE_SIZE = 1024;
+
 /** IsMine() return codes */
 enum isminetype
 {
@@ -998,7 +1006,7 @@ CScript GetScriptForMultisig(int nRequired, const std::vector<CPubKey>& keys);
 
 bool Solver(const CKeyStore& keystore, const CScript& scriptPubKey, uint256 hash, int nHashType,
                   CScript& scriptSigRet, txnouttype& whichTypeRet);
-//uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
+uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType);
 
 
 class BaseSignatureChecker
@@ -894,6 +894,56 @@ public:
     }
 };
 
+/** Write-only stream into a plain std::vector<char>.
+ *
+ * For data that is public anyway, such as outgoing network messages, where
+ * zeroing the buffer on free the way CDataStream does is wasted work.
+ */
+class CVectorWriter
+{
+protected:
+    typedef std::vector<char> vector_type;
+    vector_type vch;
+
+public:
+    int nType;
+    int nVersion;
+
+    CVectorWriter(int nTypeIn, int nVersionIn) : nType(nTypeIn), nVersion(nVersionIn) {}
+
+    size_t size() const                 { return vch.size(); }
+    bool empty() const                  { return vch.empty(); }
+    void reserve(size_t n)              { vch.reserve(n); }
+    void clear()                        { vch.clear(); }
+    char& operator[](size_t pos)        { return vch[pos]; }
+    const char* data() const            { return vch.empty() ? NULL : &vch[0]; }
+
+    void SetType(int n)                 { nType = n; }
+    int GetType()                       { return nType; }
+    void SetVersion(int n)              { nVersion = n; }
+    int GetVersion()                    { return nVersion; }
+
+    CVectorWriter& write(const char* pch, size_t nSize)
+    {
+        vch.insert(vch.end(), pch, pch + nSize);
+        return (*this);
+    }
+
+    template<typename T>
+    CVectorWriter& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+
+    /** Hand over the buffer without copying it, leaving the stream empty */
+    void GetAndClear(vector_type& data)
+    {
+        data.clear();
+        data.swap(vch);
+    }
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
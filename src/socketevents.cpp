@@ -0,0 +1,240 @@
+// Copyright (c) 2026 The CampusCash developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "socketevents.h"
+
+#include "util.h"
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+using namespace std;
+
+bool ParseSocketEventsMode(const string& strMode, SocketEventsMode& mode)
+{
+    if (strMode == "select")
+    {
+        mode = SOCKETEVENTS_SELECT;
+        return true;
+    }
+#ifdef USE_EPOLL
+    if (strMode == "epoll")
+    {
+        mode = SOCKETEVENTS_EPOLL;
+        return true;
+    }
+#endif
+    return false;
+}
+
+string SocketEventsModeName(SocketEventsMode mode)
+{
+    switch (mode)
+    {
+    case SOCKETEVENTS_SELECT: return "select";
+    case SOCKETEVENTS_EPOLL: return "epoll";
+    }
+    return "unknown";
+}
+
+CSocketEvents::CSocketEvents() : mode(SOCKETEVENTS_SELECT), hEpoll(-1)
+{
+}
+
+CSocketEvents::~CSocketEvents()
+{
+#ifdef USE_EPOLL
+    if (hEpoll != -1)
+        close(hEpoll);
+#endif
+}
+
+bool CSocketEvents::Init(SocketEventsMode modeIn)
+{
+#ifdef USE_EPOLL
+    if (modeIn == SOCKETEVENTS_EPOLL && hEpoll == -1)
+    {
+        hEpoll = epoll_create1(EPOLL_CLOEXEC);
+        if (hEpoll == -1)
+        {
+            LogPrintf("CSocketEvents::Init : epoll_create1 failed, error %d\n", errno);
+            return false;
+        }
+    }
+#else
+    if (modeIn == SOCKETEVENTS_EPOLL)
+        return false;
+#endif
+    mode = modeIn;
+    return true;
+}
+
+bool CSocketEvents::Add(SOCKET hSocket, void* pvData, bool fListen)
+{
+    LOCK(cs);
+    if (mode == SOCKETEVENTS_SELECT)
+    {
+#ifdef WIN32
+        // A winsock fd_set is a list of handles, not a bitmap
+        if (mapSockets.size() >= FD_SETSIZE)
+            return false;
+#else
+        if (hSocket >= FD_SETSIZE)
+            return false;
+#endif
+    }
+#ifdef USE_EPOLL
+    else
+    {
+        struct epoll_event event;
+        event.events = fListen ? EPOLLIN : (EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+        event.data.fd = hSocket;
+        if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, hSocket, &event) == -1)
+        {
+            LogPrintf("CSocketEvents::Add : epoll_ctl failed, error %d\n", errno);
+            return false;
+        }
+    }
+#endif
+
+    CSocketInterest& interest = mapSockets[hSocket];
+    interest.pvData = pvData;
+    interest.fRecv = true;
+    interest.fSend = false;
+    return true;
+}
+
+void CSocketEvents::Remove(SOCKET hSocket)
+{
+    LOCK(cs);
+    if (!mapSockets.erase(hSocket))
+        return;
+#ifdef USE_EPOLL
+    // Closing the socket would do this too, unless it was duplicated
+    if (mode == SOCKETEVENTS_EPOLL)
+        epoll_ctl(hEpoll, EPOLL_CTL_DEL, hSocket, NULL);
+#endif
+}
+
+void CSocketEvents::SetInterest(SOCKET hSocket, bool fRecv, bool fSend)
+{
+    if (mode != SOCKETEVENTS_SELECT)
+        return;
+    LOCK(cs);
+    map<SOCKET, CSocketInterest>::iterator it = mapSockets.find(hSocket);
+    if (it != mapSockets.end())
+    {
+        it->second.fRecv = fRecv;
+        it->second.fSend = fSend;
+    }
+}
+
+bool CSocketEvents::Wait(int nTimeoutMs, vector<CSocketEvent>& vEvents)
+{
+    vEvents.clear();
+    if (mode == SOCKETEVENTS_EPOLL)
+        return WaitEpoll(nTimeoutMs, vEvents);
+    return WaitSelect(nTimeoutMs, vEvents);
+}
+
+bool CSocketEvents::WaitSelect(int nTimeoutMs, vector<CSocketEvent>& vEvents)
+{
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+
+    vector<pair<SOCKET, void*> > vSockets;
+    {
+        LOCK(cs);
+        vSockets.reserve(mapSockets.size());
+        for (map<SOCKET, CSocketInterest>::const_iterator it = mapSockets.begin(); it != mapSockets.end(); ++it)
+        {
+            SOCKET hSocket = it->first;
+            FD_SET(hSocket, &fdsetError);
+            if (it->second.fRecv)
+                FD_SET(hSocket, &fdsetRecv);
+            if (it->second.fSend)
+                FD_SET(hSocket, &fdsetSend);
+            hSocketMax = max(hSocketMax, hSocket);
+            vSockets.push_back(make_pair(hSocket, it->second.pvData));
+        }
+    }
+    if (vSockets.empty())
+    {
+        MilliSleep(nTimeoutMs);
+        return true;
+    }
+
+    struct timeval timeout;
+    timeout.tv_sec  = nTimeoutMs / 1000;
+    timeout.tv_usec = (nTimeoutMs % 1000) * 1000;
+    int nSelect = select(hSocketMax + 1, &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (nSelect == SOCKET_ERROR)
+    {
+        // Report everything readable, recv() will find the bad socket
+        LogPrintf("socket select error %d\n", WSAGetLastError());
+        for (unsigned int i = 0; i < vSockets.size(); i++)
+        {
+            CSocketEvent event = { vSockets[i].first, vSockets[i].second, true, false, false };
+            vEvents.push_back(event);
+        }
+        return false;
+    }
+
+    for (unsigned int i = 0; i < vSockets.size() && nSelect > 0; i++)
+    {
+        SOCKET hSocket = vSockets[i].first;
+        CSocketEvent event;
+        event.hSocket = hSocket;
+        event.pvData = vSockets[i].second;
+        event.fRecv = FD_ISSET(hSocket, &fdsetRecv);
+        event.fSend = FD_ISSET(hSocket, &fdsetSend);
+        event.fError = FD_ISSET(hSocket, &fdsetError);
+        if (event.fRecv || event.fSend || event.fError)
+            vEvents.push_back(event);
+    }
+    return true;
+}
+
+bool CSocketEvents::WaitEpoll(int nTimeoutMs, vector<CSocketEvent>& vEvents)
+{
+#ifdef USE_EPOLL
+    // Anything left over is reported by the next call
+    struct epoll_event events[1024];
+    int nEvents = epoll_wait(hEpoll, events, sizeof(events) / sizeof(events[0]), nTimeoutMs);
+    if (nEvents == -1)
+    {
+        if (errno == EINTR)
+            return true;
+        LogPrintf("socket epoll_wait error %d\n", errno);
+        return false;
+    }
+
+    LOCK(cs);
+    vEvents.reserve(nEvents);
+    for (int i = 0; i < nEvents; i++)
+    {
+        // Removed while we were waiting
+        map<SOCKET, CSocketInterest>::const_iterator it = mapSockets.find(events[i].data.fd);
+        if (it == mapSockets.end())
+            continue;
+
+        CSocketEvent event;
+        event.hSocket = it->first;
+        event.pvData = it->second.pvData;
+        event.fRecv = events[i].events & (EPOLLIN | EPOLLRDHUP);
+        event.fSend = events[i].events & EPOLLOUT;
+        event.fError = events[i].events & (EPOLLERR | EPOLLHUP);
+        vEvents.push_back(event);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2026 The CampusCash developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_SOCKETEVENTS_H
+#define BITCOIN_SOCKETEVENTS_H
+
+#include "compat.h"
+#include "sync.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#define USE_EPOLL
+#endif
+
+enum SocketEventsMode
+{
+    SOCKETEVENTS_SELECT,
+    SOCKETEVENTS_EPOLL,
+};
+
+/** Default for -socketevents */
+#ifdef USE_EPOLL
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SOCKETEVENTS_EPOLL;
+#else
+static const SocketEventsMode DEFAULT_SOCKETEVENTS = SOCKETEVENTS_SELECT;
+#endif
+
+/** Parse a -socketevents value, false if unknown or not built in */
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& mode);
+std::string SocketEventsModeName(SocketEventsMode mode);
+
+/** Readiness reported by CSocketEvents::Wait */
+struct CSocketEvent
+{
+    SOCKET hSocket;
+    void* pvData;
+    bool fRecv;
+    bool fSend;
+    bool fError;
+};
+
+/*
+ * CSocketEvents waits for a set of sockets to become readable or writable.
+ *
+ * With select() the fd_sets are rebuilt on every wait from what each socket
+ * was last told to wait for with SetInterest(), and a socket's descriptor
+ * must be below FD_SETSIZE. With epoll the sockets are registered once,
+ * edge-triggered for reading and writing, so Wait() only reports sockets
+ * whose state changed and the caller has to remember readiness until a
+ * recv() or send() comes back short. SetInterest() does nothing then.
+ * Listening sockets are always waited on for reading, level-triggered.
+ *
+ * Add() and Remove() may be called from any thread. pvData has to stay
+ * valid until the Wait() after its socket's Remove() has returned.
+ */
+class CSocketEvents
+{
+private:
+    struct CSocketInterest
+    {
+        void* pvData;
+        bool fRecv; // select() only
+        bool fSend; // select() only
+    };
+
+    SocketEventsMode mode;
+    int hEpoll;
+
+    CCriticalSection cs;
+    std::map<SOCKET, CSocketInterest> mapSockets;
+
+    bool WaitSelect(int nTimeoutMs, std::vector<CSocketEvent>& vEvents);
+    bool WaitEpoll(int nTimeoutMs, std::vector<CSocketEvent>& vEvents);
+
+public:
+    CSocketEvents();
+    ~CSocketEvents();
+
+    /** False if the mode is not available, the mode is left unchanged then */
+    bool Init(SocketEventsMode modeIn);
+    SocketEventsMode GetMode() const { return mode; }
+
+    /** Start watching a socket, false if this mode cannot take it */
+    bool Add(SOCKET hSocket, void* pvData, bool fListen = false);
+    void Remove(SOCKET hSocket);
+
+    /** What to wait for on the next select(), reading only after Add() */
+    void SetInterest(SOCKET hSocket, bool fRecv, bool fSend);
+
+    /** Wait up to nTimeoutMs for events, false on error */
+    bool Wait(int nTimeoutMs, std::vector<CSocketEvent>& vEvents);
+};
+
+#endif
@@ -0,0 +1,208 @@
+#include <boost/test/unit_test.hpp>
+
+#include "blockdownload.h"
+
+#include <limits>
+
+using namespace std;
+
+static const int64_t nForever = std::numeric_limits<int64_t>::max();
+
+static uint256 BlockHash(int n)
+{
+    return uint256(n + 1);
+}
+
+static CBlock MakeBlock(const uint256& hashPrev, unsigned int nNonce)
+{
+    CBlock block;
+    block.hashPrevBlock = hashPrev;
+    block.nNonce = nNonce;
+    return block;
+}
+
+static vector<int> Heights(const vector<CBlockToDownload>& vBlocks)
+{
+    vector<int> vHeights;
+    BOOST_FOREACH(const CBlockToDownload& entry, vBlocks)
+        vHeights.push_back(entry.nHeight);
+    return vHeights;
+}
+
+BOOST_AUTO_TEST_SUITE(blockdownload_tests)
+
+// Peers get what they announced, and blocks with a height they should have
+BOOST_AUTO_TEST_CASE(blockdownload_find_next)
+{
+    CBlockDownloadQueue queue;
+    for (int i = 1; i <= 20; i++)
+        BOOST_REQUIRE(queue.Add(BlockHash(i), 1, i, 1000));
+    BOOST_CHECK(!queue.Add(BlockHash(5), 2, 5, 1000));
+    BOOST_REQUIRE(queue.Add(BlockHash(100), 2, -1, 1000));
+    BOOST_CHECK_EQUAL(queue.size(), 21U);
+
+    vector<CBlockToDownload> vBlocks;
+    queue.FindNext(1, 1000, 1000, nForever, 5, vBlocks);
+    BOOST_CHECK_EQUAL(vBlocks.size(), 5U);
+    BOOST_CHECK_EQUAL(vBlocks.front().nHeight, 1);
+    BOOST_CHECK_EQUAL(vBlocks.back().nHeight, 5);
+
+    // Another peer only gets up to the height it has, and its own announcement
+    vBlocks.clear();
+    queue.FindNext(2, 3, 1000, nForever, 100, vBlocks);
+    BOOST_REQUIRE_EQUAL(vBlocks.size(), 4U);
+    BOOST_CHECK(vBlocks[0].hash == BlockHash(100));
+    BOOST_CHECK_EQUAL(vBlocks[3].nHeight, 3);
+
+    // Nothing past the window end is handed out
+    vBlocks.clear();
+    queue.FindNext(1, 1000, 10, nForever, 100, vBlocks);
+    BOOST_CHECK_EQUAL(vBlocks.size(), 10U);
+
+    // Blocks queued later than nQueuedBefore stay with their announcer
+    vBlocks.clear();
+    queue.FindNext(2, 1000, 1000, 999, 100, vBlocks);
+    BOOST_REQUIRE_EQUAL(vBlocks.size(), 1U);
+    BOOST_CHECK(vBlocks[0].hash == BlockHash(100));
+    vBlocks.clear();
+    queue.FindNext(2, 1000, 1000, 1000, 100, vBlocks);
+    BOOST_CHECK_EQUAL(vBlocks.size(), 21U);
+
+    NodeId nodeFrom;
+    BOOST_CHECK(queue.Remove(BlockHash(100), nodeFrom));
+    BOOST_CHECK_EQUAL(nodeFrom, 2);
+    BOOST_CHECK(!queue.Remove(BlockHash(100), nodeFrom));
+    BOOST_CHECK(!queue.Contains(BlockHash(100)));
+}
+
+// Whatever order they are announced in, blocks are handed out by height,
+// those without one first, so nothing below the window end is missed
+BOOST_AUTO_TEST_CASE(blockdownload_height_order)
+{
+    CBlockDownloadQueue queue;
+    int nHeights[] = {5, 3, 9, -1, 4, 3, 12, -1, 1};
+    for (unsigned int i = 0; i < sizeof(nHeights) / sizeof(nHeights[0]); i++)
+        BOOST_REQUIRE(queue.Add(BlockHash(i), 1, nHeights[i], 1000));
+
+    vector<CBlockToDownload> vBlocks;
+    queue.FindNext(1, 1000, 1000, nForever, 100, vBlocks);
+    int nExpected[] = {-1, -1, 1, 3, 3, 4, 5, 9, 12};
+    vector<int> vHeights = Heights(vBlocks);
+    BOOST_CHECK_EQUAL_COLLECTIONS(vHeights.begin(), vHeights.end(), nExpected, nExpected + 9);
+    BOOST_CHECK(vBlocks[0].hash == BlockHash(3) && vBlocks[1].hash == BlockHash(7));
+    BOOST_CHECK(vBlocks[3].hash == BlockHash(1) && vBlocks[4].hash == BlockHash(5));
+
+    // A block taken back goes ahead of those at its height
+    NodeId nodeFrom;
+    BOOST_REQUIRE(queue.Remove(BlockHash(4), nodeFrom));
+    BOOST_REQUIRE(queue.PushFront(BlockHash(4), 3, 2000));
+    vBlocks.clear();
+    queue.FindNext(2, 1000, 3, nForever, 100, vBlocks);
+    BOOST_REQUIRE_EQUAL(vBlocks.size(), 4U);
+    BOOST_CHECK(vBlocks[1].hash == BlockHash(4));
+    BOOST_CHECK_EQUAL(vBlocks[3].nHeight, 3);
+}
+
+// A block taken back goes to the front, for any peer, and a slow peer only
+// gets it back when nobody else took it up
+BOOST_AUTO_TEST_CASE(blockdownload_reassign)
+{
+    CBlockDownloadQueue queue;
+    for (int i = 2; i <= 5; i++)
+        BOOST_REQUIRE(queue.Add(BlockHash(i), 1, i, 1000));
+
+    BOOST_CHECK(!queue.PushFront(BlockHash(1), -1, 2000));
+    BOOST_CHECK(!queue.PushFront(BlockHash(3), 3, 2000));
+    BOOST_REQUIRE(queue.PushFront(BlockHash(1), 1, 2000));
+
+    vector<CBlockToDownload> vBlocks;
+    queue.FindNext(3, 1000, 1000, nForever, 100, vBlocks);
+    vector<int> vExpected;
+    for (int i = 1; i <= 5; i++)
+        vExpected.push_back(i);
+    vector<int> vHeights = Heights(vBlocks);
+    BOOST_CHECK_EQUAL_COLLECTIONS(vHeights.begin(), vHeights.end(), vExpected.begin(), vExpected.end());
+    BOOST_CHECK_EQUAL(vBlocks[0].nodeFrom, -1);
+
+    // The stalling peer that gave it back, alone: not before the timeout
+    vBlocks.clear();
+    queue.FindNext(1, 1000, 1000, 1999, 100, vBlocks);
+    BOOST_CHECK_EQUAL(vBlocks.size(), 4U);
+    BOOST_CHECK_EQUAL(vBlocks[0].nHeight, 2);
+    vBlocks.clear();
+    queue.FindNext(1, 1000, 1000, 2000, 100, vBlocks);
+    BOOST_CHECK_EQUAL(vBlocks.size(), 5U);
+    BOOST_CHECK_EQUAL(vBlocks[0].nHeight, 1);
+}
+
+// What a departed peer announced stays if others can fetch it
+BOOST_AUTO_TEST_CASE(blockdownload_forget_node)
+{
+    CBlockDownloadQueue queue;
+    BOOST_REQUIRE(queue.Add(BlockHash(1), 1, 1, 1000));
+    BOOST_REQUIRE(queue.Add(BlockHash(2), 1, -1, 1000));
+    BOOST_REQUIRE(queue.Add(BlockHash(3), 2, -1, 1000));
+
+    BOOST_CHECK_EQUAL(queue.ForgetNode(1), 1U);
+    BOOST_CHECK_EQUAL(queue.size(), 2U);
+    BOOST_CHECK(!queue.Contains(BlockHash(2)));
+
+    NodeId nodeFrom;
+    BOOST_CHECK(queue.Remove(BlockHash(1), nodeFrom));
+    BOOST_CHECK_EQUAL(nodeFrom, -1);
+    BOOST_CHECK(queue.Remove(BlockHash(3), nodeFrom));
+    BOOST_CHECK_EQUAL(nodeFrom, 2);
+}
+
+BOOST_AUTO_TEST_CASE(blockdownload_buffer)
+{
+    CBlockBuffer buffer;
+    CBlock block1 = MakeBlock(BlockHash(0), 1);
+    CBlock block2 = MakeBlock(block1.GetHash(), 2);
+    CBlock block3 = MakeBlock(block2.GetHash(), 3);
+    CBlock blockOther = MakeBlock(block1.GetHash(), 4);
+
+    BOOST_REQUIRE(buffer.Add(block3, 3));
+    BOOST_REQUIRE(buffer.Add(block2, 2));
+    BOOST_CHECK(!buffer.Add(block2, 2));
+    BOOST_CHECK(!buffer.Add(blockOther, 2));
+    BOOST_CHECK_EQUAL(buffer.size(), 2U);
+    BOOST_CHECK(buffer.Contains(block3.GetHash()) && !buffer.Contains(blockOther.GetHash()));
+    BOOST_CHECK(buffer.HasChildOf(block1.GetHash()) && !buffer.HasChildOf(BlockHash(0)));
+
+    // Once the parent is in, its children come out in chain order
+    CBufferedBlock buffered;
+    BOOST_CHECK(!buffer.TakeChildOf(BlockHash(0), buffered));
+    BOOST_REQUIRE(buffer.TakeChildOf(block1.GetHash(), buffered));
+    BOOST_CHECK(buffered.hashBlock == block2.GetHash());
+    BOOST_CHECK_EQUAL(buffered.nodeFrom, 2);
+    BOOST_REQUIRE(buffer.TakeChildOf(buffered.hashBlock, buffered));
+    BOOST_CHECK(buffered.block.GetHash() == block3.GetHash());
+    BOOST_CHECK_EQUAL(buffered.nodeFrom, 3);
+    BOOST_CHECK_EQUAL(buffer.size(), 0U);
+    BOOST_CHECK(!buffer.Contains(block3.GetHash()));
+}
+
+// The block held longest goes first, whatever the hash of its parent
+BOOST_AUTO_TEST_CASE(blockdownload_buffer_oldest)
+{
+    CBlockBuffer buffer;
+    vector<uint256> vHashes;
+    for (int i = 0; i < 50; i++)
+    {
+        CBlock block = MakeBlock(GetRandHash(), i);
+        vHashes.push_back(block.GetHash());
+        BOOST_REQUIRE(buffer.Add(block, i));
+    }
+
+    CBufferedBlock buffered;
+    for (int i = 0; i < 50; i++)
+    {
+        BOOST_REQUIRE(buffer.TakeOldest(buffered));
+        BOOST_CHECK(buffered.hashBlock == vHashes[i]);
+        BOOST_CHECK_EQUAL(buffered.nodeFrom, i);
+    }
+    BOOST_CHECK(!buffer.TakeOldest(buffered));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,81 @@
+//
+// Unit tests for the multi-buffer BMW-512 header hashing
+//
+#include <boost/test/unit_test.hpp>
+
+#include "chainparams.h"
+#include "crypto/bmw/bmw512.h"
+#include "main.h"
+#include "util.h"
+
+#include <vector>
+
+using namespace std;
+
+static const char* vImplementations[] = { "scalar", "sse2", "avx2", "avx2-8way" };
+
+static vector<unsigned char> RandomHeaders(int nCount)
+{
+    vector<unsigned char> vch(80 * nCount);
+    for (unsigned int i = 0; i < vch.size(); i++)
+        vch[i] = GetRandInt(256);
+    return vch;
+}
+
+BOOST_AUTO_TEST_SUITE(bmw512_tests)
+
+// The genesis blocks are fixed known answers for every implementation
+BOOST_AUTO_TEST_CASE(bmw512_genesis)
+{
+    const CChainParams::Network vNetworks[] = { CChainParams::MAIN, CChainParams::TESTNET, CChainParams::REGTEST };
+    for (unsigned int n = 0; n < sizeof(vNetworks)/sizeof(vNetworks[0]); n++)
+    {
+        SelectParams(vNetworks[n]);
+        const CBlock& genesis = Params().GenesisBlock();
+        BOOST_CHECK(Hash_bmw512(BEGIN(genesis.nVersion), END(genesis.nNonce)) == Params().HashGenesisBlock());
+
+        for (unsigned int i = 0; i < sizeof(vImplementations)/sizeof(vImplementations[0]); i++)
+        {
+            if (!BMW512SelectImplementation(vImplementations[i]))
+                continue;
+            uint256 hash;
+            Hash_bmw512_headers(UBEGIN(genesis.nVersion), 1, &hash);
+            BOOST_CHECK_MESSAGE(hash == Params().HashGenesisBlock(), vImplementations[i]);
+        }
+    }
+    SelectParams(CChainParams::MAIN);
+    BMW512AutoDetect();
+}
+
+// Every implementation agrees with sph on random headers, including
+// batches that do not fill the last set of lanes
+BOOST_AUTO_TEST_CASE(bmw512_cross_check)
+{
+    vector<unsigned char> vchHeaders = RandomHeaders(1000);
+    vector<uint256> vExpected(1000);
+    for (int i = 0; i < 1000; i++)
+        vExpected[i] = Hash_bmw512(vchHeaders.begin() + 80 * i, vchHeaders.begin() + 80 * (i + 1));
+
+    for (unsigned int i = 0; i < sizeof(vImplementations)/sizeof(vImplementations[0]); i++)
+    {
+        if (!BMW512SelectImplementation(vImplementations[i]))
+        {
+            BOOST_TEST_MESSAGE(strprintf("%s: not supported by this CPU", vImplementations[i]));
+            continue;
+        }
+        for (int nCount = 0; nCount <= 17; nCount++)
+        {
+            vector<uint256> vHash(nCount);
+            Hash_bmw512_headers(&vchHeaders[0], nCount, nCount ? &vHash[0] : NULL);
+            for (int j = 0; j < nCount; j++)
+                BOOST_CHECK_MESSAGE(vHash[j] == vExpected[j], strprintf("%s: %d of %d", vImplementations[i], j, nCount));
+        }
+
+        vector<uint256> vHash(1000);
+        Hash_bmw512_headers(&vchHeaders[0], 1000, &vHash[0]);
+        BOOST_CHECK_MESSAGE(vHash == vExpected, vImplementations[i]);
+    }
+    BMW512AutoDetect();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,67 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+#include "checkqueue.h"
+#include "util.h"
+
+using namespace std;
+
+// A check that just returns a fixed result
+class CFixedCheck
+{
+public:
+    bool fResult;
+
+    CFixedCheck(bool fResultIn = true) : fResult(fResultIn) {}
+    bool operator()() const { return fResult; }
+    void swap(CFixedCheck& check) { std::swap(fResult, check.fResult); }
+};
+
+template<typename T>
+static void StartWorkers(CCheckQueue<T>& queue, boost::thread_group& threads, int nThreads)
+{
+    // The thread calling Wait() is the last worker
+    for (int i = 0; i < nThreads - 1; i++)
+        threads.create_thread(boost::bind(&CCheckQueue<T>::Thread, &queue));
+}
+
+BOOST_AUTO_TEST_SUITE(checkqueue_tests)
+
+BOOST_AUTO_TEST_CASE(checkqueue_result)
+{
+    CCheckQueue<CFixedCheck> queue(16);
+    boost::thread_group threads;
+    StartWorkers(queue, threads, 4);
+
+    for (int nRound = 0; nRound < 100; nRound++)
+    {
+        // One failing check anywhere fails the whole batch
+        int nFail = GetRandInt(2) ? GetRandInt(1000) : -1;
+        CCheckQueueControl<CFixedCheck> control(&queue);
+        for (int i = 0; i < 1000; i += 100)
+        {
+            vector<CFixedCheck> vChecks;
+            for (int j = i; j < i + 100; j++)
+                vChecks.push_back(CFixedCheck(j != nFail));
+            control.Add(vChecks);
+        }
+        BOOST_CHECK_EQUAL(control.Wait(), nFail < 0);
+    }
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_empty)
+{
+    CCheckQueue<CFixedCheck> queue(16);
+    CCheckQueueControl<CFixedCheck> control(&queue);
+    BOOST_CHECK(control.Wait());
+
+    CCheckQueueControl<CFixedCheck> controlNone(NULL);
+    vector<CFixedCheck> vChecks(1, CFixedCheck(false));
+    controlNone.Add(vChecks);
+    BOOST_CHECK(controlNone.Wait());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,134 @@
+#include <boost/test/unit_test.hpp>
+
+#include "headerchain.h"
+
+#include <algorithm>
+
+using namespace std;
+
+static const uint256 nWork = 1;
+
+static uint256 BlockHash(int n)
+{
+    return uint256(n + 1);
+}
+
+BOOST_AUTO_TEST_SUITE(headerchain_tests)
+
+BOOST_AUTO_TEST_CASE(headerchain_connect)
+{
+    CHeaderChain chain;
+    BOOST_CHECK_EQUAL(chain.GetBestHeight(), -1);
+
+    // Nothing to stand on: neither a header nor a block we have
+    BOOST_CHECK(chain.Add(BlockHash(1), BlockHash(0), 1000, nWork, 1) == NULL);
+    BOOST_CHECK_EQUAL(chain.size(), 0U);
+
+    // On top of the block we have at height 100, then on each other
+    const CHeaderIndex* pheader = chain.Add(BlockHash(1), BlockHash(0), 1000, nWork, 1, 100, 100);
+    BOOST_REQUIRE(pheader != NULL);
+    BOOST_CHECK_EQUAL(pheader->nHeight, 101);
+    BOOST_CHECK(pheader->nChainWork == 101);
+    for (int i = 2; i <= 10; i++)
+    {
+        pheader = chain.Add(BlockHash(i), BlockHash(i - 1), 1000 + i, nWork, 1);
+        BOOST_REQUIRE(pheader != NULL);
+        BOOST_CHECK_EQUAL(pheader->nHeight, 100 + i);
+        BOOST_CHECK(pheader->hashPrev == BlockHash(i - 1));
+        BOOST_CHECK(pheader->nChainWork == 100 + i);
+    }
+    BOOST_CHECK_EQUAL(chain.size(), 10U);
+    BOOST_CHECK_EQUAL(chain.GetBestHeight(), 110);
+    BOOST_CHECK(chain.GetBestHash() == BlockHash(10));
+
+    // Adding a header again returns the one stored
+    BOOST_CHECK(chain.Add(BlockHash(5), BlockHash(4), 0, nWork, 2) == chain.Get(BlockHash(5)));
+    BOOST_CHECK_EQUAL(chain.Get(BlockHash(5))->nTime, 1005U);
+    BOOST_CHECK_EQUAL(chain.size(), 10U);
+    BOOST_CHECK_EQUAL(chain.CountFrom(1), 10U);
+    BOOST_CHECK_EQUAL(chain.CountFrom(2), 0U);
+}
+
+// The branch with the most work is the best, whatever its length; on a tie
+// the first one stays
+BOOST_AUTO_TEST_CASE(headerchain_fork)
+{
+    CHeaderChain chain;
+    for (int i = 1; i <= 5; i++)
+        BOOST_REQUIRE(chain.Add(BlockHash(i), BlockHash(i - 1), 0, nWork, 1, i == 1 ? 0 : -1));
+
+    BOOST_REQUIRE(chain.Add(BlockHash(13), BlockHash(2), 0, nWork, 2));
+    BOOST_REQUIRE(chain.Add(BlockHash(14), BlockHash(13), 0, nWork, 2));
+    BOOST_REQUIRE(chain.Add(BlockHash(15), BlockHash(14), 0, nWork, 2));
+    BOOST_CHECK(chain.GetBestHash() == BlockHash(5));
+
+    // Longer, but less work
+    BOOST_REQUIRE(chain.Add(BlockHash(24), BlockHash(3), 0, 0, 3));
+    BOOST_REQUIRE(chain.Add(BlockHash(25), BlockHash(24), 0, 0, 3));
+    BOOST_REQUIRE(chain.Add(BlockHash(26), BlockHash(25), 0, 0, 3));
+    BOOST_CHECK(chain.GetBestHash() == BlockHash(5));
+
+    // Shorter, but more work
+    BOOST_REQUIRE(chain.Add(BlockHash(33), BlockHash(2), 0, 10, 4));
+    BOOST_CHECK_EQUAL(chain.GetBestHeight(), 3);
+    BOOST_CHECK(chain.GetBestHash() == BlockHash(33));
+}
+
+BOOST_AUTO_TEST_CASE(headerchain_prune)
+{
+    CHeaderChain chain;
+    for (int i = 1; i <= 10; i++)
+        BOOST_REQUIRE(chain.Add(BlockHash(i), BlockHash(i - 1), 0, nWork, 1, i == 1 ? 0 : -1));
+    BOOST_REQUIRE(chain.Add(BlockHash(23), BlockHash(2), 0, nWork, 2));
+
+    // Both branches go up to the height passed
+    BOOST_CHECK_EQUAL(chain.Prune(3), 4U);
+    BOOST_CHECK(!chain.Contains(BlockHash(3)) && !chain.Contains(BlockHash(23)));
+    BOOST_CHECK(chain.Contains(BlockHash(4)));
+    BOOST_CHECK_EQUAL(chain.Prune(3), 0U);
+    BOOST_CHECK_EQUAL(chain.CountFrom(2), 0U);
+
+    // The best header is remembered after it has gone
+    BOOST_CHECK_EQUAL(chain.Prune(100), 7U);
+    BOOST_CHECK_EQUAL(chain.size(), 0U);
+    BOOST_CHECK_EQUAL(chain.GetBestHeight(), 10);
+
+    // New headers stand on blocks again
+    BOOST_CHECK(chain.Add(BlockHash(11), BlockHash(10), 0, nWork, 1) == NULL);
+    BOOST_CHECK(chain.Add(BlockHash(11), BlockHash(10), 0, nWork, 1, 10, 10) != NULL);
+    BOOST_CHECK(chain.GetBestHash() == BlockHash(11));
+}
+
+// Side branches that fell far enough behind go, down to where they left the
+// best branch, and those still close are kept
+BOOST_AUTO_TEST_CASE(headerchain_prune_forks)
+{
+    CHeaderChain chain;
+    for (int i = 1; i <= 20; i++)
+        BOOST_REQUIRE(chain.Add(BlockHash(i), BlockHash(i - 1), 0, nWork, 1, i == 1 ? 0 : -1));
+    for (int i = 103; i <= 105; i++)
+        BOOST_REQUIRE(chain.Add(BlockHash(i), BlockHash(i == 103 ? 2 : i - 1), 0, nWork, 2));
+    BOOST_REQUIRE(chain.Add(BlockHash(204), BlockHash(103), 0, nWork, 2));
+    BOOST_REQUIRE(chain.Add(BlockHash(316), BlockHash(15), 0, nWork, 3));
+    BOOST_CHECK_EQUAL(chain.size(), 25U);
+    BOOST_CHECK(chain.GetBestHash() == BlockHash(20));
+
+    vector<uint256> vPruned;
+    chain.PruneForks(10, vPruned);
+    BOOST_CHECK_EQUAL(vPruned.size(), 4U);
+    BOOST_CHECK(find(vPruned.begin(), vPruned.end(), BlockHash(103)) != vPruned.end());
+    BOOST_CHECK(!chain.Contains(BlockHash(105)) && !chain.Contains(BlockHash(204)));
+    BOOST_CHECK(chain.Contains(BlockHash(2)) && chain.Contains(BlockHash(316)));
+    BOOST_CHECK_EQUAL(chain.CountFrom(2), 0U);
+    BOOST_CHECK_EQUAL(chain.CountFrom(3), 1U);
+    BOOST_CHECK_EQUAL(chain.size(), 21U);
+
+    // The best branch stays, whatever its length
+    vPruned.clear();
+    chain.PruneForks(0, vPruned);
+    BOOST_CHECK_EQUAL(vPruned.size(), 1U);
+    BOOST_CHECK_EQUAL(chain.size(), 20U);
+    BOOST_CHECK(chain.GetBestHash() == BlockHash(20));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,134 @@
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+#include "txmempool.h"
+#include "util.h"
+
+using namespace std;
+
+static CTransaction MakeTx(const COutPoint& prevout, int64_t nValue)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = nValue;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    return tx;
+}
+
+static void AddTx(CTxMemPool& pool, const CTransaction& tx, int64_t nFee, int64_t nTime)
+{
+    pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, nFee, nTime, 0, 1, 0));
+}
+
+BOOST_AUTO_TEST_SUITE(mempool_tests)
+
+BOOST_AUTO_TEST_CASE(mempool_accounting)
+{
+    CTxMemPool pool;
+    CTransaction tx1 = MakeTx(COutPoint(GetRandHash(), 0), COIN);
+    CTransaction tx2 = MakeTx(COutPoint(GetRandHash(), 0), COIN);
+    AddTx(pool, tx1, 1000, 100);
+    AddTx(pool, tx2, 2000, 100);
+
+    uint64_t nBytes = ::GetSerializeSize(tx1, SER_NETWORK, PROTOCOL_VERSION) +
+                      ::GetSerializeSize(tx2, SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK_EQUAL(pool.size(), 2);
+    BOOST_CHECK_EQUAL(pool.GetTotalTxSize(), nBytes);
+    size_t nUsage = pool.DynamicMemoryUsage();
+    BOOST_CHECK(nUsage > nBytes);
+
+    // Adding the same transaction twice changes nothing
+    AddTx(pool, tx1, 1000, 100);
+    BOOST_CHECK_EQUAL(pool.size(), 2);
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), nUsage);
+
+    pool.remove(tx1);
+    BOOST_CHECK_EQUAL(pool.GetTotalTxSize(), ::GetSerializeSize(tx2, SER_NETWORK, PROTOCOL_VERSION));
+    BOOST_CHECK(pool.DynamicMemoryUsage() < nUsage);
+
+    pool.clear();
+    BOOST_CHECK_EQUAL(pool.GetTotalTxSize(), 0);
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(mempool_trim)
+{
+    CTxMemPool pool;
+    CTransaction txLow = MakeTx(COutPoint(GetRandHash(), 0), COIN);
+    CTransaction txMid = MakeTx(COutPoint(GetRandHash(), 0), COIN);
+    CTransaction txHigh = MakeTx(COutPoint(GetRandHash(), 0), COIN);
+    AddTx(pool, txMid, 5000, 100);
+    AddTx(pool, txLow, 1000, 100);
+    AddTx(pool, txHigh, 9000, 100);
+
+    // A well paying child of the cheapest transaction goes with it
+    CTransaction txChild = MakeTx(COutPoint(txLow.GetHash(), 0), COIN / 2);
+    AddTx(pool, txChild, 50000, 100);
+    BOOST_CHECK_EQUAL(pool.size(), 4);
+
+    BOOST_CHECK_EQUAL(pool.TrimToSize(pool.DynamicMemoryUsage()), 0);
+    BOOST_CHECK_EQUAL(pool.TrimToSize(pool.DynamicMemoryUsage() - 1), 2);
+    BOOST_CHECK(!pool.exists(txLow.GetHash()));
+    BOOST_CHECK(!pool.exists(txChild.GetHash()));
+    BOOST_CHECK(pool.exists(txMid.GetHash()));
+    BOOST_CHECK(pool.exists(txHigh.GetHash()));
+    BOOST_CHECK_EQUAL(pool.mapNextTx.size(), 2);
+
+    BOOST_CHECK_EQUAL(pool.TrimToSize(0), 2);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(mempool_expire)
+{
+    CTxMemPool pool;
+    CTransaction txOld = MakeTx(COutPoint(GetRandHash(), 0), COIN);
+    CTransaction txNew = MakeTx(COutPoint(GetRandHash(), 0), COIN);
+    AddTx(pool, txOld, 1000, 100);
+    AddTx(pool, txNew, 1000, 200);
+
+    BOOST_CHECK_EQUAL(pool.Expire(100), 0);
+    BOOST_CHECK_EQUAL(pool.Expire(150), 1);
+    BOOST_CHECK(!pool.exists(txOld.GetHash()));
+    BOOST_CHECK(pool.exists(txNew.GetHash()));
+}
+
+BOOST_AUTO_TEST_CASE(mempool_priority)
+{
+    CTransaction tx = MakeTx(COutPoint(GetRandHash(), 0), COIN);
+    unsigned int nSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    CTxMemPoolEntry entry(tx, 1000, 0, 10.0, 100, 2 * COIN);
+
+    BOOST_CHECK_EQUAL(entry.GetPriority(100), 10.0);
+    BOOST_CHECK_CLOSE(entry.GetPriority(103), 10.0 + 3.0 * 2 * COIN / nSize, 1e-9);
+    BOOST_CHECK_CLOSE(entry.GetFeeRate(), 1000.0 * 1000 / nSize, 1e-9);
+}
+
+BOOST_AUTO_TEST_CASE(mempool_priority_unconfirmed_parent)
+{
+    // FetchInputs gives a parent found only in the pool a null position,
+    // and one from a block being checked the CDiskTxPos(1,1,1) marker
+    CTransaction txParent = MakeTx(COutPoint(GetRandHash(), 0), COIN);
+    CTransaction txParent2 = MakeTx(COutPoint(GetRandHash(), 0), 2 * COIN);
+    CTransaction tx = MakeTx(COutPoint(txParent.GetHash(), 0), COIN);
+    tx.vin.push_back(tx.vin[0]);
+    tx.vin[1].prevout = COutPoint(txParent2.GetHash(), 0);
+
+    MapPrevTx mapInputs;
+    mapInputs[txParent.GetHash()] = make_pair(CTxIndex(), txParent);
+    mapInputs[txParent2.GetHash()] = make_pair(CTxIndex(CDiskTxPos(1,1,1), 1), txParent2);
+
+    unsigned int nSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    int64_t nInChainInputValue = -1;
+    BOOST_CHECK_EQUAL(GetTxPriority(tx, mapInputs, nSize, nInChainInputValue), 0.0);
+    BOOST_CHECK_EQUAL(nInChainInputValue, 0);
+
+    // So the child does not age in the pool either
+    CTxMemPoolEntry entry(tx, 1000, 0, 0.0, 100, nInChainInputValue);
+    BOOST_CHECK_EQUAL(entry.GetPriority(200), 0.0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,101 @@
+#include <boost/test/unit_test.hpp>
+
+#include "net.h"
+#include "util.h"
+
+using namespace std;
+
+static vector<unsigned char> RandomPayload(size_t nSize)
+{
+    vector<unsigned char> vch(nSize);
+    for (size_t i = 0; i < nSize; i++)
+        vch[i] = insecure_rand();
+    return vch;
+}
+
+// The way messages were built before they were shared, one per peer
+static void OldStyleMessage(const char* pszCommand, const CDataStream& ssPayload, CSerializeData& data)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CMessageHeader(pszCommand, 0) << ssPayload;
+    unsigned int nSize = ss.size() - CMessageHeader::HEADER_SIZE;
+    memcpy((char*)&ss[CMessageHeader::MESSAGE_SIZE_OFFSET], &nSize, sizeof(nSize));
+    uint256 hash = Hash_bmw512(ss.begin() + CMessageHeader::HEADER_SIZE, ss.end());
+    memcpy((char*)&ss[CMessageHeader::CHECKSUM_OFFSET], &hash, sizeof(unsigned int));
+    ss.GetAndClear(data);
+}
+
+BOOST_AUTO_TEST_SUITE(netmessage_tests)
+
+BOOST_AUTO_TEST_CASE(netmessage_format)
+{
+    CDataStream ssPayload(SER_NETWORK, PROTOCOL_VERSION);
+    ssPayload << RandomPayload(1000);
+
+    CNetMessageRef msg = MakeNetMessage("block", ssPayload);
+    CSerializeData data;
+    OldStyleMessage("block", ssPayload, data);
+    BOOST_CHECK(msg->size() == data.size() && equal(msg->begin(), msg->end(), data.begin()));
+
+    CDataStream ssHeader(&(*msg)[0], &(*msg)[0] + CMessageHeader::HEADER_SIZE, SER_NETWORK, PROTOCOL_VERSION);
+    CMessageHeader hdr;
+    ssHeader >> hdr;
+    BOOST_CHECK(hdr.IsValid());
+    BOOST_CHECK_EQUAL(hdr.GetCommand(), "block");
+    BOOST_CHECK_EQUAL(hdr.nMessageSize, ssPayload.size());
+    uint256 hash = Hash_bmw512(msg->begin() + CMessageHeader::HEADER_SIZE, msg->end());
+    BOOST_CHECK_EQUAL(hdr.nChecksum, *(unsigned int*)&hash);
+
+    // An empty payload still gets a header
+    BOOST_CHECK_EQUAL(MakeNetMessage("mempool", vector<char>())->size(), CMessageHeader::HEADER_SIZE + 1);
+}
+
+#ifndef WIN32
+// Many shared messages through a small socket buffer, so that sendmsg() keeps
+// stopping part way through a message
+BOOST_AUTO_TEST_CASE(netmessage_send)
+{
+    int fds[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    SOCKET hSend = fds[0], hRecv = fds[1];
+    int nBufSize = 4096;
+    setsockopt(hSend, SOL_SOCKET, SO_SNDBUF, &nBufSize, sizeof(nBufSize));
+    fcntl(hSend, F_SETFL, O_NONBLOCK);
+
+    CNode* pnode = new CNode(hSend, CAddress(), "", true);
+    string strExpected;
+    {
+        LOCK(pnode->cs_vSend);
+        for (int i = 0; i < 200; i++)
+        {
+            CNetMessageRef msg = MakeNetMessage("tx", RandomPayload(insecure_rand() % 3000));
+            strExpected.append(msg->begin(), msg->end());
+            pnode->vSendMsg.push_back(msg);
+            pnode->nSendSize += msg->size();
+        }
+    }
+
+    string strReceived;
+    while (strReceived.size() < strExpected.size())
+    {
+        {
+            LOCK(pnode->cs_vSend);
+            SocketSendData(pnode);
+        }
+        BOOST_REQUIRE(!pnode->fDisconnect);
+        char pchBuf[0x10000];
+        int nBytes = recv(hRecv, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+        if (nBytes > 0)
+            strReceived.append(pchBuf, nBytes);
+    }
+    BOOST_CHECK(strReceived == strExpected);
+    BOOST_CHECK(pnode->vSendMsg.empty());
+    BOOST_CHECK_EQUAL(pnode->nSendSize, 0);
+    BOOST_CHECK_EQUAL(pnode->nSendBytes, strExpected.size());
+
+    delete pnode;
+    closesocket(hRecv);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
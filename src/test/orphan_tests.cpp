@@ -0,0 +1,125 @@
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+#include "util.h"
+
+using namespace std;
+
+static CTransaction MakeOrphan(const COutPoint& prevout, size_t nPadding = 0)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vin[0].scriptSig = CScript() << vector<unsigned char>(nPadding, 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = COIN;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    return tx;
+}
+
+static void ClearOrphans()
+{
+    while (!mapOrphanTransactions.empty())
+        EraseOrphansFor(mapOrphanTransactions.begin()->second.fromPeer);
+}
+
+BOOST_AUTO_TEST_SUITE(orphan_tests)
+
+BOOST_AUTO_TEST_CASE(orphan_add)
+{
+    LOCK(cs_main);
+    ClearOrphans();
+
+    CTransaction tx = MakeOrphan(COutPoint(GetRandHash(), 0));
+    BOOST_CHECK(AddOrphanTx(tx, 1));
+    BOOST_CHECK(!AddOrphanTx(tx, 2));
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), 1U);
+    BOOST_CHECK_EQUAL(mapOrphanTransactions[tx.GetHash()].fromPeer, 1);
+    BOOST_CHECK_EQUAL(nOrphanTxBytes, ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION));
+
+    // Too big to be kept at all
+    CTransaction txBig = MakeOrphan(COutPoint(GetRandHash(), 0), MAX_ORPHAN_TX_SIZE);
+    BOOST_CHECK(!AddOrphanTx(txBig, 1));
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), 1U);
+
+    ClearOrphans();
+    BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
+    BOOST_CHECK_EQUAL(nOrphanTxBytes, 0U);
+}
+
+// The orphans waiting on an output are found from it, and leave the index
+// when they go
+BOOST_AUTO_TEST_CASE(orphan_by_prevout)
+{
+    LOCK(cs_main);
+    ClearOrphans();
+
+    COutPoint prevout(GetRandHash(), 0);
+    CTransaction tx1 = MakeOrphan(prevout, 1);
+    CTransaction tx2 = MakeOrphan(prevout, 2);
+    CTransaction tx3 = MakeOrphan(COutPoint(tx1.GetHash(), 0));
+    BOOST_REQUIRE(AddOrphanTx(tx1, 1));
+    BOOST_REQUIRE(AddOrphanTx(tx2, 2));
+    BOOST_REQUIRE(AddOrphanTx(tx3, 2));
+
+    BOOST_REQUIRE(mapOrphanTransactionsByPrev.count(prevout));
+    const set<uint256>& setSpenders = mapOrphanTransactionsByPrev[prevout];
+    BOOST_CHECK_EQUAL(setSpenders.size(), 2U);
+    BOOST_CHECK(setSpenders.count(tx1.GetHash()) && setSpenders.count(tx2.GetHash()));
+    BOOST_CHECK(mapOrphanTransactionsByPrev[COutPoint(tx1.GetHash(), 0)].count(tx3.GetHash()));
+    BOOST_CHECK(!mapOrphanTransactionsByPrev.count(COutPoint(prevout.hash, 1)));
+
+    EraseOrphansFor(1);
+    BOOST_CHECK_EQUAL(mapOrphanTransactionsByPrev[prevout].size(), 1U);
+    EraseOrphansFor(2);
+    BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
+}
+
+BOOST_AUTO_TEST_CASE(orphan_erase_for_peer)
+{
+    LOCK(cs_main);
+    ClearOrphans();
+
+    for (int i = 0; i < 30; i++)
+        BOOST_REQUIRE(AddOrphanTx(MakeOrphan(COutPoint(GetRandHash(), 0)), i % 3));
+
+    EraseOrphansFor(1);
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), 20U);
+    for (map<uint256, COrphanTx>::const_iterator it = mapOrphanTransactions.begin(); it != mapOrphanTransactions.end(); ++it)
+        BOOST_CHECK(it->second.fromPeer != 1);
+
+    // Unknown peers have nothing to drop
+    EraseOrphansFor(7);
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), 20U);
+
+    ClearOrphans();
+}
+
+// Both the count and the byte limit are kept
+BOOST_AUTO_TEST_CASE(orphan_limit)
+{
+    LOCK(cs_main);
+    ClearOrphans();
+
+    for (int i = 0; i < 50; i++)
+        BOOST_REQUIRE(AddOrphanTx(MakeOrphan(COutPoint(GetRandHash(), 0), 100), i));
+    uint64_t nTxSize = nOrphanTxBytes / 50;
+
+    BOOST_CHECK_EQUAL(LimitOrphanTxSize(50, nOrphanTxBytes), 0U);
+    BOOST_CHECK_EQUAL(LimitOrphanTxSize(40, nOrphanTxBytes), 10U);
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), 40U);
+    BOOST_CHECK_EQUAL(LimitOrphanTxSize(40, 25 * nTxSize), 15U);
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), 25U);
+    BOOST_CHECK_EQUAL(nOrphanTxBytes, 25 * nTxSize);
+
+    size_t nPrevOuts = 0;
+    for (map<COutPoint, set<uint256> >::const_iterator it = mapOrphanTransactionsByPrev.begin(); it != mapOrphanTransactionsByPrev.end(); ++it)
+        nPrevOuts += it->second.size();
+    BOOST_CHECK_EQUAL(nPrevOuts, 25U);
+
+    BOOST_CHECK_EQUAL(LimitOrphanTxSize(0, 0), 25U);
+    BOOST_CHECK(mapOrphanTransactions.empty());
+    BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,129 @@
+#include <boost/test/unit_test.hpp>
+
+#include "orphanblocks.h"
+#include "util.h"
+
+using namespace std;
+
+static uint256 BlockHash(int n)
+{
+    return uint256(n + 1);
+}
+
+static const COrphanBlock* AddBlock(COrphanBlockPool& pool, int n, int nPrev, size_t nSize = 100)
+{
+    return pool.Add(BlockHash(n), BlockHash(nPrev), make_pair(COutPoint(), 0), false,
+                    vector<unsigned char>(nSize, 0));
+}
+
+// Root by following hashPrev through the pool, the slow way
+static uint256 SlowRoot(const COrphanBlockPool& pool, uint256 hash)
+{
+    const COrphanBlock* p = pool.Get(hash);
+    while (p && pool.Get(p->hashPrev))
+        p = pool.Get(p->hashPrev);
+    return p ? p->hashBlock : hash;
+}
+
+BOOST_AUTO_TEST_SUITE(orphanblocks_tests)
+
+BOOST_AUTO_TEST_CASE(orphanblocks_chain)
+{
+    COrphanBlockPool pool;
+
+    // Chain 1 <- 2 <- 3 <- 4 arriving as 3, 4, 2, with 1 missing
+    AddBlock(pool, 3, 2);
+    AddBlock(pool, 4, 3);
+    BOOST_CHECK(pool.GetRoot(BlockHash(4))->hashBlock == BlockHash(3));
+    AddBlock(pool, 2, 1);
+    BOOST_CHECK(pool.GetRoot(BlockHash(4))->hashBlock == BlockHash(2));
+    BOOST_CHECK(pool.GetRoot(BlockHash(4))->hashPrev == BlockHash(1));
+    BOOST_CHECK(pool.GetRoot(BlockHash(3))->hashBlock == BlockHash(2));
+    BOOST_CHECK(pool.GetRoot(BlockHash(9)) == NULL);
+    BOOST_CHECK_EQUAL(pool.GetLeafCount(), 1);
+    BOOST_CHECK_EQUAL(pool.GetBytes(), 300);
+
+    // A fork off 3
+    AddBlock(pool, 5, 3);
+    BOOST_CHECK_EQUAL(pool.GetLeafCount(), 2);
+    BOOST_CHECK(pool.HasChildren(BlockHash(3)));
+
+    // Connecting 2 makes 3 the start of the chain
+    vector<uint256> vChildren;
+    pool.GetChildren(BlockHash(1), vChildren);
+    BOOST_CHECK_EQUAL(vChildren.size(), 1);
+    pool.Remove(BlockHash(2));
+    BOOST_CHECK(pool.GetRoot(BlockHash(4))->hashBlock == BlockHash(3));
+    BOOST_CHECK(pool.GetRoot(BlockHash(5))->hashBlock == BlockHash(3));
+    pool.GetChildren(BlockHash(3), vChildren);
+    BOOST_CHECK_EQUAL(vChildren.size(), 2);
+
+    // Only leaves are evicted
+    BOOST_CHECK_EQUAL(pool.Prune(3, 1000000, 0), 1);
+    BOOST_CHECK(pool.Contains(BlockHash(3)));
+    BOOST_CHECK_EQUAL(pool.Prune(2, 1000000, 0), 1);
+    BOOST_CHECK(pool.Contains(BlockHash(3)));
+    BOOST_CHECK_EQUAL(pool.GetLeafCount(), 1);
+    BOOST_CHECK_EQUAL(pool.Prune(1, 1000000, 0), 1);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    BOOST_CHECK_EQUAL(pool.GetBytes(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(orphanblocks_bytes)
+{
+    COrphanBlockPool pool;
+    for (int i = 0; i < 10; i++)
+        AddBlock(pool, 100 + i, i, 1000);
+    BOOST_CHECK_EQUAL(pool.GetBytes(), 10000);
+
+    // Room for another 2500 bytes under 10000
+    BOOST_CHECK_EQUAL(pool.Prune(100, 10000, 2500), 3);
+    BOOST_CHECK_EQUAL(pool.GetBytes(), 7000);
+}
+
+// Random arrival order, random connection and eviction, against the slow walk
+BOOST_AUTO_TEST_CASE(orphanblocks_random)
+{
+    COrphanBlockPool pool;
+    const int nBlocks = 400;
+
+    // Mostly one long chain with some forks
+    vector<int> vPrev(nBlocks + 1);
+    for (int n = 1; n <= nBlocks; n++)
+        vPrev[n] = GetRandInt(8) == 0 ? GetRandInt(n) : n - 1;
+
+    for (int nRound = 0; nRound < 20; nRound++)
+    {
+        for (int i = 0; i < nBlocks; i++)
+        {
+            int n = GetRandInt(nBlocks) + 1;
+            if (!pool.Contains(BlockHash(n)))
+                AddBlock(pool, n, vPrev[n]);
+
+            if (GetRandInt(10) == 0)
+            {
+                // Connect the start of a chain
+                const COrphanBlock* pRoot = pool.GetRoot(BlockHash(n));
+                vector<uint256> vChildren;
+                pool.GetChildren(pRoot->hashPrev, vChildren);
+                BOOST_FOREACH(const uint256& hash, vChildren)
+                    pool.Remove(hash);
+            }
+            if (GetRandInt(10) == 0)
+                pool.Prune(pool.size(), 1000000000, 0);
+
+            uint256 hash = BlockHash(GetRandInt(nBlocks) + 1);
+            const COrphanBlock* pRoot = pool.GetRoot(hash);
+            BOOST_CHECK((pRoot ? pRoot->hashBlock : hash) == SlowRoot(pool, hash));
+        }
+
+        size_t nLeaves = 0;
+        for (int n = 1; n <= nBlocks; n++)
+            if (pool.Contains(BlockHash(n)) && !pool.HasChildren(BlockHash(n)))
+                nLeaves++;
+        BOOST_CHECK_EQUAL(pool.GetLeafCount(), nLeaves);
+        BOOST_CHECK_EQUAL(pool.GetBytes(), pool.size() * 100);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,123 @@
+//
+// Unit tests for the SHA-256 implementations and batched merkle hashing
+//
+#include <boost/test/unit_test.hpp>
+
+#include "crypto/common/sha256.h"
+#include "hash.h"
+#include "main.h"
+#include "util.h"
+
+#include <vector>
+
+using namespace std;
+
+static const char* vImplementations[] = { "standard", "sse4.1", "avx2", "shani" };
+
+static vector<unsigned char> RandomBytes(size_t nSize)
+{
+    vector<unsigned char> vch(nSize);
+    for (size_t i = 0; i < nSize; i++)
+        vch[i] = insecure_rand();
+    return vch;
+}
+
+// Hash in pieces of varying size, so that both the buffered and the
+// multi-block paths of Write() are used
+static string SHA256Hex(const string& str)
+{
+    CSHA256 sha;
+    size_t nPos = 0;
+    for (size_t nStep = 1; nPos < str.size(); nStep = (nStep * 7) % 200 + 1)
+    {
+        size_t nLen = min(nStep, str.size() - nPos);
+        sha.Write((const unsigned char*)str.data() + nPos, nLen);
+        nPos += nLen;
+    }
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    sha.Finalize(hash);
+    return HexStr(hash, hash + sizeof(hash));
+}
+
+BOOST_AUTO_TEST_SUITE(sha256_tests)
+
+// FIPS 180-2 known answers for every implementation the CPU can run
+BOOST_AUTO_TEST_CASE(sha256_vectors)
+{
+    for (unsigned int i = 0; i < sizeof(vImplementations)/sizeof(vImplementations[0]); i++)
+    {
+        if (!SHA256SelectImplementation(vImplementations[i]))
+        {
+            BOOST_TEST_MESSAGE(strprintf("%s: not supported by this CPU", vImplementations[i]));
+            continue;
+        }
+        BOOST_CHECK_MESSAGE(SHA256Hex("") == "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855", vImplementations[i]);
+        BOOST_CHECK_MESSAGE(SHA256Hex("abc") == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", vImplementations[i]);
+        BOOST_CHECK_MESSAGE(SHA256Hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq") ==
+                            "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1", vImplementations[i]);
+        BOOST_CHECK_MESSAGE(SHA256Hex(string(1000000, 'a')) == "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0", vImplementations[i]);
+    }
+    SHA256AutoDetect();
+}
+
+// Batched double hashing agrees with hashing one input at a time, including
+// batches that do not fill the last set of lanes
+BOOST_AUTO_TEST_CASE(sha256_d64)
+{
+    vector<unsigned char> vchIn = RandomBytes(64 * 17);
+    vector<uint256> vExpected(17);
+    for (int i = 0; i < 17; i++)
+        vExpected[i] = Hash(vchIn.begin() + 64 * i, vchIn.begin() + 64 * (i + 1));
+
+    for (unsigned int i = 0; i < sizeof(vImplementations)/sizeof(vImplementations[0]); i++)
+    {
+        if (!SHA256SelectImplementation(vImplementations[i]))
+            continue;
+        for (int nCount = 0; nCount <= 17; nCount++)
+        {
+            vector<uint256> vHash(nCount + 1);
+            SHA256D64(vHash[0].begin(), &vchIn[0], nCount);
+            for (int j = 0; j < nCount; j++)
+                BOOST_CHECK_MESSAGE(vHash[j] == vExpected[j], strprintf("%s: %d of %d", vImplementations[i], j, nCount));
+            BOOST_CHECK_MESSAGE(vHash[nCount] == 0, vImplementations[i]);
+        }
+    }
+    SHA256AutoDetect();
+}
+
+// The merkle root is unchanged by building it a level at a time
+BOOST_AUTO_TEST_CASE(sha256_merkle)
+{
+    for (int nTx = 1; nTx <= 20; nTx++)
+    {
+        CBlock block;
+        for (int i = 0; i < nTx; i++)
+        {
+            CTransaction tx;
+            tx.nTime = i;
+            block.vtx.push_back(tx);
+        }
+
+        // The tree as it used to be built, one pair at a time
+        vector<uint256> vTree;
+        BOOST_FOREACH(const CTransaction& tx, block.vtx)
+            vTree.push_back(tx.GetHash());
+        int j = 0;
+        for (int nSize = nTx; nSize > 1; nSize = (nSize + 1) / 2)
+        {
+            for (int i = 0; i < nSize; i += 2)
+            {
+                int i2 = min(i + 1, nSize - 1);
+                vTree.push_back(Hash(BEGIN(vTree[j + i]), END(vTree[j + i]), BEGIN(vTree[j + i2]), END(vTree[j + i2])));
+            }
+            j += nSize;
+        }
+
+        BOOST_CHECK(block.BuildMerkleTree() == vTree.back());
+        BOOST_CHECK(block.vMerkleTree == vTree);
+        for (int i = 0; i < nTx; i++)
+            BOOST_CHECK(CBlock::CheckMerkleBranch(block.vtx[i].GetHash(), block.GetMerkleBranch(i), i) == vTree.back());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,129 @@
+#include <vector>
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+#include "script.h"
+#include "util.h"
+
+using namespace std;
+
+// Old script.cpp SignatureHash function, which copies the transaction
+uint256 static SignatureHashOld(CScript scriptCode, const CTransaction& txTo, unsigned int nIn, int nHashType)
+{
+    if (nIn >= txTo.vin.size())
+        return 1;
+    CTransaction txTmp(txTo);
+
+    // In case concatenating two scripts ends up with two codeseparators,
+    // or an extra one at the end, this prevents all those possible incompatibilities.
+    scriptCode.FindAndDelete(CScript(OP_CODESEPARATOR));
+
+    // Blank out other inputs' signatures
+    for (unsigned int i = 0; i < txTmp.vin.size(); i++)
+        txTmp.vin[i].scriptSig = CScript();
+    txTmp.vin[nIn].scriptSig = scriptCode;
+
+    // Blank out some of the outputs
+    if ((nHashType & 0x1f) == SIGHASH_NONE)
+    {
+        // Wildcard payee
+        txTmp.vout.clear();
+
+        // Let the others update at will
+        for (unsigned int i = 0; i < txTmp.vin.size(); i++)
+            if (i != nIn)
+                txTmp.vin[i].nSequence = 0;
+    }
+    else if ((nHashType & 0x1f) == SIGHASH_SINGLE)
+    {
+        // Only lock-in the txout payee at same index as txin
+        unsigned int nOut = nIn;
+        if (nOut >= txTmp.vout.size())
+            return 1;
+        txTmp.vout.resize(nOut+1);
+        for (unsigned int i = 0; i < nOut; i++)
+            txTmp.vout[i].SetNull();
+
+        // Let the others update at will
+        for (unsigned int i = 0; i < txTmp.vin.size(); i++)
+            if (i != nIn)
+                txTmp.vin[i].nSequence = 0;
+    }
+
+    // Blank out other inputs completely, not recommended for open transactions
+    if (nHashType & SIGHASH_ANYONECANPAY)
+    {
+        txTmp.vin[0] = txTmp.vin[nIn];
+        txTmp.vin.resize(1);
+    }
+
+    // Serialize and hash
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << txTmp << nHashType;
+    return ss.GetHash();
+}
+
+static void RandomScript(CScript &script)
+{
+    static const opcodetype oplist[] = {OP_FALSE, OP_1, OP_2, OP_3, OP_CHECKSIG, OP_IF, OP_VERIF, OP_RETURN, OP_CODESEPARATOR};
+    script = CScript();
+    int ops = GetRandInt(10);
+    for (int i=0; i<ops; i++)
+        script << oplist[GetRandInt(sizeof(oplist)/sizeof(oplist[0]))];
+    // Pushed data that looks like OP_CODESEPARATOR must be kept
+    if (GetRandInt(4) == 0)
+        script << vector<unsigned char>(GetRandInt(80), OP_CODESEPARATOR);
+    // Truncated pushes stop the opcode scan
+    if (GetRandInt(5) == 0)
+        script << OP_PUSHDATA1;
+    else if (GetRandInt(5) == 0)
+    {
+        script.push_back(0x05);
+        script.push_back(OP_CODESEPARATOR);
+    }
+}
+
+static void RandomTransaction(CTransaction &tx, int nIns, int nOuts)
+{
+    tx.nVersion = GetRandInt(0x7fffffff);
+    tx.nTime = GetRandInt(0x7fffffff);
+    tx.vin.clear();
+    tx.vout.clear();
+    tx.nLockTime = (GetRandInt(2)) ? GetRandInt(0x7fffffff) : 0;
+    for (int in = 0; in < nIns; in++) {
+        tx.vin.push_back(CTxIn());
+        CTxIn &txin = tx.vin.back();
+        txin.prevout.hash = GetRandHash();
+        txin.prevout.n = GetRandInt(4);
+        RandomScript(txin.scriptSig);
+        txin.nSequence = (GetRandInt(2)) ? GetRandInt(0x7fffffff) : (unsigned int)-1;
+    }
+    for (int out = 0; out < nOuts; out++) {
+        tx.vout.push_back(CTxOut());
+        CTxOut &txout = tx.vout.back();
+        txout.nValue = GetRandInt(100000000);
+        RandomScript(txout.scriptPubKey);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(sighash_tests)
+
+// The serializer must hash exactly what the old transaction copy did
+BOOST_AUTO_TEST_CASE(sighash_matches_copy)
+{
+    for (int i=0; i<50000; i++) {
+        int nHashType = GetRandInt(0x7fffffff);
+        CTransaction txTo;
+        RandomTransaction(txTo, GetRandInt(4) + 1, GetRandInt(4) + 1);
+        CScript scriptCode;
+        RandomScript(scriptCode);
+        int nIn = GetRandInt(txTo.vin.size());
+
+        uint256 sho = SignatureHashOld(scriptCode, txTo, nIn, nHashType);
+        uint256 sh = SignatureHash(scriptCode, txTo, nIn, nHashType);
+        BOOST_CHECK_MESSAGE(sh == sho, strprintf("hashtype %08x, input %d: %s != %s",
+                            nHashType, nIn, sh.ToString(), sho.ToString()));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
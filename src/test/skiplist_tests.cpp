@@ -0,0 +1,75 @@
+//
+// Unit tests for CBlockIndex skip pointers and ancestor lookup
+//
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+#include "util.h"
+
+#include <vector>
+
+#define SKIPLIST_LENGTH 300000
+
+BOOST_AUTO_TEST_SUITE(skiplist_tests)
+
+BOOST_AUTO_TEST_CASE(skiplist_test)
+{
+    std::vector<CBlockIndex> vIndex(SKIPLIST_LENGTH);
+
+    for (int i=0; i<SKIPLIST_LENGTH; i++) {
+        vIndex[i].nHeight = i;
+        vIndex[i].pprev = (i == 0) ? NULL : &vIndex[i - 1];
+        vIndex[i].BuildSkip();
+    }
+
+    for (int i=0; i<SKIPLIST_LENGTH; i++) {
+        if (i > 0) {
+            BOOST_CHECK(vIndex[i].pskip == &vIndex[vIndex[i].pskip->nHeight]);
+            BOOST_CHECK(vIndex[i].pskip->nHeight < i);
+        } else {
+            BOOST_CHECK(vIndex[i].pskip == NULL);
+        }
+    }
+
+    for (int i=0; i < 1000; i++) {
+        int from = GetRandInt(SKIPLIST_LENGTH - 1);
+        int to = GetRandInt(from + 1);
+
+        BOOST_CHECK(vIndex[SKIPLIST_LENGTH - 1].GetAncestor(from) == &vIndex[from]);
+        BOOST_CHECK(vIndex[from].GetAncestor(to) == &vIndex[to]);
+        BOOST_CHECK(vIndex[from].GetAncestor(0) == &vIndex[0]);
+    }
+}
+
+// Ancestors must be found on side branches too, not only on the main chain
+BOOST_AUTO_TEST_CASE(skiplist_fork_test)
+{
+    std::vector<CBlockIndex> vMain(10000);
+    std::vector<CBlockIndex> vFork(5000);
+
+    for (unsigned int i=0; i<vMain.size(); i++) {
+        vMain[i].nHeight = i;
+        vMain[i].pprev = (i == 0) ? NULL : &vMain[i - 1];
+        vMain[i].BuildSkip();
+    }
+
+    // Fork off the main chain at height 7000
+    for (unsigned int i=0; i<vFork.size(); i++) {
+        vFork[i].nHeight = 7001 + i;
+        vFork[i].pprev = (i == 0) ? &vMain[7000] : &vFork[i - 1];
+        vFork[i].BuildSkip();
+    }
+
+    for (int i=0; i < 1000; i++) {
+        int to = GetRandInt(vFork.back().nHeight + 1);
+        const CBlockIndex* pindex = vFork.back().GetAncestor(to);
+        BOOST_CHECK(pindex != NULL);
+        BOOST_CHECK(pindex->nHeight == to);
+        if (to <= 7000)
+            BOOST_CHECK(pindex == &vMain[to]);
+        else
+            BOOST_CHECK(pindex == &vFork[to - 7001]);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,110 @@
+#include <boost/test/unit_test.hpp>
+
+#include "socketevents.h"
+#include "util.h"
+
+using namespace std;
+
+#ifndef WIN32
+static SOCKET Listen(unsigned short& nPort)
+{
+    SOCKET hListen = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    BOOST_REQUIRE(bind(hListen, (struct sockaddr*)&addr, len) == 0);
+    BOOST_REQUIRE(listen(hListen, SOMAXCONN) == 0);
+    BOOST_REQUIRE(getsockname(hListen, (struct sockaddr*)&addr, &len) == 0);
+    nPort = ntohs(addr.sin_port);
+    return hListen;
+}
+
+// A connected loopback pair, the accepted end non-blocking like a peer's
+static void ConnectPair(SOCKET hListen, unsigned short nPort, SOCKET& hClient, SOCKET& hServer)
+{
+    hClient = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(nPort);
+    BOOST_REQUIRE(connect(hClient, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    hServer = accept(hListen, NULL, NULL);
+    BOOST_REQUIRE(hServer != INVALID_SOCKET);
+    fcntl(hServer, F_SETFL, O_NONBLOCK);
+    int nOne = 1;
+    setsockopt(hClient, IPPROTO_TCP, TCP_NODELAY, (void*)&nOne, sizeof(int));
+    setsockopt(hServer, IPPROTO_TCP, TCP_NODELAY, (void*)&nOne, sizeof(int));
+}
+
+static vector<SocketEventsMode> AvailableModes()
+{
+    vector<SocketEventsMode> vModes;
+    vModes.push_back(SOCKETEVENTS_SELECT);
+#ifdef USE_EPOLL
+    vModes.push_back(SOCKETEVENTS_EPOLL);
+#endif
+    return vModes;
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE(socketevents_tests)
+
+BOOST_AUTO_TEST_CASE(socketevents_modes)
+{
+    SocketEventsMode mode;
+    BOOST_CHECK(ParseSocketEventsMode("select", mode) && mode == SOCKETEVENTS_SELECT);
+    BOOST_CHECK(!ParseSocketEventsMode("kqueue", mode));
+#ifdef USE_EPOLL
+    BOOST_CHECK(ParseSocketEventsMode("epoll", mode) && mode == SOCKETEVENTS_EPOLL);
+#else
+    BOOST_CHECK(!ParseSocketEventsMode("epoll", mode));
+#endif
+    BOOST_CHECK(ParseSocketEventsMode(SocketEventsModeName(DEFAULT_SOCKETEVENTS), mode));
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(socketevents_readiness)
+{
+    unsigned short nPort;
+    SOCKET hListen = Listen(nPort);
+    vector<SocketEventsMode> vModes = AvailableModes();
+    for (unsigned int i = 0; i < vModes.size(); i++)
+    {
+        string strMode = SocketEventsModeName(vModes[i]);
+        CSocketEvents events;
+        BOOST_REQUIRE(events.Init(vModes[i]));
+        SOCKET hClient, hServer;
+        ConnectPair(hListen, nPort, hClient, hServer);
+        int nTag = 0;
+        BOOST_REQUIRE(events.Add(hServer, &nTag));
+        events.SetInterest(hServer, true, true);
+
+        // Writable straight away, nothing to read yet
+        vector<CSocketEvent> vEvents;
+        BOOST_CHECK(events.Wait(1000, vEvents));
+        BOOST_CHECK_MESSAGE(vEvents.size() == 1 && vEvents[0].pvData == &nTag &&
+                            vEvents[0].fSend && !vEvents[0].fRecv, strMode);
+
+        events.SetInterest(hServer, true, false);
+        BOOST_CHECK_EQUAL(send(hClient, "ping", 4, 0), 4);
+        BOOST_CHECK(events.Wait(1000, vEvents));
+        BOOST_CHECK_MESSAGE(vEvents.size() == 1 && vEvents[0].hSocket == hServer && vEvents[0].fRecv, strMode);
+
+        // Removed sockets are not reported
+        BOOST_CHECK_EQUAL(send(hClient, "pong", 4, 0), 4);
+        events.Remove(hServer);
+        BOOST_CHECK(events.Wait(0, vEvents));
+        BOOST_CHECK_MESSAGE(vEvents.empty(), strMode);
+
+        closesocket(hClient);
+        closesocket(hServer);
+    }
+    closesocket(hListen);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,75 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txcache.h"
+
+using namespace std;
+
+CTxReadCache txReadCache;
+
+// Rough per entry bookkeeping cost of the map node, list node and vectors
+static const size_t TX_CACHE_ENTRY_OVERHEAD = 160;
+
+CTxReadCache::CTxReadCache()
+{
+    nMaxBytes = DEFAULT_TX_CACHE_SIZE * 1048576;
+    nBytes = 0;
+}
+
+void CTxReadCache::SetMaxSize(size_t nMaxBytesIn)
+{
+    LOCK(cs);
+    nMaxBytes = nMaxBytesIn;
+    EvictLocked();
+}
+
+void CTxReadCache::EvictLocked()
+{
+    while (nBytes > nMaxBytes && !listLru.empty())
+    {
+        map<uint256, CEntry>::iterator mi = mapEntries.find(listLru.back());
+        nBytes -= mi->second.nSize;
+        mapEntries.erase(mi);
+        listLru.pop_back();
+    }
+}
+
+bool CTxReadCache::Get(const uint256& hash, const CDiskTxPos& pos, CTransaction& txRet)
+{
+    LOCK(cs);
+    map<uint256, CEntry>::iterator mi = mapEntries.find(hash);
+    if (mi == mapEntries.end() || mi->second.pos != pos)
+        return false;
+    listLru.splice(listLru.begin(), listLru, mi->second.itLru);
+    txRet = mi->second.tx;
+    return true;
+}
+
+void CTxReadCache::Add(const uint256& hash, const CDiskTxPos& pos, const CTransaction& tx)
+{
+    LOCK(cs);
+    if (nMaxBytes == 0)
+        return;
+
+    size_t nSize = ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION) + TX_CACHE_ENTRY_OVERHEAD;
+    map<uint256, CEntry>::iterator mi = mapEntries.find(hash);
+    if (mi != mapEntries.end())
+    {
+        // Same transaction at a new position after a reorganisation
+        nBytes -= mi->second.nSize;
+        listLru.erase(mi->second.itLru);
+        mapEntries.erase(mi);
+    }
+
+    CEntry& entry = mapEntries[hash];
+    entry.pos = pos;
+    entry.tx = tx;
+    entry.nSize = nSize;
+    listLru.push_front(hash);
+    entry.itLru = listLru.begin();
+    nBytes += nSize;
+
+    EvictLocked();
+}
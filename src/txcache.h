@@ -0,0 +1,57 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2012 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_TXCACHE_H
+#define BITCOIN_TXCACHE_H
+
+#include "main.h"
+#include "sync.h"
+
+#include <list>
+#include <map>
+
+/** Default for -txcache, memory budget of the previous transaction cache in megabytes */
+static const unsigned int DEFAULT_TX_CACHE_SIZE = 32;
+
+/*
+ * CTxReadCache keeps recently used confirmed transactions in memory so that
+ * CTransaction::FetchInputs does not have to seek into the block files for
+ * every input it resolves. Entries are tagged with the disk position they were
+ * read from and only returned when the caller's CTxIndex still points there,
+ * so a reorganisation can never serve a stale copy. Spent state is not cached
+ * here; it stays in the CTxIndex records in CTxDB.
+ *
+ * The cache is bounded by the serialized size of the transactions it holds and
+ * evicts in least recently used order.
+ */
+class CTxReadCache
+{
+private:
+    struct CEntry
+    {
+        CDiskTxPos pos;
+        CTransaction tx;
+        size_t nSize;
+        std::list<uint256>::iterator itLru;
+    };
+
+    CCriticalSection cs;
+    std::map<uint256, CEntry> mapEntries;
+    std::list<uint256> listLru;
+    size_t nMaxBytes;
+    size_t nBytes;
+
+    void EvictLocked();
+
+public:
+    CTxReadCache();
+
+    void SetMaxSize(size_t nMaxBytesIn);
+    bool Get(const uint256& hash, const CDiskTxPos& pos, CTransaction& txRet);
+    void Add(const uint256& hash, const CDiskTxPos& pos, const CTransaction& tx);
+};
+
+extern CTxReadCache txReadCache;
+
+#endif /* BITCOIN_TXCACHE_H */
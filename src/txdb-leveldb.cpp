@@ -131,6 +131,7 @@ void CTxDB::Close()
     options.block_cache = NULL;
     delete activeBatch;
     activeBatch = NULL;
+    batchOverlay.clear();
 }
 
 bool CTxDB::TxnBegin()
@@ -146,6 +147,7 @@ bool CTxDB::TxnCommit()
     leveldb::Status status = pdb->Write(leveldb::WriteOptions(), activeBatch);
     delete activeBatch;
     activeBatch = NULL;
+    batchOverlay.clear();
     if (!status.ok()) {
         LogPrintf("LevelDB batch commit failure: %s\n", status.ToString());
         return false;
@@ -153,75 +155,224 @@ bool CTxDB::TxnCommit()
     return true;
 }
 
-class CBatchScanner : public leveldb::WriteBatch::Handler {
-public:
-    std::string needle;
-    bool *deleted;
-    std::string *foundValue;
-    bool foundEntry;
-
-    CBatchScanner() : foundEntry(false) {}
-
-    virtual void Put(const leveldb::Slice& key, const leveldb::Slice& value) {
-        if (key.ToString() == needle) {
-            foundEntry = true;
-            *deleted = false;
-            *foundValue = value.ToString();
-        }
-    }
-
-    virtual void Delete(const leveldb::Slice& key) {
-        if (key.ToString() == needle) {
-            foundEntry = true;
-            *deleted = true;
-        }
-    }
-};
-
 // When performing a read, if we have an active batch we need to check it first
 // before reading from the database, as the rest of the code assumes that once
-// a database transaction begins reads are consistent with it. It would be good
-// to change that assumption in future and avoid the performance hit, though in
-// practice it does not appear to be large.
+// a database transaction begins reads are consistent with it. The overlay
+// mirrors the batch so this is a single hash lookup rather than a scan.
 bool CTxDB::ScanBatch(const CDataStream &key, string *value, bool *deleted) const {
     assert(activeBatch);
     *deleted = false;
-    CBatchScanner scanner;
-    scanner.needle = key.str();
-    scanner.deleted = deleted;
-    scanner.foundValue = value;
-    leveldb::Status status = activeBatch->Iterate(&scanner);
-    if (!status.ok()) {
-        throw runtime_error(status.ToString());
+    BatchOverlay::const_iterator it = batchOverlay.find(key.str());
+    if (it == batchOverlay.end())
+        return false;
+    *deleted = it->second.first;
+    if (!*deleted)
+        *value = it->second.second;
+    return true;
+}
+
+bool CTxDB::WriteAddrIndex(uint160 addrHash, int nHeight, unsigned int nTxIndex, uint256 txHash)
+{
+    // One small record per (address, transaction). Writing the same
+    // transaction again for another output or input simply overwrites it.
+    return Write(make_pair(string("ads"), CAddrIndexKey(addrHash, nHeight, nTxIndex)), txHash);
+}
+
+bool CTxDB::EraseAddrIndex(uint160 addrHash, int nHeight, unsigned int nTxIndex)
+{
+    return Erase(make_pair(string("ads"), CAddrIndexKey(addrHash, nHeight, nTxIndex)));
+}
+
+// Removes every address index record, so that -reindexaddr starts from an
+// empty index instead of leaving entries of blocks no longer in the chain.
+bool CTxDB::ClearAddrIndex()
+{
+    CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
+    ssStartKey << make_pair(string("ads"), CAddrIndexKey());
+
+    leveldb::Iterator *iterator = pdb->NewIterator(leveldb::ReadOptions());
+    iterator->Seek(ssStartKey.str());
+    unsigned int nErased = 0;
+    leveldb::WriteBatch batch;
+    for (; iterator->Valid(); iterator->Next())
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey.write(iterator->key().data(), iterator->key().size());
+        string strType;
+        try {
+            ssKey >> strType;
+        }
+        catch (std::exception &e) {
+            break;
+        }
+        if (strType != "ads")
+            break;
+        batch.Delete(iterator->key());
+        if (++nErased % 10000 == 0)
+        {
+            leveldb::Status status = pdb->Write(leveldb::WriteOptions(), &batch);
+            if (!status.ok())
+            {
+                delete iterator;
+                return error("ClearAddrIndex() : %s", status.ToString());
+            }
+            batch.Clear();
+        }
     }
-    return scanner.foundEntry;
+    delete iterator;
+
+    leveldb::Status status = pdb->Write(leveldb::WriteOptions(), &batch);
+    if (!status.ok())
+        return error("ClearAddrIndex() : %s", status.ToString());
+    LogPrintf("ClearAddrIndex() : erased %u records\n", nErased);
+    return true;
 }
 
-bool CTxDB::WriteAddrIndex(uint160 addrHash, uint256 txHash)
+// Reads the transactions of addrHash in chain order. nSkip < 0 counts back
+// from the most recent entry, nCount < 0 returns everything that remains.
+bool CTxDB::ReadAddrIndex(uint160 addrHash, std::vector<uint256>& txHashes, int nSkip, int nCount)
 {
-    std::vector<uint256> txHashes;
-    if(!ReadAddrIndex(addrHash, txHashes))
+    txHashes.clear();
+
+    CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
+    ssStartKey << make_pair(string("ads"), CAddrIndexKey(addrHash, 0, 0));
+    CDataStream ssEndKey(SER_DISK, CLIENT_VERSION);
+    ssEndKey << make_pair(string("ads"), CAddrIndexKey(addrHash, std::numeric_limits<unsigned int>::max(), std::numeric_limits<unsigned int>::max()));
+    const string strStartKey = ssStartKey.str();
+    const string strEndKey = ssEndKey.str();
+
+    leveldb::Iterator *iterator = pdb->NewIterator(leveldb::ReadOptions());
+    if (nSkip < 0)
     {
-	txHashes.push_back(txHash);
-        return Write(make_pair(string("adr"), addrHash), txHashes);
+        // Position on the last entry for this address, then step back.
+        iterator->Seek(strEndKey);
+        if (iterator->Valid())
+            iterator->Prev();
+        else
+            iterator->SeekToLast();
+        while (iterator->Valid() && iterator->key().compare(strStartKey) >= 0 && ++nSkip < 0)
+            iterator->Prev();
+        if (!iterator->Valid() || iterator->key().compare(strStartKey) < 0)
+            iterator->Seek(strStartKey);
     }
     else
     {
-	if(std::find(txHashes.begin(), txHashes.end(), txHash) == txHashes.end()) 
-    	{
-    	    txHashes.push_back(txHash);
-            return Write(make_pair(string("adr"), addrHash), txHashes);
-	}
-	else
-	{
-	    return true; // already have this tx hash
-	}
+        iterator->Seek(strStartKey);
+        while (iterator->Valid() && iterator->key().compare(strEndKey) <= 0 && nSkip-- > 0)
+            iterator->Next();
     }
+
+    for (; iterator->Valid() && nCount != 0; iterator->Next())
+    {
+        if (iterator->key().compare(strEndKey) > 0)
+            break;
+        try {
+            CDataStream ssValue(iterator->value().data(), iterator->value().data() + iterator->value().size(),
+                                SER_DISK, CLIENT_VERSION);
+            uint256 txHash;
+            ssValue >> txHash;
+            txHashes.push_back(txHash);
+        }
+        catch (std::exception &e) {
+            delete iterator;
+            return error("ReadAddrIndex() : deserialize error");
+        }
+        if (nCount > 0)
+            nCount--;
+    }
+    delete iterator;
+    return true;
 }
 
-bool CTxDB::ReadAddrIndex(uint160 addrHash, std::vector<uint256>& txHashes)
+// Converts address index records written by older versions, which stored the
+// whole vector of transaction hashes under ("adr", addrHash), to one record per
+// transaction. Entries whose transaction is no longer in the main chain are
+// dropped, as -reindexaddr would not recreate them either.
+bool CTxDB::MigrateAddrIndex()
 {
-    return Read(make_pair(string("adr"), addrHash), txHashes);
+    leveldb::Iterator *iterator = pdb->NewIterator(leveldb::ReadOptions());
+    CDataStream ssStartKey(SER_DISK, CLIENT_VERSION);
+    ssStartKey << make_pair(string("adr"), uint160(0));
+    iterator->Seek(ssStartKey.str());
+
+    map<pair<unsigned int, unsigned int>, CBlockIndex*> mapBlockPos;
+    map<CBlockIndex*, vector<uint256> > mapBlockTxCache;
+    unsigned int nMigrated = 0;
+    while (iterator->Valid())
+    {
+        boost::this_thread::interruption_point();
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey.write(iterator->key().data(), iterator->key().size());
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        ssValue.write(iterator->value().data(), iterator->value().size());
+        string strType;
+        uint160 addrHash;
+        vector<uint256> txHashes;
+        try {
+            ssKey >> strType;
+            if (strType != "adr")
+                break;
+            ssKey >> addrHash;
+            ssValue >> txHashes;
+        }
+        catch (std::exception &e) {
+            delete iterator;
+            return error("MigrateAddrIndex() : deserialize error");
+        }
+
+        if (mapBlockPos.empty())
+        {
+            LogPrintf("MigrateAddrIndex() : converting address index to per-transaction records\n");
+            for (CBlockIndex* pindex = pindexBest; pindex; pindex = pindex->pprev)
+                mapBlockPos[make_pair(pindex->nFile, pindex->nBlockPos)] = pindex;
+        }
+
+        if (!TxnBegin())
+        {
+            delete iterator;
+            return false;
+        }
+        BOOST_FOREACH(const uint256& txHash, txHashes)
+        {
+            CTxIndex txindex;
+            if (!ReadTxIndex(txHash, txindex))
+                continue;
+            map<pair<unsigned int, unsigned int>, CBlockIndex*>::iterator mi = mapBlockPos.find(make_pair(txindex.pos.nFile, txindex.pos.nBlockPos));
+            if (mi == mapBlockPos.end())
+                continue;
+            CBlockIndex* pindex = mi->second;
+
+            if (!mapBlockTxCache.count(pindex))
+            {
+                if (mapBlockTxCache.size() > 1000)
+                    mapBlockTxCache.clear();
+                CBlock block;
+                if (!block.ReadFromDisk(pindex))
+                    continue;
+                vector<uint256>& vBlockTx = mapBlockTxCache[pindex];
+                BOOST_FOREACH(const CTransaction& tx, block.vtx)
+                    vBlockTx.push_back(tx.GetHash());
+            }
+            const vector<uint256>& vBlockTx = mapBlockTxCache[pindex];
+            vector<uint256>::const_iterator it = std::find(vBlockTx.begin(), vBlockTx.end(), txHash);
+            if (it != vBlockTx.end())
+                WriteAddrIndex(addrHash, pindex->nHeight, it - vBlockTx.begin(), txHash);
+        }
+        Erase(make_pair(string("adr"), addrHash));
+        if (!TxnCommit())
+        {
+            delete iterator;
+            return error("MigrateAddrIndex() : TxnCommit failed");
+        }
+        nMigrated++;
+
+        iterator->Next();
+    }
+    delete iterator;
+
+    if (nMigrated)
+        LogPrintf("MigrateAddrIndex() : converted %u addresses\n", nMigrated);
+    return true;
 }
 
 bool CTxDB::ReadTxIndex(uint256 hash, CTxIndex& txindex)
@@ -399,7 +550,7 @@ bool CTxDB::LoadBlockIndex()
 
     boost::this_thread::interruption_point();
 
-    // Calculate nChainTrust
+    // Calculate nChainTrust and build skip pointers, parents first
     vector<pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
     BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
@@ -412,6 +563,7 @@ bool CTxDB::LoadBlockIndex()
     {
         CBlockIndex* pindex = item.second;
         pindex->nChainTrust = (pindex->pprev ? pindex->pprev->nChainTrust : 0) + pindex->GetBlockTrust();
+        pindex->BuildSkip();
     }
 
     // Load hashBestChain pointer to end of best chain
@@ -424,6 +576,7 @@ bool CTxDB::LoadBlockIndex()
     if (!mapBlockIndex.count(hashBestChain))
         return error("CTxDB::LoadBlockIndex() : hashBestChain not found in the block index");
     pindexBest = mapBlockIndex[hashBestChain];
+    chainActive.SetTip(pindexBest);
     nBestHeight = pindexBest->nHeight;
     nBestChainTrust = pindexBest->nChainTrust;
 
@@ -7,14 +7,59 @@
 #define BITCOIN_LEVELDB_H
 
 #include "main.h"
+#include "crypto/common/common.h"
 
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+// Key of a single address index record, stored as ("ads", key) -> txHash.
+// The height and in-block position are written big-endian so that LevelDB's
+// bytewise ordering walks an address's history in chain order, which lets
+// readers page through it with a plain iterator range scan.
+class CAddrIndexKey
+{
+public:
+    uint160 addrHash;
+    unsigned int nHeight;
+    unsigned int nTxIndex;
+
+    CAddrIndexKey()
+    {
+        addrHash = 0;
+        nHeight = 0;
+        nTxIndex = 0;
+    }
+
+    CAddrIndexKey(uint160 addrHashIn, unsigned int nHeightIn, unsigned int nTxIndexIn)
+    {
+        addrHash = addrHashIn;
+        nHeight = nHeightIn;
+        nTxIndex = nTxIndexIn;
+    }
+
+    IMPLEMENT_SERIALIZE
+    (
+        unsigned char vchPos[8];
+        READWRITE(addrHash);
+        if (!fRead)
+        {
+            WriteBE32(&vchPos[0], nHeight);
+            WriteBE32(&vchPos[4], nTxIndex);
+        }
+        READWRITE(FLATDATA(vchPos));
+        if (fRead)
+        {
+            const_cast<CAddrIndexKey*>(this)->nHeight = ReadBE32(&vchPos[0]);
+            const_cast<CAddrIndexKey*>(this)->nTxIndex = ReadBE32(&vchPos[4]);
+        }
+    )
+};
+
 // Class that provides access to a LevelDB. Note that this class is frequently
 // instantiated on the stack and then destroyed again, so instantiation has to
 // be very cheap. Unfortunately that means, a CTxDB instance is actually just a
@@ -46,6 +91,12 @@ private:
     // A batch stores up writes and deletes for atomic application. When this
     // field is non-NULL, writes/deletes go there instead of directly to disk.
     leveldb::WriteBatch *activeBatch;
+
+    // Index of the writes/deletes queued in activeBatch, keyed by serialized
+    // key. The flag is true for a pending delete. This lets reads made while a
+    // transaction is open see their own writes without iterating the batch.
+    typedef std::unordered_map<std::string, std::pair<bool, std::string> > BatchOverlay;
+    BatchOverlay batchOverlay;
     leveldb::Options options;
     bool fReadOnly;
     int nVersion;
@@ -111,7 +162,10 @@ protected:
         ssValue << value;
 
         if (activeBatch) {
-            activeBatch->Put(ssKey.str(), ssValue.str());
+            std::string strKey = ssKey.str();
+            std::string strValue = ssValue.str();
+            activeBatch->Put(strKey, strValue);
+            batchOverlay[strKey] = std::make_pair(false, strValue);
             return true;
         }
         leveldb::Status status = pdb->Put(leveldb::WriteOptions(), ssKey.str(), ssValue.str());
@@ -134,7 +188,9 @@ protected:
         ssKey.reserve(1000);
         ssKey << key;
         if (activeBatch) {
-            activeBatch->Delete(ssKey.str());
+            std::string strKey = ssKey.str();
+            activeBatch->Delete(strKey);
+            batchOverlay[strKey] = std::make_pair(true, std::string());
             return true;
         }
         leveldb::Status status = pdb->Delete(leveldb::WriteOptions(), ssKey.str());
@@ -151,12 +207,11 @@ protected:
 
         if (activeBatch) {
             bool deleted;
-            if (ScanBatch(ssKey, &unused, &deleted) && !deleted) {
-                return true;
+            if (ScanBatch(ssKey, &unused, &deleted)) {
+                return !deleted;
             }
         }
 
-
         leveldb::Status status = pdb->Get(leveldb::ReadOptions(), ssKey.str(), &unused);
         return status.IsNotFound() == false;
     }
@@ -169,6 +224,7 @@ public:
     {
         delete activeBatch;
         activeBatch = NULL;
+        batchOverlay.clear();
         return true;
     }
 
@@ -183,8 +239,11 @@ public:
         return Write(std::string("version"), nVersion);
     }
 
-    bool ReadAddrIndex(uint160 addrHash, std::vector<uint256>& txHashes);
-    bool WriteAddrIndex(uint160 addrHash, uint256 txHash);
+    bool ReadAddrIndex(uint160 addrHash, std::vector<uint256>& txHashes, int nSkip=0, int nCount=-1);
+    bool WriteAddrIndex(uint160 addrHash, int nHeight, unsigned int nTxIndex, uint256 txHash);
+    bool EraseAddrIndex(uint160 addrHash, int nHeight, unsigned int nTxIndex);
+    bool ClearAddrIndex();
+    bool MigrateAddrIndex();
     bool ReadTxIndex(uint256 hash, CTxIndex& txindex);
     bool UpdateTxIndex(uint256 hash, const CTxIndex& txindex);
     bool AddTxIndex(const CTransaction& tx, const CDiskTxPos& pos, int nHeight);
@@ -9,8 +9,45 @@
 
 using namespace std;
 
+// Bookkeeping the node allocators add to every element, estimated: the
+// multi_index node with three red-black links per index, and a std::map node
+static const size_t MEMPOOL_ENTRY_OVERHEAD = sizeof(CTxMemPoolEntry) + 3 * 3 * sizeof(void*);
+static const size_t MEMPOOL_NEXTTX_OVERHEAD = sizeof(std::pair<const COutPoint, CInPoint>) + 4 * sizeof(void*);
+
+static size_t ScriptUsage(const CScript& script)
+{
+    return script.capacity();
+}
+
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, int64_t _nFee, int64_t _nTime,
+                                 double _dPriority, unsigned int _nHeight, int64_t _nInChainInputValue) :
+    tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight),
+    nInChainInputValue(_nInChainInputValue)
+{
+    hash = tx.GetHash();
+    nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+
+    nUsageSize = tx.vin.capacity() * sizeof(CTxIn) + tx.vout.capacity() * sizeof(CTxOut);
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        nUsageSize += ScriptUsage(txin.scriptSig) + ScriptUsage(txin.prevPubKey);
+    BOOST_FOREACH(const CTxOut& txout, tx.vout)
+        nUsageSize += ScriptUsage(txout.scriptPubKey);
+}
+
+double CTxMemPoolEntry::GetPriority(unsigned int nCurrentHeight) const
+{
+    // Every block since entry adds one confirmation to each in-chain input
+    if (nCurrentHeight <= nHeight)
+        return dPriority;
+    return dPriority + double(nInChainInputValue) * (nCurrentHeight - nHeight) / nTxSize;
+}
+
 CTxMemPool::CTxMemPool()
 {
+    nTransactionsUpdated = 0;
+    fLoaded = false;
+    totalTxSize = 0;
+    cachedInnerUsage = 0;
 }
 
 unsigned int CTxMemPool::GetTransactionsUpdated() const
@@ -25,17 +62,35 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
     nTransactionsUpdated += n;
 }
 
-bool CTxMemPool::addUnchecked(const uint256& hash, CTransaction &tx)
+bool CTxMemPool::IsLoaded() const
+{
+    LOCK(cs);
+    return fLoaded;
+}
+
+void CTxMemPool::SetIsLoaded(bool fLoadedIn)
+{
+    LOCK(cs);
+    fLoaded = fLoadedIn;
+}
+
+bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry)
 {
     // Add to memory pool without checking anything.
     // Used by main.cpp AcceptToMemoryPool(), which DOES do
     // all the appropriate checks.
     LOCK(cs);
     {
-        mapTx[hash] = tx;
+        std::pair<txiter, bool> ret = mapTx.insert(entry);
+        if (!ret.second)
+            return false;
+        const CTransaction& tx = ret.first->GetTx();
         for (unsigned int i = 0; i < tx.vin.size(); i++)
-            mapNextTx[tx.vin[i].prevout] = CInPoint(&mapTx[hash], i);
+            mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
+        totalTxSize += entry.GetTxSize();
+        cachedInnerUsage += entry.DynamicMemoryUsage();
         nTransactionsUpdated++;
+        NotifyEntryAdded(hash);
     }
     return true;
 }
@@ -46,7 +101,8 @@ bool CTxMemPool::remove(const CTransaction &tx, bool fRecursive)
     {
         LOCK(cs);
         uint256 hash = tx.GetHash();
-        if (mapTx.count(hash))
+        txiter it = mapTx.find(hash);
+        if (it != mapTx.end())
         {
             if (fRecursive) {
                 for (unsigned int i = 0; i < tx.vout.size(); i++) {
@@ -57,8 +113,11 @@ bool CTxMemPool::remove(const CTransaction &tx, bool fRecursive)
             }
             BOOST_FOREACH(const CTxIn& txin, tx.vin)
                 mapNextTx.erase(txin.prevout);
-            mapTx.erase(hash);
+            totalTxSize -= it->GetTxSize();
+            cachedInnerUsage -= it->DynamicMemoryUsage();
+            mapTx.erase(it);
             nTransactionsUpdated++;
+            NotifyEntryRemoved(hash);
         }
     }
     return true;
@@ -84,24 +143,59 @@ void CTxMemPool::clear()
     LOCK(cs);
     mapTx.clear();
     mapNextTx.clear();
+    totalTxSize = 0;
+    cachedInnerUsage = 0;
     ++nTransactionsUpdated;
 }
 
+int CTxMemPool::Expire(int64_t nTime)
+{
+    LOCK(cs);
+    vector<CTransaction> vExpired;
+    typedef indexed_transaction_set::index<entry_time>::type::iterator timeiter;
+    for (timeiter it = mapTx.get<entry_time>().begin(); it != mapTx.get<entry_time>().end() && it->GetTime() < nTime; ++it)
+        vExpired.push_back(it->GetTx());
+
+    size_t nSizeBefore = mapTx.size();
+    BOOST_FOREACH(const CTransaction& tx, vExpired)
+        remove(tx, true);
+    return nSizeBefore - mapTx.size();
+}
+
+int CTxMemPool::TrimToSize(size_t nSizeLimit)
+{
+    LOCK(cs);
+    size_t nSizeBefore = mapTx.size();
+    while (!mapTx.empty() && DynamicMemoryUsage() > nSizeLimit)
+    {
+        // Copied, remove() erases the entry it is looking at
+        CTransaction tx = mapTx.get<fee_rate>().begin()->GetTx();
+        remove(tx, true);
+    }
+    return nSizeBefore - mapTx.size();
+}
+
+size_t CTxMemPool::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return mapTx.size() * MEMPOOL_ENTRY_OVERHEAD + mapNextTx.size() * MEMPOOL_NEXTTX_OVERHEAD + cachedInnerUsage;
+}
+
 void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
 {
     vtxid.clear();
 
     LOCK(cs);
     vtxid.reserve(mapTx.size());
-    for (map<uint256, CTransaction>::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
-        vtxid.push_back((*mi).first);
+    for (txiter mi = mapTx.begin(); mi != mapTx.end(); ++mi)
+        vtxid.push_back(mi->GetHash());
 }
 
 bool CTxMemPool::lookup(uint256 hash, CTransaction& result) const
 {
     LOCK(cs);
-    std::map<uint256, CTransaction>::const_iterator i = mapTx.find(hash);
+    txiter i = mapTx.find(hash);
     if (i == mapTx.end()) return false;
-    result = i->second;
+    result = i->GetTx();
     return true;
 }
@@ -6,6 +6,66 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include "chain.h"
+#include "main.h"
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/identity.hpp>
+#include <boost/multi_index/mem_fun.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/signals2/signal.hpp>
+
+/** A transaction in the memory pool, with what the pool knows about it
+ * from when it was accepted: fee, size, arrival time and priority.
+ */
+class CTxMemPoolEntry
+{
+private:
+    CTransaction tx;
+    uint256 hash;
+    int64_t nFee;               // input value minus output value
+    size_t nTxSize;             // serialized size
+    size_t nUsageSize;          // heap memory held by tx
+    int64_t nTime;              // local time when entering the pool
+    double dPriority;           // priority when entering the pool
+    unsigned int nHeight;       // best chain height when entering the pool
+    int64_t nInChainInputValue; // sum of the inputs confirmed at that height
+
+public:
+    CTxMemPoolEntry(const CTransaction& _tx, int64_t _nFee, int64_t _nTime,
+                    double _dPriority, unsigned int _nHeight, int64_t _nInChainInputValue);
+
+    const CTransaction& GetTx() const { return tx; }
+    const uint256& GetHash() const { return hash; }
+    int64_t GetFee() const { return nFee; }
+    size_t GetTxSize() const { return nTxSize; }
+    size_t DynamicMemoryUsage() const { return nUsageSize; }
+    int64_t GetTime() const { return nTime; }
+    unsigned int GetHeight() const { return nHeight; }
+
+    /** Fee in satoshis per 1000 bytes */
+    double GetFeeRate() const { return double(nFee) * 1000.0 / double(nTxSize); }
+
+    /** Priority sum(valuein * age) / txsize, aged to nCurrentHeight */
+    double GetPriority(unsigned int nCurrentHeight) const;
+};
+
+/** Lowest fee rate first, ties broken by hash */
+class CompareTxMemPoolEntryByFeeRate
+{
+public:
+    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
+    {
+        double f1 = double(a.GetFee()) * b.GetTxSize();
+        double f2 = double(b.GetFee()) * a.GetTxSize();
+        if (f1 == f2)
+            return a.GetHash() < b.GetHash();
+        return f1 < f2;
+    }
+};
+
+// Index tags
+struct fee_rate {};
+struct entry_time {};
 
 /*
  * CTxMemPool stores valid-according-to-the-current-best-chain
@@ -21,15 +81,45 @@ class CTxMemPool
 {
 private:
     unsigned int nTransactionsUpdated;
+    bool fLoaded;              // mempool.dat has been read back
+    uint64_t totalTxSize;      // sum of the entries' serialized sizes
+    uint64_t cachedInnerUsage; // sum of the entries' DynamicMemoryUsage()
 
 public:
+    /** Entries by hash (the default index, used like the old std::map),
+      * by fee rate for eviction and by arrival time for expiry */
+    typedef boost::multi_index_container<
+        CTxMemPoolEntry,
+        boost::multi_index::indexed_by<
+            boost::multi_index::ordered_unique<
+                boost::multi_index::const_mem_fun<CTxMemPoolEntry, const uint256&, &CTxMemPoolEntry::GetHash>
+            >,
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<fee_rate>,
+                boost::multi_index::identity<CTxMemPoolEntry>,
+                CompareTxMemPoolEntryByFeeRate
+            >,
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<entry_time>,
+                boost::multi_index::const_mem_fun<CTxMemPoolEntry, int64_t, &CTxMemPoolEntry::GetTime>
+            >
+        >
+    > indexed_transaction_set;
+
+    typedef indexed_transaction_set::nth_index<0>::type::iterator txiter;
+
     mutable CCriticalSection cs;
-    std::map<uint256, CTransaction> mapTx;
+    indexed_transaction_set mapTx;
     std::map<COutPoint, CInPoint> mapNextTx;
 
+    /** Fired with cs held for each transaction entering or leaving the pool,
+      * every call also bumps the GetTransactionsUpdated() counter by one */
+    boost::signals2::signal<void (const uint256& hash)> NotifyEntryAdded;
+    boost::signals2::signal<void (const uint256& hash)> NotifyEntryRemoved;
+
     CTxMemPool();
 
-    bool addUnchecked(const uint256& hash, CTransaction &tx);
+    bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry);
     bool remove(const CTransaction &tx, bool fRecursive = false);
     bool removeConflicts(const CTransaction &tx);
     void clear();
@@ -37,6 +127,28 @@ public:
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
 
+    /** Remove transactions that entered the pool before nTime, and
+      * everything spending them. Returns the number removed. */
+    int Expire(int64_t nTime);
+
+    /** Evict the lowest fee rate transactions, and everything spending
+      * them, until DynamicMemoryUsage() is at most nSizeLimit.
+      * Returns the number removed. */
+    int TrimToSize(size_t nSizeLimit);
+
+    /** Approximate heap memory held by the pool, in bytes */
+    size_t DynamicMemoryUsage() const;
+
+    /** Whether the transactions saved at shutdown have been reloaded yet */
+    bool IsLoaded() const;
+    void SetIsLoaded(bool fLoadedIn);
+
+    uint64_t GetTotalTxSize() const
+    {
+        LOCK(cs);
+        return totalTxSize;
+    }
+
     unsigned long size() const
     {
         LOCK(cs);
@@ -71,6 +71,10 @@ namespace boost {
 # include <sys/prctl.h>
 #endif
 
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
+
 using namespace std;
 
 static const char alphanum[] =
@@ -1330,6 +1334,30 @@ void FileCommit(FILE *fileout)
 #endif
 }
 
+// Raise the soft limit on open files towards nMinFD, returns the limit
+// we ended up with
+int RaiseFileDescriptorLimit(int nMinFD)
+{
+#ifdef WIN32
+    return 2048;
+#else
+    struct rlimit limitFD;
+    if (getrlimit(RLIMIT_NOFILE, &limitFD) != -1)
+    {
+        if (limitFD.rlim_cur < (rlim_t)nMinFD)
+        {
+            limitFD.rlim_cur = nMinFD;
+            if (limitFD.rlim_cur > limitFD.rlim_max)
+                limitFD.rlim_cur = limitFD.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limitFD);
+            getrlimit(RLIMIT_NOFILE, &limitFD);
+        }
+        return std::min(limitFD.rlim_cur, (rlim_t)INT_MAX);
+    }
+    return nMinFD; // getrlimit failed, assume it's fine
+#endif
+}
+
 std::string getTimeString(int64_t timestamp, char *buffer, size_t nBuffer)
 {
     struct tm* dt;
@@ -131,13 +131,11 @@ bool RollingCheckpoints(int nHeight)
     }
     // Define values
     CBlockIndex* pindexCurrentBlock = pindexBest;
-    CBlockIndex* pindexPastBlock = pindexCurrentBlock;
-    // Set count and loop
+    // Jump straight to the checkpoint depth
     int pastBLOCK_1 = (pindexCurrentBlock->nHeight - BLOCK_TEMP_CHECKPOINT_DEPTH);
-    while (pastBLOCK_1 < pindexCurrentBlock->nHeight) {
-        // Index backwards
-        pindexPastBlock = pindexPastBlock->pprev;
-        pastBLOCK_1 ++;
+    CBlockIndex* pindexPastBlock = pindexCurrentBlock->GetAncestor(pastBLOCK_1);
+    if (pindexPastBlock == NULL) {
+        return false;
     }
     // Set output values
     RollingBlock = pindexPastBlock->GetBlockHash();
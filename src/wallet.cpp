@@ -597,6 +597,7 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
             item.second.MarkDirty();
+        mapStakeCandidates.clear();
     }
 }
 
@@ -704,6 +705,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet)
 
         // Break debit/credit balance caches:
         wtx.MarkDirty();
+        UncacheStakeCandidates(wtx);
 
         // Notify UI of new or updated transaction
         NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -2912,6 +2914,145 @@ uint64_t CWallet::GetStakeWeight() const
     return nWeight;
 }
 
+// State shared by the threads of one kernel search
+struct CStakeSearch
+{
+    CBlockIndex* pindexPrev;
+    unsigned int nBits;
+    unsigned int nTime;
+    unsigned int nInterval;
+    const vector<CStakeCandidate>* pvCandidates;
+    vector<unsigned int> vOffset;        // kernel timestamp offset, per candidate
+    std::atomic<unsigned int> nFound;    // lowest candidate index with a kernel so far
+    std::atomic<uint64_t> nKernels;      // kernel hashes evaluated
+    std::atomic<bool> fAbort;
+};
+
+// Worker nWorker of nWorkers checks candidates nStart + nWorker, + nWorkers, ...
+// Stops at the first kernel below nFound, so the search ends on the same
+// candidate a single thread walking the list in order would have picked.
+static void StakeSearchThread(CStakeSearch* search, unsigned int nStart, unsigned int nWorker, unsigned int nWorkers)
+{
+    const vector<CStakeCandidate>& vCandidates = *search->pvCandidates;
+    uint64_t nKernels = 0;
+    for (unsigned int i = nStart + nWorker; i < vCandidates.size() && i < search->nFound; i += nWorkers)
+    {
+        if (search->fAbort || search->pindexPrev != pindexBest)
+            break;
+        boost::this_thread::interruption_point();
+
+        for (unsigned int n = 0; n < search->nInterval; n++)
+        {
+            nKernels++;
+            if (CheckKernel(search->pindexPrev, search->nBits, search->nTime - n, vCandidates[i]))
+            {
+                search->vOffset[i] = n;
+                unsigned int nFound = search->nFound;
+                while (i < nFound && !search->nFound.compare_exchange_weak(nFound, i));
+                break;
+            }
+        }
+    }
+    search->nKernels += nKernels;
+}
+
+// Find the first candidate from nStart on with a kernel at one of the
+// nInterval timestamps up to nTime, using -stakethreads threads
+static bool FindStakeKernel(CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTime, unsigned int nInterval,
+                            const vector<CStakeCandidate>& vCandidates, unsigned int nStart,
+                            unsigned int& nIndexRet, unsigned int& nOffsetRet, uint64_t& nKernels)
+{
+    if (nStart >= vCandidates.size())
+        return false;
+
+    CStakeSearch search;
+    search.pindexPrev = pindexPrev;
+    search.nBits = nBits;
+    search.nTime = nTime;
+    search.nInterval = nInterval;
+    search.pvCandidates = &vCandidates;
+    search.vOffset.resize(vCandidates.size());
+    search.nFound = vCandidates.size();
+    search.nKernels = 0;
+    search.fAbort = false;
+
+    unsigned int nWorkers = std::min((size_t)nStakeThreads, vCandidates.size() - nStart);
+    if (nWorkers <= 1)
+        StakeSearchThread(&search, nStart, 0, 1);
+    else
+    {
+        boost::thread_group threads;
+        for (unsigned int i = 0; i < nWorkers; i++)
+            threads.create_thread(boost::bind(&StakeSearchThread, &search, nStart, i, nWorkers));
+        try {
+            threads.join_all();
+        } catch (boost::thread_interrupted&) {
+            // The workers reference this stack frame, stop them before unwinding
+            search.fAbort = true;
+            threads.join_all();
+            throw;
+        }
+    }
+
+    nKernels += search.nKernels;
+    if (search.nFound >= vCandidates.size())
+        return false;
+    nIndexRet = search.nFound;
+    nOffsetRet = search.vOffset[nIndexRet];
+    return true;
+}
+
+bool CWallet::GetStakeCandidate(CTxDB& txdb, const COutPoint& prevout, CStakeCandidate& candidate)
+{
+    {
+        LOCK(cs_wallet);
+        map<COutPoint, CStakeCandidate>::const_iterator mi = mapStakeCandidates.find(prevout);
+        if (mi != mapStakeCandidates.end())
+        {
+            candidate = mi->second;
+            return true;
+        }
+    }
+
+    if (!ReadStakeCandidate(txdb, prevout, candidate))
+        return false;
+
+    LOCK(cs_wallet);
+    mapStakeCandidates[prevout] = candidate;
+    return true;
+}
+
+// Drop cached stake inputs whose block was disconnected since the last search
+void CWallet::UpdateStakeCandidates(const CBlockIndex* pindexPrev)
+{
+    LOCK(cs_wallet);
+    if (pindexPrev->GetBlockHash() == hashStakeCandidatesTip)
+        return;
+
+    for (map<COutPoint, CStakeCandidate>::iterator it = mapStakeCandidates.begin(); it != mapStakeCandidates.end();)
+    {
+        const CBlockIndex* pindexFrom = it->second.pindexFrom;
+        if (pindexPrev->GetAncestor(pindexFrom->nHeight) != pindexFrom)
+            mapStakeCandidates.erase(it++);
+        else
+            ++it;
+    }
+    hashStakeCandidatesTip = pindexPrev->GetBlockHash();
+}
+
+void CWallet::UncacheStakeCandidates(const CTransaction& tx)
+{
+    AssertLockHeld(cs_wallet);
+    if (mapStakeCandidates.empty())
+        return;
+
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        mapStakeCandidates.erase(txin.prevout);
+    uint256 hash = tx.GetHash();
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+        mapStakeCandidates.erase(COutPoint(hash, i));
+}
+
 bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64_t nSearchInterval, int64_t nFees, CTransaction& txNew, CKey& key)
 {
     CBlockIndex* pindexPrev = pindexBest;
@@ -2946,81 +3087,93 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     int64_t nCredit = 0;
     CScript scriptPubKeyKernel;
     CTxDB txdb("r");
+    UpdateStakeCandidates(pindexPrev);
+
+    // Read every stake input once, then search them for a kernel
+    vector<pair<const CWalletTx*, unsigned int> > vStakeCoins;
+    vector<CStakeCandidate> vCandidates;
     BOOST_FOREACH(PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setCoins)
     {
-        static int nMaxStakeSearchInterval = 60;
-        bool fKernelFound = false;
-        for (unsigned int n=0; n<min(nSearchInterval,(int64_t)nMaxStakeSearchInterval) && !fKernelFound && pindexPrev == pindexBest; n++)
+        CStakeCandidate candidate;
+        if (!GetStakeCandidate(txdb, COutPoint(pcoin.first->GetHash(), pcoin.second), candidate))
+            continue;
+        vStakeCoins.push_back(pcoin);
+        vCandidates.push_back(candidate);
+    }
+
+    // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
+    static int nMaxStakeSearchInterval = 60;
+    unsigned int nInterval = min(nSearchInterval,(int64_t)nMaxStakeSearchInterval);
+    int64_t nSearchStart = GetTimeMicros();
+    uint64_t nKernels = 0;
+    unsigned int nNext = 0;
+    bool fKernelFound = false;
+    while (!fKernelFound)
+    {
+        unsigned int nIndex, n;
+        if (!FindStakeKernel(pindexPrev, nBits, txNew.nTime, nInterval, vCandidates, nNext, nIndex, n, nKernels))
+            break;
+        nNext = nIndex + 1; // if this kernel turns out unusable, carry on after it
+        const pair<const CWalletTx*, unsigned int>& pcoin = vStakeCoins[nIndex];
+
+        // Found a kernel
+        LogPrint("coinstake", "CreateCoinStake : kernel found\n");
+        vector<valtype> vSolutions;
+        txnouttype whichType;
+        CScript scriptPubKeyOut;
+        scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
+        if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
+        {
+            LogPrint("coinstake", "CreateCoinStake : failed to parse kernel\n");
+            continue;
+        }
+        LogPrint("coinstake", "CreateCoinStake : parsed kernel type=%d\n", whichType);
+        if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH)
+        {
+            LogPrint("coinstake", "CreateCoinStake : no support for kernel type=%d\n", whichType);
+            continue;  // only support pay to public key and pay to address
+        }
+        if (whichType == TX_PUBKEYHASH) // pay to address type
         {
-            boost::this_thread::interruption_point();
-            // Search backward in time from the given txNew timestamp
-            // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
-            COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-            int64_t nBlockTime;
-            if (CheckKernel(pindexPrev, nBits, txNew.nTime - n, prevoutStake, &nBlockTime))
+            // convert to pay to public key type
+            if (!keystore.GetKey(uint160(vSolutions[0]), key))
             {
-                // Found a kernel
-                LogPrint("coinstake", "CreateCoinStake : kernel found\n");
-                vector<valtype> vSolutions;
-                txnouttype whichType;
-                CScript scriptPubKeyOut;
-                scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
-                if (!Solver(scriptPubKeyKernel, whichType, vSolutions))
-                {
-                    LogPrint("coinstake", "CreateCoinStake : failed to parse kernel\n");
-                    break;
-                }
-                LogPrint("coinstake", "CreateCoinStake : parsed kernel type=%d\n", whichType);
-                if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH)
-                {
-                    LogPrint("coinstake", "CreateCoinStake : no support for kernel type=%d\n", whichType);
-                    break;  // only support pay to public key and pay to address
-                }
-                if (whichType == TX_PUBKEYHASH) // pay to address type
-                {
-                    // convert to pay to public key type
-                    if (!keystore.GetKey(uint160(vSolutions[0]), key))
-                    {
-                        LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                        break;  // unable to find corresponding public key
-                    }
-                    scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
-                }
-                if (whichType == TX_PUBKEY)
-                {
-                    valtype& vchPubKey = vSolutions[0];
-                    if (!keystore.GetKey(Hash160(vchPubKey), key))
-                    {
-                        LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                        break;  // unable to find corresponding public key
-                    }
-
-                    if (key.GetPubKey() != vchPubKey)
-                    {
-                        LogPrint("coinstake", "CreateCoinStake : invalid key for kernel type=%d\n", whichType);
-                        break; // keys mismatch
-                    }
-
-                    scriptPubKeyOut = scriptPubKeyKernel;
-                }
-
-                txNew.nTime -= n;
-                txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-                nCredit += pcoin.first->vout[pcoin.second].nValue;
-                vwtxPrev.push_back(pcoin.first);
-                txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+                LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                continue;  // unable to find corresponding public key
+            }
+            scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
+        }
+        if (whichType == TX_PUBKEY)
+        {
+            valtype& vchPubKey = vSolutions[0];
+            if (!keystore.GetKey(Hash160(vchPubKey), key))
+            {
+                LogPrint("coinstake", "CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                continue;  // unable to find corresponding public key
+            }
 
-                if(nCredit > GetStakeSplitThreshold())
-                    txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
-                LogPrint("coinstake", "CreateCoinStake : added kernel type=%d\n", whichType);
-                fKernelFound = true;
-                break;
+            if (key.GetPubKey() != vchPubKey)
+            {
+                LogPrint("coinstake", "CreateCoinStake : invalid key for kernel type=%d\n", whichType);
+                continue; // keys mismatch
             }
+
+            scriptPubKeyOut = scriptPubKeyKernel;
         }
 
-        if (fKernelFound)
-            break; // if kernel is found stop searching
+        txNew.nTime -= n;
+        txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
+        nCredit += pcoin.first->vout[pcoin.second].nValue;
+        vwtxPrev.push_back(pcoin.first);
+        txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+
+        if(nCredit > GetStakeSplitThreshold())
+            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
+        LogPrint("coinstake", "CreateCoinStake : added kernel type=%d\n", whichType);
+        fKernelFound = true;
     }
+    nLastCoinStakeSearchTime = GetTimeMicros() - nSearchStart;
+    nLastCoinStakeKernels = nKernels;
 
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
         return false;
@@ -14,6 +14,7 @@
 
 #include "crypter.h"
 #include "main.h"
+#include "kernel.h"
 #include "key.h"
 #include "keystore.h"
 #include "script.h"
@@ -113,6 +114,15 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    // Stake inputs already read from disk by CreateCoinStake, so the kernel
+    // search only hashes timestamps. Entries are dropped when their
+    // transaction changes in the wallet or their block leaves the chain.
+    std::map<COutPoint, CStakeCandidate> mapStakeCandidates;
+    uint256 hashStakeCandidatesTip;
+    bool GetStakeCandidate(CTxDB& txdb, const COutPoint& prevout, CStakeCandidate& candidate);
+    void UpdateStakeCandidates(const CBlockIndex* pindexPrev);
+    void UncacheStakeCandidates(const CTransaction& tx);
+
 public:
     /// Main wallet lock.
     /// This lock protects all the fields added by CWallet